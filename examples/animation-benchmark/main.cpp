@@ -0,0 +1,124 @@
+// times posing a skeleton as its clips grow from 10 to 10,000 keys per channel
+// unbaked clips are sampled by searching for the key every time, and through an animation_cursor; baked clips index their frame directly
+#include <libglplayground.h>
+#include <gltf_writer.h>
+#include <chrono>
+#include <cstdio>
+using namespace libplayground::gl;
+using libplayground_tests::gltf_writer;
+namespace animation_benchmark {
+    constexpr uint32_t joint_count = 32;
+    constexpr float keys_per_second = 30.f;
+    constexpr float frames_per_second = 60.f;
+    constexpr size_t samples_per_run = 20000;
+    // a chain of joints, each with a triangle bound to it and a rotation channel of the given length
+    static void write_skeleton(const std::string& path, uint32_t key_count) {
+        gltf_writer writer;
+        std::vector<glm::vec3> positions, normals;
+        std::vector<glm::vec2> uvs;
+        std::vector<uint16_t> joints;
+        std::vector<glm::vec4> weights;
+        std::vector<uint32_t> indices;
+        for (uint32_t i = 0; i < joint_count; i++) {
+            float x = (float)i;
+            positions.insert(positions.end(), { glm::vec3(x, 0.f, 0.f), glm::vec3(x + 1.f, 0.f, 0.f), glm::vec3(x, 1.f, 0.f) });
+            for (uint32_t j = 0; j < 3; j++) {
+                normals.push_back(glm::vec3(0.f, 0.f, 1.f));
+                uvs.push_back(glm::vec2(0.f));
+                joints.insert(joints.end(), { (uint16_t)i, 0, 0, 0 });
+                weights.push_back(glm::vec4(1.f, 0.f, 0.f, 0.f));
+                indices.push_back(i * 3 + j);
+            }
+        }
+        std::string vertex_count = std::to_string(positions.size());
+        writer.add_accessor(positions.data(), positions.size() * sizeof(glm::vec3), "\"componentType\":5126,\"type\":\"VEC3\",\"count\":" + vertex_count +
+            ",\"min\":[0,0,0],\"max\":[" + std::to_string(joint_count) + ",1,0]");
+        writer.add_accessor(normals.data(), normals.size() * sizeof(glm::vec3), "\"componentType\":5126,\"type\":\"VEC3\",\"count\":" + vertex_count);
+        writer.add_accessor(uvs.data(), uvs.size() * sizeof(glm::vec2), "\"componentType\":5126,\"type\":\"VEC2\",\"count\":" + vertex_count);
+        writer.add_accessor(joints.data(), joints.size() * sizeof(uint16_t), "\"componentType\":5123,\"type\":\"VEC4\",\"count\":" + vertex_count);
+        writer.add_accessor(weights.data(), weights.size() * sizeof(glm::vec4), "\"componentType\":5126,\"type\":\"VEC4\",\"count\":" + vertex_count);
+        writer.add_accessor(indices.data(), indices.size() * sizeof(uint32_t), "\"componentType\":5125,\"type\":\"SCALAR\",\"count\":" + std::to_string(indices.size()));
+        std::vector<glm::mat4> inverse_bind_matrices(joint_count, glm::mat4(1.f));
+        writer.add_accessor(inverse_bind_matrices.data(), inverse_bind_matrices.size() * sizeof(glm::mat4), "\"componentType\":5126,\"type\":\"MAT4\",\"count\":" + std::to_string(joint_count));
+        // every channel shares the same keys
+        std::vector<float> times(key_count);
+        std::vector<glm::vec4> rotations(key_count);
+        for (uint32_t i = 0; i < key_count; i++) {
+            times[i] = (float)i / keys_per_second;
+            float half_angle = sinf((float)i * 0.1f) * 0.25f;
+            rotations[i] = glm::vec4(0.f, 0.f, sinf(half_angle), cosf(half_angle)); // xyzw
+        }
+        writer.add_accessor(times.data(), times.size() * sizeof(float), "\"componentType\":5126,\"type\":\"SCALAR\",\"count\":" + std::to_string(key_count) +
+            ",\"min\":[0],\"max\":[" + std::to_string(times.back()) + "]");
+        writer.add_accessor(rotations.data(), rotations.size() * sizeof(glm::vec4), "\"componentType\":5126,\"type\":\"VEC4\",\"count\":" + std::to_string(key_count));
+        std::vector<std::string> nodes = { "{\"mesh\":0,\"skin\":0}" }, joint_nodes, channels, samplers;
+        for (uint32_t i = 0; i < joint_count; i++) {
+            std::string node = "{\"name\":\"joint" + std::to_string(i) + "\",\"translation\":[1,0,0]";
+            if (i + 1 < joint_count) {
+                node += ",\"children\":[" + std::to_string(i + 2) + "]";
+            }
+            nodes.push_back(node + "}");
+            joint_nodes.push_back(std::to_string(i + 1));
+            channels.push_back("{\"sampler\":" + std::to_string(i) + ",\"target\":{\"node\":" + std::to_string(i + 1) + ",\"path\":\"rotation\"}}");
+            samplers.push_back("{\"input\":7,\"output\":8,\"interpolation\":\"LINEAR\"}");
+        }
+        writer.save(path, "\"scenes\":[{\"nodes\":[0,1]}],"
+            "\"nodes\":[" + gltf_writer::join(nodes) + "],"
+            "\"skins\":[{\"joints\":[" + gltf_writer::join(joint_nodes) + "],\"inverseBindMatrices\":6}],"
+            "\"animations\":[{\"channels\":[" + gltf_writer::join(channels) + "],\"samplers\":[" + gltf_writer::join(samplers) + "]}],"
+            "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2,\"JOINTS_0\":3,\"WEIGHTS_0\":4},\"indices\":5}]}]");
+    }
+    // plays the clip forward one frame at a time, looping, and returns nanoseconds per pose
+    static double time_playback(ref<model> m, model::animation_cursor* cursor) {
+        std::vector<glm::mat4> palette;
+        float time = 0.f;
+        // once untimed, so that every buffer has been allocated
+        m->compute_bone_palette(0, time, palette, cursor);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < samples_per_run; i++) {
+            time += 1.f / frames_per_second;
+            m->compute_bone_palette(0, time, palette, cursor);
+        }
+        auto end = std::chrono::steady_clock::now();
+        return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (double)samples_per_run;
+    }
+    static int run() {
+        if (!glfwInit()) {
+            spdlog::error("GLFW failed to initialize!");
+            return 1;
+        }
+        // models need a context to upload their meshes to, but nothing is drawn
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        ref<window> context = ref<window>::create("Animation benchmark", 64, 64, false, 3, 3);
+        std::filesystem::path directory = std::filesystem::temp_directory_path() / "libglplayground-animation-benchmark";
+        std::filesystem::create_directories(directory);
+        spdlog::set_level(spdlog::level::warn);
+        std::printf("%u joints, %zu poses per run, in nanoseconds per pose\n", joint_count, samples_per_run);
+        std::printf("%8s %12s %12s %12s\n", "keys", "search", "cursor", "baked");
+        for (uint32_t key_count : { 10u, 100u, 1000u, 10000u }) {
+            std::string path = (directory / ("skeleton-" + std::to_string(key_count) + ".gltf")).string();
+            write_skeleton(path, key_count);
+            model::settings s;
+            s.lod_count = 0;
+            s.bake_animations = false;
+            ref<model> keyed = ref<model>::create(path, s);
+            s.bake_animations = true;
+            ref<model> baked = ref<model>::create(path, s);
+            model::animation_cursor cursor;
+            double search_time = time_playback(keyed, nullptr);
+            double cursor_time = time_playback(keyed, &cursor);
+            double baked_time = time_playback(baked, nullptr);
+            std::printf("%8u %12.1f %12.1f %12.1f\n", key_count, search_time, cursor_time, baked_time);
+        }
+        std::filesystem::remove_all(directory);
+        return 0;
+    }
+}
+int main() {
+    try {
+        return animation_benchmark::run();
+    } catch (const std::exception& exc) {
+        spdlog::error(exc.what());
+        return 1;
+    }
+}
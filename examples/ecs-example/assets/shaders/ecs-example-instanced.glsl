@@ -0,0 +1,29 @@
+#shader vertex
+#version 330 core
+layout(location = 0) in vec3 pos;
+layout(location = 2) in vec2 _uv;
+layout(location = 3) in mat4 instance_model;
+layout(location = 7) in float _layer;
+out vec2 uv;
+flat out float layer;
+layout(std140) uniform camera_data {
+    mat4 projection;
+    mat4 view;
+    mat4 view_projection;
+    vec4 camera_position;
+    vec4 viewport;
+};
+void main() {
+    gl_Position = view_projection * instance_model * vec4(pos, 1.0);
+    uv = _uv;
+    layer = _layer;
+}
+#shader fragment
+#version 330 core
+out vec4 out_color;
+in vec2 uv;
+flat in float layer;
+uniform sampler2DArray tex;
+void main() {
+    out_color = texture(tex, vec3(uv, layer));
+}
\ No newline at end of file
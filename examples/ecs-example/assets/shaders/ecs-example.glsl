@@ -2,19 +2,28 @@
 #version 330 core
 layout(location = 0) in vec3 pos;
 layout(location = 2) in vec2 _uv;
+layout(location = 7) in float _layer;
 out vec2 uv;
-uniform mat4 projection;
-uniform mat4 view;
+flat out float layer;
+layout(std140) uniform camera_data {
+    mat4 projection;
+    mat4 view;
+    mat4 view_projection;
+    vec4 camera_position;
+    vec4 viewport;
+};
 uniform mat4 model;
 void main() {
-    gl_Position = projection * view * model * vec4(pos, 1.0);
+    gl_Position = view_projection * model * vec4(pos, 1.0);
     uv = _uv;
+    layer = _layer;
 }
 #shader fragment
 #version 330 core
 out vec4 out_color;
 in vec2 uv;
-uniform sampler2D tex;
+flat in float layer;
+uniform sampler2DArray tex;
 void main() {
-    out_color = texture(tex, uv);
+    out_color = texture(tex, vec3(uv, layer));
 }
\ No newline at end of file
@@ -82,23 +82,29 @@ namespace ecs_example {
                 glm::vec3(0.f),
                 glm::vec3(1.f)
             };
-            std::vector<ref<texture>> textures = {
-                texture::from_file("assets/textures/tex1.png"),
-                texture::from_file("assets/textures/tex2.png")
+            auto& assets = asset_manager::get();
+            // both images have the same size, so they are packed into layers of one array texture
+            auto& packer = texture_manager::get();
+            std::vector<texture_descriptor> textures = {
+                packer.load("assets/textures/tex1.png", "tex"),
+                packer.load("assets/textures/tex2.png", "tex")
             };
+            // every cube references the same geometry and only the texture layer differs, so all of them are drawn in one instanced call
+            auto geometry = ref<shared_geometry>::create(vertices, indices);
             for (size_t i = 0; i < positions.size(); i++) {
                 glm::vec3 pos = positions[i];
                 auto entity = this->m_scene->create();
                 entity.get_component<components::transform_component>().translation = pos;
-                std::vector<texture_descriptor> tex = { { { textures[i % textures.size()] }, "tex" } };
-                entity.add_component<components::mesh_component>(vertices, indices, tex);
+                auto& mesh = entity.add_component<components::mesh_component>();
+                mesh.textures = { textures[i % textures.size()] };
+                mesh.geometry = geometry;
             }
             this->m_camera = this->m_scene->create();
             this->m_camera.add_component<components::camera_component>();
             this->m_camera.add_component<components::script_component>().bind<camera_behavior>();
-            shader_factory factory;
             auto& library = shader_library::get();
-            library["renderer-default"] = factory.single_file("assets/shaders/ecs-example.glsl");
+            library["renderer-default"] = assets.load_shader("assets/shaders/ecs-example.glsl");
+            library["renderer-instanced"] = assets.load_shader("assets/shaders/ecs-example-instanced.glsl");
         }
     private:
         ref<shader> m_shader;
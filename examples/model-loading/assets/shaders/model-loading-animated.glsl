@@ -3,22 +3,36 @@ layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 _uv;
 // todo: add more fields for advanced lighting; though for now, we only need this
-layout(location = 3) in ivec4 bone_ids;
+layout(location = 3) in uvec4 bone_ids;
 layout(location = 4) in vec4 weights;
-uniform mat4 projection;
-uniform mat4 view;
+layout(std140) uniform camera_data {
+    mat4 projection;
+    mat4 view;
+    mat4 view_projection;
+    vec4 camera_position;
+    vec4 viewport;
+};
 uniform mat4 model;
-uniform mat4 bones[100]; // 100 max
+// undoes position quantization; the model sets these to zero and one when positions are stored as floats
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+// every animated model's bones are stored in one buffer; each matrix takes up 4 texels, one per column
+uniform samplerBuffer bone_palette;
+uniform int bone_offset;
 out vec2 uv;
+mat4 get_bone(uint id) {
+    int texel = (bone_offset + int(id)) * 4;
+    return mat4(texelFetch(bone_palette, texel), texelFetch(bone_palette, texel + 1), texelFetch(bone_palette, texel + 2), texelFetch(bone_palette, texel + 3));
+}
 mat4 get_bone_transform() {
-    mat4 matrix = bones[bone_ids[0]] * weights[0];
-    matrix += bones[bone_ids[1]] * weights[1];
-    matrix += bones[bone_ids[2]] * weights[2];
-    matrix += bones[bone_ids[3]] * weights[3];
+    mat4 matrix = get_bone(bone_ids[0]) * weights[0];
+    matrix += get_bone(bone_ids[1]) * weights[1];
+    matrix += get_bone(bone_ids[2]) * weights[2];
+    matrix += get_bone(bone_ids[3]) * weights[3];
     return matrix;
 }
 void main() {
     mat4 bone_transform = get_bone_transform();
-    gl_Position = projection * view * model * bone_transform * vec4(position, 1.0);
+    gl_Position = view_projection * model * bone_transform * vec4(position_offset + position * position_scale, 1.0);
     uv = _uv;
 }
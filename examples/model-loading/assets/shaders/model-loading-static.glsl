@@ -2,11 +2,19 @@
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 _uv;
-uniform mat4 projection;
-uniform mat4 view;
+layout(std140) uniform camera_data {
+    mat4 projection;
+    mat4 view;
+    mat4 view_projection;
+    vec4 camera_position;
+    vec4 viewport;
+};
 uniform mat4 model;
+// undoes position quantization; the model sets these to zero and one when positions are stored as floats
+uniform vec3 position_offset;
+uniform vec3 position_scale;
 out vec2 uv;
 void main() {
-    gl_Position = projection * view * model * vec4(position, 1.0);
+    gl_Position = view_projection * model * vec4(position_offset + position * position_scale, 1.0);
     uv = _uv;
 }
\ No newline at end of file
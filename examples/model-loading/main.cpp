@@ -13,11 +13,18 @@ namespace model_loading {
         model_loading_app() : application("Model loading example", 800, 600, false, major_opengl_version) { }
     protected:
         virtual void load_content() override {
-            shader_factory factory;
+            auto& assets = asset_manager::get();
             auto& library = shader_library::get();
-            library["model-animated"] = factory.multiple_files("assets/shaders/model-loading-animated.glsl", "assets/shaders/model-loading-fragment.glsl");
+            // linked and cooked once, then loaded from the caches on later runs
+            shader::set_binary_cache_directory("shader-cache");
+            model::set_cooked_cache_directory("model-cache");
+            library["model-animated"] = assets.load_shader("assets/shaders/model-loading-animated.glsl", "assets/shaders/model-loading-fragment.glsl");
             this->m_entity = this->m_scene->create();
-            this->m_entity.add_component<components::model_component>(ref<model>::create("assets/models/bee.glb"), -1);
+            // the shaders in this example undo position quantization, so the most compact vertex format can be used
+            model::settings settings;
+            settings.format = vertex_format::compact_layout();
+            settings.use_cooked_cache = true;
+            this->m_entity.add_component<components::model_component>(assets.load_model("assets/models/bee.glb", settings), -1);
             this->m_camera = this->m_scene->create();
             this->m_camera.add_component<components::camera_component>().direction = glm::normalize(glm::vec3(-1.f));
         }
@@ -1,11 +1,16 @@
 #shader vertex
 #version 330 core
 layout(location = 0) in vec3 position;
-uniform mat4 projection;
-uniform mat4 view;
+layout(std140) uniform camera_data {
+    mat4 projection;
+    mat4 view;
+    mat4 view_projection;
+    vec4 camera_position;
+    vec4 viewport;
+};
 uniform mat4 model;
 void main() {
-    gl_Position = projection * view * model * vec4(position, 1.0);
+    gl_Position = view_projection * model * vec4(position, 1.0);
 }
 #shader fragment
 #version 330 core
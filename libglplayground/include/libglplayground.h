@@ -6,6 +6,9 @@
 #include "libglplayground/ref.h"
 #include "libglplayground/window.h"
 #include "libglplayground/input_manager.h"
+#include "libglplayground/culling.h"
+#include "libglplayground/bvh.h"
+#include "libglplayground/occlusion.h"
 #include "libglplayground/renderer.h"
 #include "libglplayground/entity.h"
 #include "libglplayground/scene.h"
@@ -15,8 +18,18 @@
 #include "libglplayground/vertex_array_object.h"
 #include "libglplayground/vertex_buffer_object.h"
 #include "libglplayground/element_buffer_object.h"
+#include "libglplayground/uniform_buffer_object.h"
 #include "libglplayground/shader.h"
+#include "libglplayground/texture_compression.h"
 #include "libglplayground/texture.h"
+#include "libglplayground/texture_manager.h"
+#include "libglplayground/texture_buffer.h"
+
+// redundant state elimination for the above
+#include "libglplayground/state_tracker.h"
+#include "libglplayground/thread_pool.h"
+#include "libglplayground/main_thread_queue.h"
+#include "libglplayground/cooked_file.h"
 
 // class for easily reading and creating shaders
 #include "libglplayground/shader_factory.h"
@@ -25,8 +38,13 @@
 #include "libglplayground/shader_library.h"
 
 // assimp-imported models
+#include "libglplayground/baked_animation.h"
+#include "libglplayground/mesh_optimizer.h"
 #include "libglplayground/model.h"
 
+// path-keyed cache of models, textures and shaders
+#include "libglplayground/asset_manager.h"
+
 // scripting base class
 #include "libglplayground/script.h"
 
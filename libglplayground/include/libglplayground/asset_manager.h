@@ -0,0 +1,54 @@
+#pragma once
+#include "ref.h"
+#include "model.h"
+namespace libplayground {
+    namespace gl {
+        class texture;
+        class shader;
+        // hands out one shared instance per asset, keyed on its canonical path (and the settings it was loaded with)
+        // assets stay cached until collect_garbage finds that nothing else references them
+        // main thread only
+        class asset_manager {
+        public:
+            enum class asset_type {
+                model,
+                texture,
+                shader,
+            };
+            struct asset_info {
+                asset_type type;
+                std::string path;
+                uint32_t references; // not counting the manager's own
+                size_t gpu_memory, cpu_memory; // in bytes
+            };
+            static asset_manager& get();
+            asset_manager(const asset_manager&) = delete;
+            asset_manager& operator=(const asset_manager&) = delete;
+            // the model is imported with model::load_async if it is not cached yet
+            ref<model> load_model(const std::string& path, const model::settings& s = model::settings(), bool async = false);
+            // the texture is streamed in with texture::load_async if it is not cached yet
+            ref<texture> load_texture(const std::string& path, bool async = false);
+            ref<shader> load_shader(const std::string& path);
+            ref<shader> load_shader(const std::string& vertex_path, const std::string& fragment_path, const std::string& geometry_path = "");
+            // when set, models and textures are also matched on a hash of the file's contents, so that copies under different paths are shared
+            // costs a read of the whole file on every load
+            void set_content_deduplication(bool enabled);
+            bool get_content_deduplication() const;
+            // releases every asset that only the manager references; returns how many were released
+            size_t collect_garbage();
+            void clear();
+            std::vector<asset_info> get_assets() const;
+            size_t get_gpu_memory_usage() const;
+        private:
+            asset_manager();
+            template<typename T> struct entry {
+                ref<T> asset;
+                std::string path;
+            };
+            std::unordered_map<std::string, entry<model>> m_models;
+            std::unordered_map<std::string, entry<texture>> m_textures;
+            std::unordered_map<std::string, entry<shader>> m_shaders;
+            bool m_content_deduplication;
+        };
+    }
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+namespace libplayground {
+    namespace gl {
+        class binary_writer;
+        class binary_reader;
+        // an animation clip resampled at a fixed rate
+        // every track is quantized to 16 bits per component and stored as a structure of arrays, so that channels can be decoded 4 at a time
+        // rotations use the "smallest three" encoding; translations and scales are quantized within their own range
+        class baked_animation {
+        public:
+            struct sample {
+                glm::vec3 translation;
+                glm::quat rotation;
+                glm::vec3 scale;
+            };
+            baked_animation() = default;
+            // sampler(channel, time) returns the channel's transform at the given time, in ticks
+            template<typename F> static baked_animation bake(size_t channel_count, float duration, float frames_per_tick, F&& sampler) {
+                baked_animation result;
+                size_t frame_count = std::max((size_t)2, (size_t)std::ceil(duration * frames_per_tick) + 1);
+                std::vector<sample> samples(frame_count * channel_count);
+                for (size_t frame = 0; frame < frame_count; frame++) {
+                    float time = duration * (float)frame / (float)(frame_count - 1);
+                    for (size_t channel = 0; channel < channel_count; channel++) {
+                        samples[frame * channel_count + channel] = sampler(channel, time);
+                    }
+                }
+                result.encode(samples, channel_count, frame_count, duration);
+                return result;
+            }
+            // writes one sample per channel
+            void evaluate(float time, sample* samples) const;
+            size_t get_channel_count() const;
+            size_t get_memory_usage() const;
+            // for cooked model files
+            void write(binary_writer& writer) const;
+            void read(binary_reader& reader);
+        private:
+            void encode(const std::vector<sample>& samples, size_t channel_count, size_t frame_count, float duration);
+            size_t m_channel_count = 0, m_stride = 0, m_frame_count = 0;
+            float m_ticks_per_frame = 0.f;
+            // per channel (padded to the stride): value = min + quantized * scale
+            std::vector<float> m_translation_min[3], m_translation_scale[3], m_scale_min[3], m_scale_scale[3];
+            // per frame, per channel: [frame * stride + channel]
+            std::vector<uint16_t> m_translations[3], m_rotations[3], m_scales[3];
+        };
+    }
+}
\ No newline at end of file
@@ -0,0 +1,138 @@
+#pragma once
+#include "culling.h"
+namespace libplayground {
+    namespace gl {
+        // dynamic bounding volume hierarchy
+        // leaves are refit incrementally as they move, and the whole tree is rebuilt with a binned sah when it degrades
+        class bvh {
+        public:
+            static constexpr uint32_t null_index = std::numeric_limits<uint32_t>::max();
+            bvh();
+            // returns a proxy that stays valid until it is removed, even across rebuilds
+            uint32_t insert(const aabb& box, uint64_t user_data);
+            void remove(uint32_t proxy);
+            // returns true if the tree had to be refit
+            bool update(uint32_t proxy, const aabb& box);
+            void rebuild();
+            // rebuilds if the sah cost has grown past the given ratio of its cost after the last rebuild
+            bool rebuild_if_degraded(float max_cost_ratio = 1.5f);
+            float get_sah_cost() const;
+            size_t size() const;
+            uint64_t get_user_data(uint32_t proxy) const;
+            // the box that was last passed in; node boxes are fattened
+            const aabb& get_bounds(uint32_t proxy) const;
+            // callback(proxy, fully_inside) is called for every leaf whose fat box touches the frustum
+            template<typename F> void query(const frustum& f, F&& callback) const {
+                if (this->m_root == null_index) {
+                    return;
+                }
+                std::vector<std::pair<uint32_t, bool>> stack;
+                stack.push_back({ this->m_root, false });
+                while (!stack.empty()) {
+                    auto [index, inside] = stack.back();
+                    stack.pop_back();
+                    const node& n = this->m_nodes[index];
+                    if (!inside) {
+                        auto result = classify(f, n.box);
+                        if (result == classification::outside) {
+                            continue;
+                        }
+                        inside = result == classification::inside;
+                    }
+                    if (n.is_leaf()) {
+                        callback(n.proxy, inside);
+                    } else {
+                        stack.push_back({ n.left, inside });
+                        stack.push_back({ n.right, inside });
+                    }
+                }
+            }
+            // callback(proxy, entry_distance) is called for leaves hit by the ray, nearest subtrees first
+            // it returns the new maximum distance, so a closest-hit query can return the distance it just accepted
+            template<typename F> void raycast(const glm::vec3& origin, const glm::vec3& direction, float max_distance, F&& callback) const {
+                if (this->m_root == null_index) {
+                    return;
+                }
+                glm::vec3 inverse_direction = 1.f / direction;
+                std::vector<std::pair<uint32_t, float>> stack;
+                float entry;
+                if (!intersect_ray(this->m_nodes[this->m_root].box, origin, inverse_direction, max_distance, entry)) {
+                    return;
+                }
+                stack.push_back({ this->m_root, entry });
+                while (!stack.empty()) {
+                    auto [index, node_entry] = stack.back();
+                    stack.pop_back();
+                    if (node_entry > max_distance) {
+                        continue;
+                    }
+                    const node& n = this->m_nodes[index];
+                    if (n.is_leaf()) {
+                        const aabb& tight = this->m_proxies[n.proxy].bounds;
+                        float leaf_entry;
+                        if (intersect_ray(tight, origin, inverse_direction, max_distance, leaf_entry)) {
+                            max_distance = callback(n.proxy, leaf_entry);
+                        }
+                        continue;
+                    }
+                    float left_entry, right_entry;
+                    bool hit_left = intersect_ray(this->m_nodes[n.left].box, origin, inverse_direction, max_distance, left_entry);
+                    bool hit_right = intersect_ray(this->m_nodes[n.right].box, origin, inverse_direction, max_distance, right_entry);
+                    // push the farther child first so that the nearer one is visited first
+                    if (hit_left && hit_right && left_entry < right_entry) {
+                        stack.push_back({ n.right, right_entry });
+                        stack.push_back({ n.left, left_entry });
+                    } else {
+                        if (hit_left) {
+                            stack.push_back({ n.left, left_entry });
+                        }
+                        if (hit_right) {
+                            stack.push_back({ n.right, right_entry });
+                        }
+                    }
+                }
+            }
+        private:
+            enum class classification {
+                outside,
+                intersecting,
+                inside
+            };
+            struct node {
+                aabb box;
+                uint32_t parent = null_index;
+                uint32_t left = null_index, right = null_index;
+                uint32_t proxy = null_index;
+                bool is_leaf() const {
+                    return this->left == null_index;
+                }
+            };
+            struct proxy_data {
+                aabb bounds;
+                uint64_t user_data;
+                uint32_t node = null_index;
+            };
+            struct build_item {
+                aabb box;
+                glm::vec3 centroid;
+                uint32_t proxy;
+            };
+            static classification classify(const frustum& f, const aabb& box);
+            static bool intersect_ray(const aabb& box, const glm::vec3& origin, const glm::vec3& inverse_direction, float max_distance, float& entry);
+            static aabb fatten(const aabb& box);
+            uint32_t allocate_node();
+            void free_node(uint32_t index);
+            void insert_leaf(uint32_t leaf);
+            void remove_leaf(uint32_t leaf);
+            void refit(uint32_t index);
+            void build_range(std::vector<build_item>& items, size_t begin, size_t end, uint32_t node_index, uint32_t parent, uint32_t depth);
+            std::vector<node> m_nodes;
+            std::vector<uint32_t> m_free_nodes;
+            std::vector<proxy_data> m_proxies;
+            std::vector<uint32_t> m_free_proxies;
+            uint32_t m_root;
+            size_t m_leaf_count;
+            float m_built_cost;
+        };
+    }
+}
\ No newline at end of file
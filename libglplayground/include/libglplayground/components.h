@@ -24,9 +24,39 @@ namespace libplayground {
                 std::vector<vertex> vertices;
                 std::vector<uint32_t> indices;
                 std::vector<texture_descriptor> textures;
+                // the renderer keeps this mesh's buffers on the GPU; call these after editing the data so it gets re-uploaded
+                uint32_t vertex_version = 0;
+                uint32_t index_version = 0;
+                // set if this entity's transform never changes; lets the renderer merge it into a static batch
+                bool is_static = false;
+                // transparent meshes are drawn after opaque geometry, back to front
+                bool is_transparent = false;
+                // rasterized into the scene's occlusion buffer, when occlusion culling is on; best kept to large, simple, opaque meshes like walls
+                bool is_occluder = false;
+                // if set, this is drawn instead of the vertices and indices above, and is instanced with every other entity sharing it
+                ref<shared_geometry> geometry;
+                // local space; recomputed only when the vertex version changes
+                aabb bounds;
+                uint32_t bounds_version = std::numeric_limits<uint32_t>::max();
                 mesh_component() = default;
                 mesh_component(const mesh_component&) = default;
                 mesh_component& operator=(const mesh_component&) = default;
+                void invalidate_vertices() {
+                    this->vertex_version++;
+                }
+                void invalidate_indices() {
+                    this->index_version++;
+                }
+                const aabb& get_bounds() {
+                    if (this->geometry) {
+                        return this->geometry->get_bounds();
+                    }
+                    if (this->bounds_version != this->vertex_version) {
+                        this->bounds = aabb::from_vertices(this->vertices);
+                        this->bounds_version = this->vertex_version;
+                    }
+                    return this->bounds;
+                }
             };
             struct camera_component {
                 glm::vec3 direction, up;
@@ -42,6 +72,12 @@ namespace libplayground {
             struct model_component {
                 ref<model> data;
                 int32_t current_animation = -1;
+                float animation_time = 0.f; // seconds; advanced by the scene every update
+                // evaluated once per update, in parallel across every animated entity, and only read when drawing
+                std::vector<glm::mat4> bone_palette;
+                model::animation_cursor animation_cursor;
+                // picked by the scene every frame from the model's screen space error
+                uint32_t current_lod = 0;
             };
 
             struct script_component {
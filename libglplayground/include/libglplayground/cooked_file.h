@@ -0,0 +1,86 @@
+#pragma once
+#include "ref.h"
+namespace libplayground {
+    namespace gl {
+        // a read-only view of a whole file, paged in by the os as it is touched
+        class mapped_file : public ref_counted {
+        public:
+            // throws if the file cannot be opened
+            mapped_file(const std::string& path);
+            ~mapped_file();
+            mapped_file(const mapped_file&) = delete;
+            mapped_file& operator=(const mapped_file&) = delete;
+            const uint8_t* get_data() const;
+            size_t get_size() const;
+        private:
+            const uint8_t* m_data;
+            size_t m_size;
+#ifdef _WIN32
+            void* m_file;
+            void* m_mapping;
+#endif
+        };
+        // every array in a cooked file starts on this boundary, so that it can be used straight from the mapping
+        constexpr size_t cooked_array_alignment = 16;
+        // builds a cooked file in memory; values are written as-is, so only trivially copyable types can be stored
+        class binary_writer {
+        public:
+            template<typename T> void write(const T& value) {
+                static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable types can be written");
+                this->write_bytes(&value, sizeof(T));
+            }
+            template<typename T> void write_array(const T* data, size_t count) {
+                static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable types can be written");
+                this->write((uint64_t)count);
+                this->align(cooked_array_alignment);
+                this->write_bytes(data, count * sizeof(T));
+            }
+            template<typename T> void write_array(const std::vector<T>& data) {
+                this->write_array(data.data(), data.size());
+            }
+            void write_string(const std::string& value);
+            // no count and no alignment; for files laid out by some other format
+            void write_bytes(const void* data, size_t size);
+            // writes to a temporary file first, so that a reader never sees a partially written file
+            void save(const std::string& path) const;
+        private:
+            void align(size_t alignment);
+            std::vector<uint8_t> m_data;
+        };
+        // reads what binary_writer wrote; throws when reading past the end of the data
+        class binary_reader {
+        public:
+            binary_reader(const uint8_t* data, size_t size);
+            template<typename T> T read() {
+                static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable types can be read");
+                T value;
+                memcpy(&value, this->read_bytes(sizeof(T)), sizeof(T));
+                return value;
+            }
+            // returns a pointer into the underlying data; no copy is made
+            template<typename T> const T* view_array(size_t& count) {
+                static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable types can be read");
+                count = (size_t)this->read<uint64_t>();
+                this->align(cooked_array_alignment);
+                if (count > (this->m_size - this->m_position) / sizeof(T)) {
+                    throw std::runtime_error("Array extends past the end of the file!");
+                }
+                return (const T*)this->read_bytes(count * sizeof(T));
+            }
+            template<typename T> void read_array(std::vector<T>& data) {
+                size_t count;
+                const T* source = this->view_array<T>(count);
+                data.resize(count);
+                if (count > 0) {
+                    memcpy(data.data(), source, count * sizeof(T));
+                }
+            }
+            std::string read_string();
+        private:
+            const uint8_t* read_bytes(size_t size);
+            void align(size_t alignment);
+            const uint8_t* m_data;
+            size_t m_size, m_position;
+        };
+    }
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+namespace libplayground {
+    namespace gl {
+        struct aabb {
+            glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+            glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+            aabb() = default;
+            aabb(const glm::vec3& min, const glm::vec3& max) {
+                this->min = min;
+                this->max = max;
+            }
+            bool is_valid() const {
+                return this->min.x <= this->max.x && this->min.y <= this->max.y && this->min.z <= this->max.z;
+            }
+            glm::vec3 get_center() const {
+                return (this->min + this->max) * 0.5f;
+            }
+            glm::vec3 get_extent() const {
+                return (this->max - this->min) * 0.5f;
+            }
+            void expand(const glm::vec3& point) {
+                this->min = glm::min(this->min, point);
+                this->max = glm::max(this->max, point);
+            }
+            void expand(const aabb& other) {
+                this->min = glm::min(this->min, other.min);
+                this->max = glm::max(this->max, other.max);
+            }
+            // the smallest box containing this box after it has been transformed
+            aabb transformed(const glm::mat4& matrix) const;
+            // works for any vertex type with a "pos" field
+            template<typename T> static aabb from_vertices(const std::vector<T>& vertices) {
+                aabb box;
+                for (const auto& v : vertices) {
+                    box.expand(v.pos);
+                }
+                return box;
+            }
+        };
+        struct frustum {
+            // left, right, bottom, top, near, far; normals point inwards
+            glm::vec4 planes[6];
+            static frustum from_matrix(const glm::mat4& view_projection);
+            bool intersects(const aabb& box) const;
+        };
+        // writes 1 into "visible" for every box that is at least partially inside the frustum, and 0 otherwise
+        // boxes are tested 4 at a time with sse, or 8 at a time when compiled with avx
+        void cull_boxes(const frustum& f, const aabb* boxes, size_t count, uint8_t* visible);
+    }
+}
\ No newline at end of file
@@ -2,17 +2,32 @@
 #include "ref.h"
 namespace libplayground {
     namespace gl {
+        // indices are stored as 16 bit when they all fit, and as 32 bit otherwise
         class element_buffer_object : public ref_counted {
         public:
             element_buffer_object(const std::vector<uint32_t>& data);
+            element_buffer_object(const uint32_t* data, size_t count);
             ~element_buffer_object();
+            // the vertex array object that owns this buffer must be bound
+            void set_data(const std::vector<uint32_t>& data);
             void bind();
             void unbind();
             void draw(GLenum mode);
+            void draw_instanced(GLenum mode, uint32_t instance_count);
+            // draws count indices, starting at the given index
+            void draw_range(GLenum mode, size_t first, size_t count);
             GLuint get();
+            // reads the indices back from the gpu, widened to 32 bit; waits for every pending draw that uses the buffer
+            std::vector<uint32_t> get_data();
+            // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+            GLenum get_index_type() const;
+            // bytes allocated on the gpu
+            size_t get_memory_usage() const;
         private:
+            void upload(const uint32_t* data, size_t count);
             GLuint m_id;
-            size_t m_index_count;
+            GLenum m_index_type;
+            size_t m_index_count, m_capacity;
         };
     }
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/packing.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
 #include <spdlog/spdlog.h>
@@ -23,10 +24,26 @@
 #include <vector>
 #include <memory>
 #include <map>
+#include <set>
 #include <unordered_map>
 #include <utility>
+#include <tuple>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <list>
+#include <array>
+#include <filesystem>
 #include <type_traits>
 #include <stdexcept>
 #include <typeinfo>
 #include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
 #include <stddef.h> // for ::size_t
\ No newline at end of file
@@ -0,0 +1,13 @@
+#pragma once
+namespace libplayground {
+    namespace gl {
+        // work that has to happen on the thread that owns the opengl context, posted from any thread
+        // the application flushes it once per frame, before updating
+        class main_thread_queue {
+        public:
+            static void post(const std::function<void()>& task);
+            // runs every task posted so far, in order
+            static void flush();
+        };
+    }
+}
\ No newline at end of file
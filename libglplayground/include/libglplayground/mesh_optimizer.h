@@ -0,0 +1,45 @@
+#pragma once
+namespace libplayground {
+    namespace gl {
+        // passes over indexed triangle lists, run on models as they are imported
+        // none of these touch opengl, so they are safe to run off the main thread
+        namespace mesh_optimizer {
+            constexpr uint32_t unused_vertex = std::numeric_limits<uint32_t>::max();
+            // one attribute array of a mesh; the bytes of each element are compared as-is, so elements must not have padding
+            struct vertex_stream {
+                const void* data;
+                size_t size, stride;
+            };
+            template<typename T> vertex_stream make_stream(const std::vector<T>& data) {
+                return { data.data(), sizeof(T), sizeof(T) };
+            }
+            // welds vertices whose bytes match in every stream; remap receives the new index of every vertex, or unused_vertex if nothing references it
+            // returns the new vertex count
+            size_t generate_weld_remap(std::vector<uint32_t>& remap, const std::vector<uint32_t>& indices, size_t vertex_count, const std::vector<vertex_stream>& streams);
+            // numbers vertices in the order that the indices first reference them, so that vertex fetch walks memory linearly
+            size_t generate_fetch_remap(std::vector<uint32_t>& remap, const std::vector<uint32_t>& indices, size_t vertex_count);
+            void remap_indices(std::vector<uint32_t>& indices, const std::vector<uint32_t>& remap);
+            template<typename T> void remap_vertices(std::vector<T>& vertices, const std::vector<uint32_t>& remap, size_t new_vertex_count) {
+                std::vector<T> result(new_vertex_count);
+                for (size_t i = 0; i < vertices.size(); i++) {
+                    if (remap[i] != unused_vertex) {
+                        result[remap[i]] = vertices[i];
+                    }
+                }
+                vertices.swap(result);
+            }
+            // reorders triangles for the post-transform vertex cache (Forsyth's linear-speed algorithm)
+            void optimize_vertex_cache(std::vector<uint32_t>& indices, size_t vertex_count);
+            // splits the cache-ordered triangles into clusters and draws the most outward-facing ones first, to cut down on overdraw
+            // a cluster boundary is only added where the cache miss ratio stays within the given factor of the whole mesh's
+            void optimize_overdraw(std::vector<uint32_t>& indices, const vertex_stream& positions, size_t vertex_count, float threshold);
+            // collapses edges in order of quadric error until the index count is at or below the target, or the next collapse would move the surface further than max_error
+            // vertices only ever collapse onto other existing vertices, so attributes and skin weights are never interpolated
+            // open borders, and attribute seams (vertices sharing a position), are left in place
+            // returns the error reached, in the same units as the positions
+            float simplify(std::vector<uint32_t>& destination, const std::vector<uint32_t>& indices, const vertex_stream& positions, size_t vertex_count, size_t target_index_count, float max_error);
+            // average cache misses per triangle, simulating a fifo cache of the given size; 0.5 is about ideal, 3 is the worst case
+            float compute_acmr(const std::vector<uint32_t>& indices, size_t vertex_count, size_t cache_size = 16);
+        }
+    }
+}
\ No newline at end of file
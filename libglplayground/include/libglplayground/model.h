@@ -1,14 +1,20 @@
 #pragma once
 #include "ref.h"
+#include "culling.h"
+#include "shader.h"
+#include "baked_animation.h"
 // Huge credit goes to The Cherno (https://github.com/TheCherno) and his game engine for providing an example for skeletal animation.
 namespace libplayground {
     namespace gl {
         struct vertex; // from renderer.h
-        class shader;
         class texture;
         class vertex_array_object;
         class vertex_buffer_object;
         class element_buffer_object;
+        class texture_buffer;
+        class mapped_file;
+        class binary_writer;
+        class binary_reader;
         struct vertex_bone_data {
             uint32_t ids[4] = { 0, 0, 0, 0 };
             float weights[4] = { 0.f, 0.f, 0.f, 0.f };
@@ -23,31 +29,160 @@ namespace libplayground {
                 spdlog::warn("This vertex has more than four bones and weights affecting it; extra data will not be used");
             }
         };
+        enum class normal_encoding {
+            full, // three floats
+            packed, // GL_INT_2_10_10_10_REV; read by shaders as a normal vec3
+            octahedral, // two snorm16s; shaders decode these themselves when "octahedral_normals" is set
+        };
+        // how model vertices are laid out on the gpu
+        // the default is the full layout, 32 bytes per vertex plus another 32 of bone data for animated models, which every shader can read
+        // compact_layout() is about half that, for shaders that handle it (see the model-loading example)
+        struct vertex_format {
+            vertex_format() {
+                this->quantize_positions = false;
+                this->normals = normal_encoding::full;
+                this->half_uvs = false;
+                this->compact_skinning = false;
+            }
+            static vertex_format compact_layout() {
+                vertex_format format;
+                format.quantize_positions = true;
+                format.normals = normal_encoding::packed;
+                format.half_uvs = true;
+                format.compact_skinning = true;
+                return format;
+            }
+            // 16 bits per component within the mesh's bounds; shaders compute "position_offset + position * position_scale"
+            bool quantize_positions;
+            normal_encoding normals;
+            bool half_uvs;
+            // 8 bit bone ids and unorm8 weights, interleaved with the rest of the vertex; ignored for models with more than 256 bones
+            bool compact_skinning;
+            bool is_full() const {
+                return !this->quantize_positions && this->normals == normal_encoding::full && !this->half_uvs;
+            }
+        };
         class assimp_mesh {
         public:
+            // a range of the index buffer; every level draws from the same vertices
+            struct lod {
+                uint32_t index_offset, index_count;
+                float error; // how far the surface may have moved from the full mesh, in model space
+            };
             std::vector<vertex>& get_vertex_data();
             std::vector<uint32_t>& get_index_data();
             std::vector<vertex_bone_data>& get_bone_data();
-            aiMesh* get_assimp_pointer();
+            // the index data holds every level, one after another; the first level is the full mesh
+            std::vector<lod>& get_lods();
+            const std::vector<lod>& get_lods() const;
+            // empty for meshes loaded from a cooked file, which are uploaded straight from the mapping
+            const std::vector<vertex>& get_vertex_data() const;
+            const std::vector<uint32_t>& get_index_data() const;
+            const std::vector<vertex_bone_data>& get_bone_data() const;
             ref<vertex_array_object> get_vao();
             ref<vertex_buffer_object> get_vbo();
             ref<vertex_buffer_object> get_bone_buffer();
             ref<element_buffer_object> get_ebo();
-            assimp_mesh(aiMesh* ptr, bool is_animated);
-            void setup();
+            const aabb& get_bounds() const;
+            // undoes position quantization; zero and one when positions are stored as floats
+            const glm::vec3& get_position_offset() const;
+            const glm::vec3& get_position_scale() const;
+            size_t get_vertex_count() const;
+            // bytes per vertex on the gpu, including bone data
+            size_t get_vertex_size() const;
+            size_t get_gpu_memory_usage() const;
+            size_t get_cpu_memory_usage() const;
+            // set when the mesh comes from a cooked file; points into the mapping, which the model keeps alive until setup
+            // cooked vertices are already in the layout that the file was cooked with
+            struct mapped_data {
+                const uint8_t* vertices = nullptr;
+                const uint32_t* indices = nullptr;
+                const vertex_bone_data* bone_data = nullptr; // one per vertex, or null for static meshes
+                size_t vertex_count = 0, index_count = 0;
+            };
+            assimp_mesh(bool is_animated);
+            void set_mapped_data(const mapped_data& data, const aabb& bounds);
+            void compute_bounds();
+            // the vertices as they are laid out on the gpu; not for meshes loaded from a cooked file
+            void pack_vertices(const vertex_format& format, size_t bone_count, std::vector<uint8_t>& packed) const;
+            // generates the opengl objects; main thread only
+            void setup(const vertex_format& format, size_t bone_count);
         private:
             std::vector<vertex> m_vertices;
             std::vector<uint32_t> m_indices;
             std::vector<vertex_bone_data> m_bone_data;
-            aiMesh* m_ptr;
+            std::vector<lod> m_lods;
             bool m_is_animated;
             ref<vertex_array_object> m_vao;
             ref<vertex_buffer_object> m_vbo, m_bone_buffer;
             ref<element_buffer_object> m_ebo;
+            aabb m_bounds;
+            glm::vec3 m_position_offset, m_position_scale;
+            size_t m_vertex_count, m_vertex_size;
+            mapped_data m_mapped_data;
         };
         class model : public ref_counted {
         public:
-            model(const std::string& path);
+            // remembers which key every channel was last sampled at, so that playing forward does not search the whole clip
+            // one is kept per animated instance; only clips that are not baked have keys to search, so with bake_animations set (the default) it stays empty
+            // examples/animation-benchmark compares the three ways of sampling
+            struct animation_cursor {
+                int32_t animation = -1;
+                std::vector<uint32_t> keys; // position, rotation and scale for every channel
+            };
+            struct settings {
+                settings() {
+                    this->bake_animations = true;
+                    this->bake_sample_rate = 30.f;
+                    this->use_cooked_cache = false;
+                    this->merge_meshes = true;
+                    this->weld_vertices = true;
+                    this->optimize_vertex_cache = true;
+                    this->optimize_overdraw = true;
+                    this->overdraw_threshold = 1.05f;
+                    this->optimize_vertex_fetch = true;
+                    this->lod_count = 3;
+                    this->lod_reduction = 0.5f;
+                    this->lod_max_error = 0.05f;
+                }
+                // resamples every clip at a fixed rate and quantizes it; far smaller and cheaper to sample, at a slight loss of precision
+                // clips that are not baked keep their original keys, which are found through an animation_cursor
+                bool bake_animations;
+                float bake_sample_rate; // frames per second
+                // loads the cooked copy of the model instead of importing when it is up to date, and writes it when it is not
+                // off by default; see set_cooked_cache_directory for where the copies go
+                bool use_cooked_cache;
+                // import-time mesh optimization (see mesh_optimizer.h)
+                bool merge_meshes; // lets assimp join small meshes, for fewer draw calls
+                bool weld_vertices;
+                bool optimize_vertex_cache;
+                bool optimize_overdraw; // only done along with vertex cache optimization
+                float overdraw_threshold; // how much worse the vertex cache may get in exchange for less overdraw
+                bool optimize_vertex_fetch;
+                // simplified levels generated per mesh, on top of the full mesh
+                uint32_t lod_count;
+                float lod_reduction; // the fraction of triangles each level keeps from the one before it
+                float lod_max_error; // relative to the radius of the mesh's bounds
+                // cooked files hold vertices in this layout, and are cooked again when it changes
+                vertex_format format;
+            };
+            // extension of cooked model files; these are loaded directly, whatever the settings
+            static constexpr const char* cooked_extension = ".cooked";
+            // cooked copies are written here, named after the source file and a hash of its full path
+            // empty (the default) puts them next to the source, as "<path>.cooked"
+            static void set_cooked_cache_directory(const std::string& path);
+            static const std::string& get_cooked_cache_directory();
+            // imports a model and writes its processed vertex, index, skeleton and animation data to a cooked file
+            static void cook(const std::string& source_path, const std::string& cooked_path, const settings& s = settings());
+            enum class load_state {
+                loading,
+                ready,
+                failed,
+            };
+            // imports the model on the thread pool and uploads it on the main thread once that finishes
+            // the model draws nothing and reports no bounds until it is ready
+            static ref<model> load_async(const std::string& path, const settings& s = settings());
+            model(const std::string& path, const settings& s = settings());
             model(const model&) = delete;
             model& operator=(const model&) = delete;
             std::vector<assimp_mesh>& get_meshes();
@@ -57,34 +192,88 @@ namespace libplayground {
             uint32_t get_animation_count() const;
             int32_t find_animation_by_name(const std::string& name) const;
             float get_animation_length(uint32_t index) const;
-            void draw(int32_t animation_index = -1, float animation_time = 0.f);
+            // model space, in the bind pose
+            const aabb& get_bounds() const;
+            bool is_animated() const;
+            load_state get_load_state() const;
+            // in bytes; skeleton and animation data count towards cpu memory
+            size_t get_gpu_memory_usage() const;
+            size_t get_cpu_memory_usage() const;
+            bool is_ready() const;
+            // evaluates the skeleton; the palette receives one matrix per bone
+            void compute_bone_palette(int32_t animation_index, float animation_time, std::vector<glm::mat4>& palette, animation_cursor* cursor = nullptr) const;
+            // meshes with fewer levels than asked for draw their coarsest one
+            // the palette comes from compute_bone_palette and is owned by the caller, so that entities can share a model; empty draws the bind pose
+            void draw(const std::vector<glm::mat4>& palette = std::vector<glm::mat4>(), uint32_t lod = 0);
+            // draws with a palette that has already been uploaded, starting at the given matrix
+            // shaders that declare "bones" as a uniform array instead are given matrices, if set
+            void draw(ref<texture_buffer> palette, uint32_t offset, uint32_t lod = 0, const std::vector<glm::mat4>* matrices = nullptr);
+            uint32_t get_lod_count() const;
+            // the largest error of any mesh at this level, in model space
+            float get_lod_error(uint32_t lod) const;
+            // the texture unit that the bone palette is bound to
+            static constexpr uint32_t bone_palette_slot = 15;
             // todo: replace with a get_vertex_buffer, get_index_buffer, etc. functions when batch rendering comes along
         private:
-            struct bone_info {
-                glm::mat4 bone_offset, final_transform;
+            model();
+            // cpu-side work only; safe to run off the main thread
+            void import(const settings& s);
+            void import_assimp(const settings& s);
+            // throws if the file is damaged; returns false if it does not match the given source stamp and settings
+            bool load_cooked(const std::string& path, const settings* s, uint64_t source_size, int64_t source_time);
+            void write_cooked(const std::string& path, const settings& s, uint64_t source_size, int64_t source_time) const;
+            // creates the opengl objects, in m_vertex_format; main thread only
+            void upload();
+            // joints are sorted so that every parent comes before its children
+            struct joint {
+                int32_t parent; // -1 for the root
+                int32_t bone; // -1 if no vertices are bound to this joint
+                glm::mat4 local_transform;
+            };
+            struct vector_key {
+                float time;
+                glm::vec3 value;
+            };
+            struct rotation_key {
+                float time;
+                glm::quat value;
+            };
+            struct channel {
+                std::vector<vector_key> positions, scales;
+                std::vector<rotation_key> rotations;
+            };
+            struct animation {
+                std::string name;
+                float duration, ticks_per_second;
+                std::vector<int32_t> joint_channels; // an index into channels for every joint, or -1 if the joint is not animated
+                std::vector<channel> channels; // emptied once the clip is baked
+                baked_animation baked;
+                bool is_baked = false;
             };
-            void bone_transform(float time, int32_t animation_index);
-            void read_node_hierarchy(float animation_time, const aiNode* node, const glm::mat4& parent_transform, int32_t animation_index);
-            void traverse_nodes(aiNode* node, const glm::mat4& parent_transform = glm::mat4(1.f), uint32_t level = 0);
-            const aiNodeAnim* find_node_animation(const aiAnimation* animation, const std::string& node_name);
-            uint32_t find_position(float animation_time, const aiNodeAnim* node_animation);
-            uint32_t find_rotation(float animation_time, const aiNodeAnim* node_animation);
-            uint32_t find_scale(float animation_time, const aiNodeAnim* node_animation);
-            glm::vec3 interpolate_translation(float animation_time, const aiNodeAnim* node_animation);
-            glm::quat interpolate_rotation(float animation_time, const aiNodeAnim* node_animation);
-            glm::vec3 interpolate_scale(float animation_time, const aiNodeAnim* node_animation);
-            std::unique_ptr<Assimp::Importer> m_importer;
+            float get_animation_ticks(int32_t animation_index, float animation_time) const;
+            void bind_palette(ref<texture_buffer> palette, uint32_t offset);
+            void draw_meshes(uint32_t lod);
+            void load_skeleton(const aiScene* scene, const std::unordered_map<std::string, uint32_t>& bone_map, bool bake, float sample_rate);
+            void evaluate_pose(float time, int32_t animation_index, std::vector<glm::mat4>& palette, animation_cursor* cursor) const;
+            static glm::vec3 interpolate_translation(float animation_time, const channel& c, uint32_t* cursor);
+            static glm::quat interpolate_rotation(float animation_time, const channel& c, uint32_t* cursor);
+            static glm::vec3 interpolate_scale(float animation_time, const channel& c, uint32_t* cursor);
             glm::mat4 m_inverse_transform;
-            uint32_t m_bone_count = 0;
-            std::vector<bone_info> m_bone_info;
+            std::vector<joint> m_joints;
+            std::vector<glm::mat4> m_bone_offsets;
+            std::vector<animation> m_animations;
             std::vector<assimp_mesh> m_meshes;
-            std::unordered_map<std::string, uint32_t> m_bone_map;
-            std::unordered_map<aiNode*, std::vector<uint32_t>> m_node_map;
-            std::vector<glm::mat4> m_bone_transforms;
-            const aiScene* m_scene;
+            ref<texture_buffer> m_palette_buffer; // used by draw(palette), right before each draw
+            uniform_handle m_bone_palette_uniform, m_bone_offset_uniform, m_bones_uniform;
+            uniform_handle m_position_offset_uniform, m_position_scale_uniform, m_octahedral_normals_uniform;
+            vertex_format m_vertex_format;
             ref<shader> m_shader;
             std::string m_file_path;
             bool m_is_animated;
+            aabb m_bounds;
+            std::vector<float> m_lod_errors;
+            load_state m_load_state;
+            ref<mapped_file> m_cooked_file; // released once uploaded
         };
     }
 }
\ No newline at end of file
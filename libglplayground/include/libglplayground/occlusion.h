@@ -0,0 +1,46 @@
+#pragma once
+#include "culling.h"
+namespace libplayground {
+    namespace gl {
+        // a small cpu depth buffer that occluders are rasterized into, and that boxes are tested against through a max-depth pyramid
+        // rows are filled 8 pixels at a time with avx, 4 with sse, or one at a time otherwise; every path gives the same result
+        // triangles that cross the near plane are skipped, so an occluder can only ever hide less than it should
+        class occlusion_buffer {
+        public:
+            // the width is rounded up to a multiple of 8
+            occlusion_buffer(uint32_t width = 256, uint32_t height = 128);
+            // clears the depth buffer
+            void begin(const glm::mat4& view_projection);
+            // positions are in model space; every 3 indices form a triangle
+            void add_occluder(const glm::vec3* positions, size_t position_stride, const uint32_t* indices, size_t index_count, const glm::mat4& transform);
+            template<typename T> void add_occluder(const std::vector<T>& vertices, const std::vector<uint32_t>& indices, const glm::mat4& transform) {
+                if (vertices.empty()) {
+                    return;
+                }
+                this->add_occluder(&vertices[0].pos, sizeof(T), indices.data(), indices.size(), transform);
+            }
+            // builds the depth pyramid; call after the last occluder
+            void finish();
+            // world space; true unless every texel the box covers has an occluder in front of it
+            bool is_visible(const aabb& box) const;
+            // on by default; off, rows are filled one pixel at a time, which tests compare against
+            void set_simd_enabled(bool enabled);
+            bool is_simd_enabled() const;
+            uint32_t get_width() const;
+            uint32_t get_height() const;
+            // the full resolution level, then every level of the pyramid down to 1x1
+            uint32_t get_level_count() const;
+            // depth in [0, 1] for every texel of the level, row by row
+            const std::vector<float>& get_depth(uint32_t level = 0) const;
+        private:
+            void rasterize_triangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+            struct level {
+                uint32_t width, height;
+                std::vector<float> depth;
+            };
+            glm::mat4 m_view_projection;
+            std::vector<level> m_levels;
+            bool m_simd_enabled;
+        };
+    }
+}
\ No newline at end of file
@@ -2,6 +2,10 @@
 namespace libplayground {
     namespace gl {
         class ref_counted {
+        public:
+            uint32_t get_ref_count() const {
+                return this->m_ref_count;
+            }
         protected:
             ref_counted() {
                 this->m_ref_count = 0;
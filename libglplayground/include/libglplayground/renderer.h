@@ -4,7 +4,10 @@
 #include "vertex_array_object.h"
 #include "vertex_buffer_object.h"
 #include "element_buffer_object.h"
+#include "uniform_buffer_object.h"
+#include "texture_buffer.h"
 #include "texture.h"
+#include "culling.h"
 namespace libplayground {
     namespace gl {
         struct vertex {
@@ -14,34 +17,189 @@ namespace libplayground {
         struct texture_descriptor {
             ref<texture> data;
             std::string uniform_name;
+            // for array textures; meshes whose textures only differ in layer are still batched and instanced together
+            // a draw has a single layer, taken from its first texture, which shaders read from vertex attribute 7
+            uint32_t layer = 0;
         };
         struct mesh {
             glm::mat4 transform;
             std::vector<vertex> vertices;
             std::vector<uint32_t> indices;
             std::vector<texture_descriptor> textures;
+            // transparent meshes are drawn after every opaque one, back to front
+            bool is_transparent = false;
+        };
+        // geometry that can be referenced by many mesh components; it is uploaded once, and every entity using it is drawn in one instanced call
+        class shared_geometry : public ref_counted {
+        public:
+            shared_geometry(const std::vector<vertex>& vertices, const std::vector<uint32_t>& indices);
+            void set_data(const std::vector<vertex>& vertices, const std::vector<uint32_t>& indices);
+            const std::vector<vertex>& get_vertices() const;
+            const std::vector<uint32_t>& get_indices() const;
+            uint32_t get_version() const;
+            const aabb& get_bounds() const;
+        private:
+            std::vector<vertex> m_vertices;
+            std::vector<uint32_t> m_indices;
+            uint32_t m_version = 0;
+            aabb m_bounds;
+        };
+        // identifies a mesh that the renderer keeps resident on the GPU across frames
+        using mesh_cache_key = uint64_t;
+        struct cached_mesh_descriptor {
+            mesh_cache_key key;
+            glm::mat4 transform;
+            // only read during submit(), except for static meshes that are batched, which are read again by render() in the same frame
+            const std::vector<vertex>* vertices = nullptr;
+            const std::vector<uint32_t>* indices = nullptr;
+            const std::vector<texture_descriptor>* textures = nullptr;
+            // a stream is only re-uploaded when its version differs from the resident copy
+            uint32_t vertex_version = 0;
+            uint32_t index_version = 0;
+            // if set, the renderer caches this geometry once instead of per key
+            shared_geometry* geometry = nullptr;
+            // static meshes are merged into shared batches when static batching is enabled
+            bool is_static = false;
+            // transparent meshes are never batched or instanced, and are drawn back to front
+            bool is_transparent = false;
         };
         struct model_descriptor {
             std::function<void(const model_descriptor&)> render_callback; // todo: not this
             glm::mat4 transform;
             int32_t animation_id = -1;
+            // used to sort model draws alongside meshes
+            ref<shader> mesh_shader;
+            bool is_transparent = false;
+            // the palettes of every model are uploaded into one buffer per frame
+            // the renderer fills in the buffer and offset before the render callback is called
+            // the matrices themselves are still needed by shaders that declare "bones" as a uniform array
+            const std::vector<glm::mat4>* bone_palette = nullptr;
+            ref<texture_buffer> bone_palette_buffer;
+            uint32_t bone_palette_offset = 0;
         };
         class renderer : public ref_counted {
         public:
+            struct statistics {
+                uint32_t draw_calls = 0;
+                uint32_t buffer_allocations = 0;
+                uint32_t buffer_uploads = 0;
+                size_t resident_meshes = 0;
+                size_t static_batches = 0;
+                size_t static_meshes = 0;
+                uint32_t culled_static_batches = 0;
+                uint32_t instanced_draw_calls = 0;
+                uint32_t instances = 0;
+                uint32_t bone_palette_matrices = 0;
+            };
             void reset();
+            // should be called before anything is submitted; draws are sorted by distance from the camera
+            // uploads the camera uniform buffer, which every shader declaring "camera_data" reads from
+            void set_camera(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& position, const glm::vec4& viewport);
             void submit(const mesh& m);
+            void submit(const cached_mesh_descriptor& desc);
             void submit(const model_descriptor& model);
+            void evict(mesh_cache_key key);
+            void clear_cache();
             void render();
+            // merges static meshes that share a texture set into pre-transformed batches; off by default
+            void set_static_batching(bool enabled);
+            bool is_static_batching_enabled() const;
+            const statistics& get_statistics() const;
         private:
+            using texture_set_key = std::vector<std::pair<const texture*, std::string>>;
+            struct static_mesh {
+                texture_set_key batch; // only rebuilt when the mesh's textures change
+                uint32_t layer;
+                glm::mat4 transform;
+                uint32_t vertex_version, index_version;
+                uint64_t last_used_frame;
+                // as submitted, and only valid in the frame they were submitted in; every member of a batch is resubmitted before it is rebuilt
+                const std::vector<vertex>* vertices = nullptr;
+                const std::vector<uint32_t>* indices = nullptr;
+            };
+            struct static_batch {
+                std::vector<texture_descriptor> textures;
+                std::set<mesh_cache_key> members;
+                ref<vertex_array_object> vao;
+                ref<vertex_buffer_object> vbo;
+                ref<vertex_buffer_object> layer_vbo; // a layer per vertex, since members may use different layers
+                ref<element_buffer_object> ebo;
+                size_t index_count = 0;
+                aabb bounds; // world space
+                bool dirty = true;
+            };
+            void submit_static(const cached_mesh_descriptor& desc);
+            void remove_stale_static_meshes();
+            void rebuild_static_batch(static_batch& batch);
+            // meshes submitted without shared geometry that have the same contents
+            // the buffers of the first one are kept, so that a matching hash can be confirmed against the gpu copy without a cpu copy
+            struct mesh_contents {
+                ref<vertex_buffer_object> vbo;
+                ref<element_buffer_object> ebo;
+                size_t vertex_count = 0, index_count = 0;
+                uint32_t users = 0;
+            };
+            struct resident_mesh {
+                ref<vertex_array_object> vao;
+                ref<vertex_buffer_object> vbo;
+                ref<element_buffer_object> ebo;
+                ref<shared_geometry> geometry; // keeps the key of the geometry cache alive
+                uint32_t vertex_version, index_version;
+                // meshes with the same key have identical contents; the geometry, or an entry of m_mesh_contents
+                const void* instance_key = nullptr;
+                uint64_t content_hash = 0;
+                uint64_t last_used_frame;
+            };
             struct assembled_mesh {
                 std::vector<texture_descriptor> textures;
                 ref<vertex_array_object> vao;
                 ref<vertex_buffer_object> vbo;
                 ref<element_buffer_object> ebo;
                 glm::mat4 transform;
+                const void* instance_key = nullptr; // null if this mesh cannot be instanced
+                bool is_transparent = false;
+            };
+            enum class draw_command_type {
+                static_batch,
+                mesh,
+                instanced,
+                model
+            };
+            struct draw_command {
+                uint64_t key;
+                draw_command_type type;
+                const void* data;
+                size_t first_instance;
             };
+            uint64_t make_sort_key(bool transparent, ref<shader> program, const std::vector<texture_descriptor>* textures, ref<vertex_array_object> vao, const glm::vec3& position);
+            void make_resident(resident_mesh& resident, bool is_new, const std::vector<vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t vertex_version, uint32_t index_version);
+            void acquire_mesh_contents(resident_mesh& resident, const std::vector<vertex>& vertices, const std::vector<uint32_t>& indices);
+            // returns whether the mesh's buffers are still the reference copy for other meshes with the same contents
+            bool release_mesh_contents(resident_mesh& resident);
+            void render_instanced(const std::vector<const assembled_mesh*>& group, size_t first_instance);
             std::vector<assembled_mesh> m_meshes;
             std::vector<model_descriptor> m_models;
+            std::unordered_map<mesh_cache_key, resident_mesh> m_mesh_cache;
+            std::unordered_map<const shared_geometry*, resident_mesh> m_geometry_cache;
+            std::unordered_multimap<uint64_t, mesh_contents> m_mesh_contents;
+            ref<vertex_buffer_object> m_instance_buffer, m_instance_layer_buffer;
+            std::vector<glm::mat4> m_instance_transforms;
+            std::vector<float> m_instance_layers;
+            std::vector<std::vector<const assembled_mesh*>> m_instance_groups;
+            std::vector<draw_command> m_commands, m_sort_scratch;
+            ref<texture_buffer> m_bone_palette_buffer;
+            std::vector<glm::mat4> m_bone_palettes;
+            std::unordered_map<uint64_t, uint32_t> m_texture_set_ids;
+            glm::vec3 m_camera_position = glm::vec3(0.f);
+            ref<uniform_buffer_object> m_camera_buffer;
+            frustum m_frustum;
+            bool m_has_camera = false;
+            std::unordered_map<mesh_cache_key, static_mesh> m_static_meshes;
+            std::map<texture_set_key, static_batch> m_static_batches;
+            size_t m_static_submissions = 0; // distinct static meshes submitted this frame
+            bool m_static_batching = false;
+            uint64_t m_frame = 0;
+            statistics m_statistics;
         };
     }
 }
\ No newline at end of file
@@ -1,20 +1,80 @@
 #pragma once
 #include "ref.h"
+#include "culling.h"
+#include "bvh.h"
+#include "occlusion.h"
 namespace libplayground {
     namespace gl {
         class renderer;
         class window;
         class entity;
+        namespace components {
+            struct model_component;
+        }
+        struct raycast_hit {
+            entt::entity hit = entt::null;
+            float distance = 0.f;
+        };
         class scene : public ref_counted {
         public:
+            scene();
             entity create();
             void destroy(const entity& entity);
             void update();
             void render(ref<renderer> renderer, ref<window> window);
             entity get_primary_camera_entity();
+            // tests the ray against the world space bounds of every mesh and model, and returns the closest hit
+            raycast_hit raycast(const glm::vec3& origin, const glm::vec3& direction, float max_distance = std::numeric_limits<float>::max());
+            // models use the coarsest level whose error covers fewer pixels than the threshold
+            // a model only moves to a coarser level once its error is below (1 - hysteresis) of the threshold, so that it does not flicker between two
+            void set_lod_threshold(float pixels, float hysteresis = 0.25f);
+            // hides meshes and models that are behind occluder meshes; off by default
+            void set_occlusion_culling(bool enabled);
+            bool is_occlusion_culling_enabled() const;
+            // how many entities passed frustum culling but were hidden by occluders last frame
+            size_t get_occluded_count() const;
             template<typename T> void on_component_added(entity& ent, T& component);
         private:
+            uint64_t get_mesh_cache_key(entt::entity handle) const;
+            void on_mesh_component_destroyed(entt::registry& registry, entt::entity handle);
+            void on_model_component_destroyed(entt::registry& registry, entt::entity handle);
+            void on_transform_component_destroyed(entt::registry& registry, entt::entity handle);
+            // what an entity's world space bounds were computed from; they are only refit when this changes
+            struct bounds_source {
+                glm::vec3 translation, rotation, scale;
+                const void* data = nullptr; // the shared geometry or model
+                uint32_t version = 0; // of the shared geometry or the mesh's vertices
+                bool operator==(const bounds_source& other) const;
+            };
+            struct spatial_proxy {
+                uint32_t proxy;
+                bounds_source source;
+            };
+            void remove_proxy(std::unordered_map<entt::entity, spatial_proxy>& proxies, entt::entity handle);
+            void sync_proxy(std::unordered_map<entt::entity, spatial_proxy>& proxies, entt::entity handle, uint32_t kind, const bounds_source& source, const std::function<aabb()>& get_bounds);
+            // refits the entities whose transform or geometry changed since the last call, however it was changed
+            void sync_spatial_index();
+            void cull_occluded(const glm::mat4& view_projection, const frustum& camera_frustum);
+            void update_animations(float delta_time);
+            void select_lod(components::model_component& model, const glm::mat4& transform, const glm::vec3& camera_position, float pixels_per_unit) const;
+            // declared before the registry so that they outlive its destruction signals
+            uint32_t m_id;
+            std::vector<uint64_t> m_evicted_meshes;
+            bvh m_spatial_index;
+            std::unordered_map<entt::entity, spatial_proxy> m_mesh_proxies, m_model_proxies;
+            uint32_t m_frames_since_rebuild_check;
             entt::registry m_registry;
+            // reused every frame by frustum culling
+            std::vector<uint32_t> m_cull_proxies;
+            std::vector<entt::entity> m_visible_meshes, m_visible_models;
+            std::vector<aabb> m_cull_boxes;
+            std::vector<uint8_t> m_cull_results;
+            double m_last_update_time;
+            float m_lod_threshold, m_lod_hysteresis;
+            occlusion_buffer m_occlusion_buffer;
+            bool m_occlusion_culling;
+            size_t m_occluded_count;
+            std::vector<components::model_component*> m_animated_models;
             friend class entity;
         };
         // entity methods (from entity.h)
@@ -5,15 +5,38 @@ namespace libplayground {
         struct shader_source {
             std::string vertex, fragment, geometry; // will add more later
         };
+        // a uniform resolved ahead of time; only valid for the shader that returned it
+        struct uniform_handle {
+            int32_t index = -1;
+            bool is_valid() const {
+                return this->index >= 0;
+            }
+        };
         class shader : public ref_counted {
         public:
+            struct statistics {
+                uint64_t uniform_updates = 0, uniform_updates_elided = 0;
+            };
             shader(const shader_source& source);
             ~shader();
+            // linked programs are saved here, and loaded back instead of being compiled again when the sources and driver match
+            // empty (the default) turns the cache off; it is also skipped if the driver offers no binary formats
+            static void set_binary_cache_directory(const std::string& path);
+            static const std::string& get_binary_cache_directory();
             void bind();
             void unbind();
             GLuint get();
+            // true if this shader declares the "camera_data" uniform block, which is kept up to date by the renderer
+            bool uses_camera_buffer() const;
+
+            // every active uniform is reflected when the shader is linked; array elements are listed as "name[index]"
+            // returns an invalid handle if the uniform does not exist, or was optimized out
+            uniform_handle get_uniform_handle(const std::string& name) const;
+            // returns GL_INVALID_INDEX if the block does not exist
+            GLuint get_uniform_block_index(const std::string& name) const;
 
             // uniform functions
+            // the shader must be bound; values equal to the last one set are not sent again
             void uniform_int(const std::string& name, GLint value);
             void uniform_uint(const std::string& name, GLuint value);
             void uniform_float(const std::string& name, GLfloat value);
@@ -21,9 +44,38 @@ namespace libplayground {
             void uniform_vec3(const std::string& name, const glm::vec3& value);
             void uniform_vec4(const std::string& name, const glm::vec4& value);
             void uniform_mat4(const std::string& name, const glm::mat4& value, bool transpose = false);
+            void uniform_int(uniform_handle handle, GLint value);
+            void uniform_uint(uniform_handle handle, GLuint value);
+            void uniform_float(uniform_handle handle, GLfloat value);
+            void uniform_vec2(uniform_handle handle, const glm::vec2& value);
+            void uniform_vec3(uniform_handle handle, const glm::vec3& value);
+            void uniform_vec4(uniform_handle handle, const glm::vec4& value);
+            void uniform_mat4(uniform_handle handle, const glm::mat4& value, bool transpose = false);
+            // uploads consecutive elements of an array, starting at the given element, in one call; values are not cached
+            void uniform_mat4_array(uniform_handle first, const glm::mat4* values, size_t count);
+            const statistics& get_statistics() const;
+            void reset_statistics();
         private:
-            GLint get_uniform_location(const std::string& name);
+            struct uniform_slot {
+                GLint location;
+                GLenum type;
+                uint8_t value[sizeof(glm::mat4)];
+                bool has_value = false;
+            };
+            void link(const shader_source& source, bool retrievable);
+            // false if there is no usable binary, in which case the program has to be linked from source
+            bool load_binary(const std::string& path, uint64_t key);
+            void save_binary(const std::string& path, uint64_t key) const;
+            void reflect();
+            void add_uniform(const std::string& name, GLint location, GLenum type);
+            // records the value, and returns false if it is the same as the one already set
+            template<typename T> bool should_update(uniform_handle handle, const T& value);
             GLuint m_id;
+            bool m_uses_camera_buffer;
+            std::vector<uniform_slot> m_uniforms;
+            std::unordered_map<std::string, int32_t> m_uniform_indices;
+            std::unordered_map<std::string, GLuint> m_uniform_blocks;
+            statistics m_statistics;
         };
     }
 }
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+namespace libplayground {
+    namespace gl {
+        // mirrors the binding state of an opengl context so that redundant binds never reach the driver
+        // every wrapper (shader, vertex_array_object, vertex_buffer_object, element_buffer_object, texture) routes its binds through here
+        class state_tracker {
+        public:
+            struct statistics {
+                uint64_t program_binds = 0, program_binds_elided = 0;
+                uint64_t vertex_array_binds = 0, vertex_array_binds_elided = 0;
+                uint64_t buffer_binds = 0, buffer_binds_elided = 0;
+                uint64_t texture_binds = 0, texture_binds_elided = 0;
+                uint64_t active_texture_changes = 0, active_texture_changes_elided = 0;
+            };
+            // the tracker of the current context
+            static state_tracker& get();
+            static void remove(GLFWwindow* context);
+            state_tracker();
+            state_tracker(const state_tracker&) = delete;
+            state_tracker& operator=(const state_tracker&) = delete;
+            void use_program(GLuint program);
+            void bind_vertex_array(GLuint vertex_array);
+            void bind_buffer(GLenum target, GLuint buffer);
+            void active_texture(uint32_t slot);
+            // binds to the active texture unit
+            void bind_texture(GLenum target, GLuint texture);
+            void bind_texture(uint32_t slot, GLenum target, GLuint texture);
+            // deleted objects are unbound by opengl, and their names may be reused
+            void on_program_deleted(GLuint program);
+            void on_vertex_array_deleted(GLuint vertex_array);
+            void on_buffer_deleted(GLuint buffer);
+            void on_texture_deleted(GLuint texture);
+            // call after code that bypasses the tracker (e.g. imgui) has touched the context
+            void invalidate();
+            const statistics& get_statistics() const;
+            void reset_statistics();
+        private:
+            static constexpr GLuint unknown = ~(GLuint)0;
+            GLuint m_program, m_vertex_array, m_array_buffer, m_element_array_buffer;
+            std::unordered_map<GLenum, GLuint> m_buffers; // every other buffer target
+            uint32_t m_active_texture;
+            std::unordered_map<uint64_t, GLuint> m_textures; // (slot << 32) | target
+            statistics m_statistics;
+        };
+    }
+}
\ No newline at end of file
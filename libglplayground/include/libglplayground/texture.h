@@ -1,5 +1,6 @@
 #pragma once
 #include "ref.h"
+#include "texture_compression.h"
 namespace libplayground {
     namespace gl {
         class texture : public ref_counted {
@@ -15,14 +16,76 @@ namespace libplayground {
                 GLenum wrap_t;
                 GLenum format;
             };
+            struct cook_settings {
+                cook_settings() {
+                    this->pick_format = true;
+                    this->format = texture_compression::format::none;
+                    this->filter = texture_compression::mip_filter::kaiser;
+                    this->srgb = true;
+                }
+                // bc1 for opaque images, bc3 when any texel is translucent, and bc4 or bc5 for one and two channel images
+                // when not set, format is used; format::none keeps 8 bits per channel
+                bool pick_format;
+                texture_compression::format format;
+                texture_compression::mip_filter filter;
+                // filter colors in linear space; clear for data like roughness or height maps
+                bool srgb;
+            };
+            // how the levels of an image sit in memory; defined in texture.cpp
+            struct image_layout;
             texture(const std::vector<uint8_t>& data, int32_t width, int32_t height, int32_t channels, const settings& s = settings());
             ~texture();
             void bind(uint32_t slot);
             GLuint get();
+            // bytes allocated on the gpu, including mips; approximate, since the driver picks the layout
+            size_t get_memory_usage() const;
+            // false while a streamed texture still shows its placeholder
+            bool is_ready() const;
+            // files with the cooked extension are uploaded level by level, as stored; anything else goes through stb_image
             static ref<texture> from_file(const std::string& path);
+            // returns a 1x1 white placeholder right away; the image is decoded on a worker, straight into a pixel buffer object,
+            // and uploaded from there on a later frame, within the upload budget
+            static ref<texture> load_async(const std::string& path, const settings& s = settings());
+            // bytes of image data uploaded per frame at most; 0 means no limit
+            // at least one image is uploaded per frame, however large it is
+            static void set_upload_budget(size_t bytes);
+            static size_t get_upload_budget();
+            // textures requested with load_async that are not ready yet
+            static size_t get_pending_count();
+            // advances streamed textures; the application calls this once per frame, after flushing the main thread queue
+            static void update_streaming();
+            // waits for workers still reading files, then drops every upload in flight; their textures keep the placeholder
+            // the application calls this on shutdown, while the context is still alive
+            static void cancel_streaming();
+            // extension of cooked texture files
+            static constexpr const char* cooked_extension = ".dds";
+            // decodes an image and writes it, with its whole mip chain and block compressed, to a dds file
+            // bc1 and bc3 fall back to uncompressed levels at load time if the context cannot sample them
+            static void cook(const std::string& source_path, const std::string& cooked_path, const cook_settings& s = cook_settings());
+            // room for layer_count images of the same size and channel count, each with a full mip chain; layers start out undefined
+            // the settings' target is ignored
+            static ref<texture> create_array(int32_t width, int32_t height, int32_t channels, uint32_t layer_count, const settings& s = settings());
+            // array textures only; the layer's mips are built on the cpu, so that the other layers are left alone
+            void set_layer(uint32_t layer, const uint8_t* pixels);
+            // array textures only; the layers that still fit keep their contents
+            void set_layer_count(uint32_t layer_count);
+            // 0 unless this is an array texture
+            uint32_t get_layer_count() const;
         private:
+            texture(const settings& s);
+            void apply_settings();
+            void allocate_layers(uint32_t layer_count);
+            // data is either client memory or, with a pixel unpack buffer bound, null
+            void set_levels(const image_layout& layout, const uint8_t* data);
+            void set_image(const void* data, int32_t width, int32_t height, int32_t channels);
             GLuint m_id;
             GLenum m_target;
+            GLenum m_format;
+            settings m_settings;
+            int32_t m_width, m_height, m_channels; // array textures only
+            uint32_t m_layer_count;
+            size_t m_memory_usage;
+            bool m_ready;
         };
     }
-}
\ No newline at end of file
+}
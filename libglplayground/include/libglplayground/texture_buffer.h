@@ -0,0 +1,23 @@
+#pragma once
+#include "ref.h"
+namespace libplayground {
+    namespace gl {
+        // a buffer that shaders read through a samplerBuffer with texelFetch
+        class texture_buffer : public ref_counted {
+        public:
+            texture_buffer(GLenum internal_format = GL_RGBA32F);
+            ~texture_buffer();
+            // the existing storage is reused if the new data fits
+            template<typename T> void set_data(const std::vector<T>& data) {
+                this->update(data.data(), data.size() * sizeof(T));
+            }
+            void bind(uint32_t slot);
+            GLuint get();
+        private:
+            void update(const void* data, size_t length);
+            GLuint m_buffer, m_texture;
+            GLenum m_internal_format;
+            size_t m_capacity;
+        };
+    }
+}
\ No newline at end of file
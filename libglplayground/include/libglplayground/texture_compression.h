@@ -0,0 +1,35 @@
+#pragma once
+namespace libplayground {
+    namespace gl {
+        // cpu-side work for cooking textures: mip generation and block compression
+        // none of these touch opengl, so they are safe to run off the main thread
+        namespace texture_compression {
+            enum class format {
+                none, // 8 bits per channel
+                bc1, // rgb, 4 bits per pixel
+                bc3, // rgba, 8 bits per pixel
+                bc4, // r, 4 bits per pixel
+                bc5, // rg, 8 bits per pixel; meant for normal maps
+                bc7, // rgba, 8 bits per pixel; can be loaded but not compressed
+            };
+            enum class mip_filter {
+                box,
+                kaiser, // sharper than box, at the cost of slight ringing
+            };
+            // 0 for format::none
+            size_t get_block_size(format f);
+            // channels is only used for format::none
+            size_t get_level_size(format f, int32_t width, int32_t height, int32_t channels);
+            // channels of the pixels compress takes and decompress returns
+            int32_t get_channel_count(format f);
+            uint32_t get_mip_count(int32_t width, int32_t height);
+            // returns every level, the full size image first; pixels are 8 bits per channel
+            // with srgb set, color channels are filtered in linear space and stored gamma encoded again; alpha is always linear
+            std::vector<std::vector<uint8_t>> generate_mips(const uint8_t* pixels, int32_t width, int32_t height, int32_t channels, mip_filter filter, bool srgb);
+            // pixels must have get_channel_count(f) channels; destination must hold get_level_size(f, width, height, 0) bytes
+            void compress(format f, const uint8_t* pixels, int32_t width, int32_t height, uint8_t* destination);
+            // bc1 through bc5 only; destination must hold width * height * get_channel_count(f) bytes
+            void decompress(format f, const uint8_t* blocks, int32_t width, int32_t height, uint8_t* destination);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "ref.h"
+#include "renderer.h"
+namespace libplayground {
+    namespace gl {
+        // packs images that share a size and channel count into the layers of array textures
+        // the renderer batches and instances meshes whose textures only differ in layer, so these can share a draw
+        // shaders sample the arrays as sampler2DArray, with the layer from vertex attribute 7
+        // main thread only
+        class texture_manager {
+        public:
+            struct statistics {
+                size_t arrays = 0;
+                size_t used_layers = 0;
+                size_t allocated_layers = 0;
+                // free layers below the last used layer of their array; the rest can only be filled by growing into them
+                size_t holes = 0;
+                // used_layers / allocated_layers
+                float occupancy = 0.f;
+                // holes / free layers; 0 when every free layer sits at the end of its array
+                float fragmentation = 0.f;
+                size_t gpu_memory = 0; // in bytes
+            };
+            static texture_manager& get();
+            texture_manager(const texture_manager&) = delete;
+            texture_manager& operator=(const texture_manager&) = delete;
+            // an image loaded again from the same path gets the same layer, and has to be removed as many times
+            texture_descriptor load(const std::string& path, const std::string& uniform_name);
+            texture_descriptor add(const uint8_t* pixels, int32_t width, int32_t height, int32_t channels, const std::string& uniform_name);
+            // frees the layer for the next image of the same format; an array is released once it is empty
+            void remove(const texture_descriptor& desc);
+            // arrays start small and double until they have this many layers; after that, another array is started
+            // clamped to what the context supports
+            void set_max_layers(uint32_t layers);
+            uint32_t get_max_layers() const;
+            statistics get_statistics() const;
+            void clear();
+        private:
+            texture_manager();
+            struct array_page {
+                ref<texture> data;
+                std::vector<uint32_t> references; // per allocated layer; 0 if free
+                uint32_t used_count = 0;
+            };
+            // width, height, channels
+            using format_key = std::tuple<int32_t, int32_t, int32_t>;
+            struct path_entry {
+                ref<texture> data;
+                uint32_t layer;
+            };
+            texture_descriptor allocate(const format_key& key);
+            std::map<format_key, std::vector<array_page>> m_pages;
+            std::unordered_map<std::string, path_entry> m_paths;
+            uint32_t m_max_layers;
+        };
+    }
+}
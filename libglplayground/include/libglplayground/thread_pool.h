@@ -0,0 +1,29 @@
+#pragma once
+namespace libplayground {
+    namespace gl {
+        // a fixed set of worker threads for data-parallel work within a frame
+        // ref-counted objects must not be copied on workers; their counts are not atomic
+        class thread_pool {
+        public:
+            static thread_pool& get();
+            // defaults to one worker per hardware thread, minus the calling thread
+            thread_pool(size_t thread_count = 0);
+            ~thread_pool();
+            thread_pool(const thread_pool&) = delete;
+            thread_pool& operator=(const thread_pool&) = delete;
+            // splits [0, count) into ranges and runs callback(begin, end) on the workers and the calling thread
+            // returns once every range is done, rethrowing the first exception thrown by any of them
+            void parallel_for(size_t count, const std::function<void(size_t begin, size_t end)>& callback, size_t min_range_size = 16);
+            // runs the task on a worker at some point; exceptions must be handled by the task
+            void submit(const std::function<void()>& task);
+            size_t get_thread_count() const;
+        private:
+            void worker();
+            std::vector<std::thread> m_threads;
+            std::queue<std::function<void()>> m_tasks;
+            std::mutex m_mutex;
+            std::condition_variable m_condition;
+            bool m_stopping;
+        };
+    }
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+#include "ref.h"
+namespace libplayground {
+    namespace gl {
+        // binding points reserved by the library; shaders that declare these blocks are bound to them when they are linked
+        enum class uniform_buffer_binding : uint32_t {
+            camera = 0
+        };
+        // std140 layout of the "camera_data" block
+        struct camera_data {
+            glm::mat4 projection;
+            glm::mat4 view;
+            glm::mat4 view_projection;
+            glm::vec4 position; // w is unused
+            glm::vec4 viewport; // x, y, width, height
+        };
+        class uniform_buffer_object : public ref_counted {
+        public:
+            uniform_buffer_object(size_t size, uint32_t binding);
+            ~uniform_buffer_object();
+            template<typename T> void set_data(const T& data, size_t offset = 0) {
+                this->update(&data, sizeof(T), offset);
+            }
+            void bind();
+            void unbind();
+            // attaches the whole buffer to its binding point
+            void bind_base();
+            GLuint get();
+        private:
+            void update(const void* data, size_t length, size_t offset);
+            size_t m_size;
+            uint32_t m_binding;
+            GLuint m_id;
+        };
+    }
+}
\ No newline at end of file
@@ -6,6 +6,8 @@ namespace libplayground {
             GLenum type;
             size_t elements, stride, offset;
             bool normalized;
+            // advance per instance instead of per vertex when nonzero
+            uint32_t divisor = 0;
         };
         class vertex_array_object : public ref_counted {
         public:
@@ -13,7 +15,8 @@ namespace libplayground {
             ~vertex_array_object();
             void bind();
             void unbind();
-            void add_vertex_attributes(const std::vector<vertex_attribute>& attributes);
+            void add_vertex_attributes(const std::vector<vertex_attribute>& attributes, uint32_t first_index = 0);
+            void disable_vertex_attributes(uint32_t first_index, uint32_t count);
             GLuint get();
         private:
             GLuint m_id;
@@ -8,14 +8,28 @@ namespace libplayground {
                 this->init(data.data(), data.size() * sizeof(T));
                 this->m_vertex_count = data.size();
             }
+            template<typename T> vertex_buffer_object(const T* data, size_t count) {
+                this->init(data, count * sizeof(T));
+                this->m_vertex_count = count;
+            }
             ~vertex_buffer_object();
+            // re-uploads the buffer in place; the existing storage is reused if the new data fits
+            template<typename T> void set_data(const std::vector<T>& data) {
+                this->update(data.data(), data.size() * sizeof(T));
+                this->m_vertex_count = data.size();
+            }
             void bind();
             void unbind();
             void draw(GLenum mode);
             GLuint get();
+            // reads the first length bytes back from the gpu; waits for every pending draw that uses the buffer
+            void get_data(void* destination, size_t length);
+            // bytes allocated on the gpu
+            size_t get_memory_usage() const;
         private:
             void init(const void* data, size_t length);
-            size_t m_vertex_count;
+            void update(const void* data, size_t length);
+            size_t m_vertex_count, m_capacity;
             GLuint m_id;
         };
     }
@@ -6,6 +6,11 @@
 #include "application.h"
 #include "components.h"
 #include "input_manager.h"
+#include "state_tracker.h"
+#include "main_thread_queue.h"
+#include "asset_manager.h"
+#include "texture_manager.h"
+#include "texture.h"
 #ifdef BUILT_IMGUI
 #include <backends/imgui_impl_glfw.h>
 #include <backends/imgui_impl_opengl3.h>
@@ -75,6 +80,9 @@ namespace libplayground {
             this->load_content();
             running = ref<application>(this);
             while (!this->m_window->should_window_close() && !this->m_terminated) {
+                // finish work handed back by other threads, e.g. models that finished loading
+                main_thread_queue::flush();
+                texture::update_streaming();
                 input_manager::get()->update();
                 this->update();
                 this->m_scene->update();
@@ -85,11 +93,17 @@ namespace libplayground {
                 this->m_scene->render(this->m_renderer, this->m_window);
                 this->m_renderer->render();
                 imgui_end_frame(this->m_window);
+                // imgui binds its own programs, vertex arrays and textures
+                state_tracker::get().invalidate();
                 this->m_window->swap_buffers();
                 this->m_window->poll_events();
             }
             spdlog::info("Shutting down...");
             this->unload_content();
+            // cached assets and uploads in flight have to go while the context is still alive
+            texture::cancel_streaming();
+            asset_manager::get().clear();
+            texture_manager::get().clear();
             terminate_imgui();
         }
         void application::quit() {
@@ -0,0 +1,162 @@
+#include "libglppch.h"
+#include "asset_manager.h"
+#include "texture.h"
+#include "shader.h"
+#include "shader_factory.h"
+namespace libplayground {
+    namespace gl {
+        // falls back to the path as given if it cannot be resolved, so that the loader reports the error
+        static std::string canonicalize(const std::string& path) {
+            std::error_code error;
+            auto canonical = std::filesystem::weakly_canonical(path, error);
+            if (error) {
+                return path;
+            }
+            return canonical.generic_string();
+        }
+        // fnv-1a; returns an empty string if the file cannot be read
+        static std::string hash_file(const std::string& path) {
+            std::ifstream file(path, std::ios::binary);
+            if (!file.is_open()) {
+                return "";
+            }
+            uint64_t hash = 14695981039346656037ull;
+            char buffer[64 * 1024];
+            while (file) {
+                file.read(buffer, sizeof(buffer));
+                std::streamsize count = file.gcount();
+                for (std::streamsize i = 0; i < count; i++) {
+                    hash = (hash ^ (uint8_t)buffer[i]) * 1099511628211ull;
+                }
+            }
+            std::stringstream stream;
+            stream << "#" << std::hex << hash;
+            return stream.str();
+        }
+        // the same file loaded with different settings is a different asset
+        static std::string get_settings_key(const model::settings& s) {
+            const auto& f = s.format;
+            std::stringstream stream;
+            // separated, so that neighbouring numbers cannot run together into the same key
+            stream << "|" << s.bake_animations << "," << s.bake_sample_rate << "," << s.use_cooked_cache << "," << s.merge_meshes << "," << s.weld_vertices
+                << "," << s.optimize_vertex_cache << "," << s.optimize_overdraw << "," << s.overdraw_threshold << "," << s.optimize_vertex_fetch
+                << "," << s.lod_count << "," << s.lod_reduction << "," << s.lod_max_error
+                << "," << f.quantize_positions << "," << (int32_t)f.normals << "," << f.half_uvs << "," << f.compact_skinning;
+            return stream.str();
+        }
+        template<typename T> static size_t release_unreferenced(std::unordered_map<std::string, T>& assets) {
+            size_t released = 0;
+            for (auto it = assets.begin(); it != assets.end();) {
+                if (it->second.asset->get_ref_count() == 1) {
+                    it = assets.erase(it);
+                    released++;
+                } else {
+                    it++;
+                }
+            }
+            return released;
+        }
+        asset_manager& asset_manager::get() {
+            static asset_manager instance;
+            return instance;
+        }
+        asset_manager::asset_manager() {
+            this->m_content_deduplication = false;
+        }
+        ref<model> asset_manager::load_model(const std::string& path, const model::settings& s, bool async) {
+            std::string canonical = canonicalize(path);
+            std::string key = this->m_content_deduplication ? hash_file(canonical) : "";
+            if (key.empty()) {
+                key = canonical;
+            }
+            key += get_settings_key(s);
+            auto it = this->m_models.find(key);
+            if (it != this->m_models.end()) {
+                return it->second.asset;
+            }
+            ref<model> asset = async ? model::load_async(canonical, s) : ref<model>::create(canonical, s);
+            this->m_models.insert({ key, { asset, canonical } });
+            return asset;
+        }
+        ref<texture> asset_manager::load_texture(const std::string& path, bool async) {
+            std::string canonical = canonicalize(path);
+            std::string key = this->m_content_deduplication ? hash_file(canonical) : "";
+            if (key.empty()) {
+                key = canonical;
+            }
+            auto it = this->m_textures.find(key);
+            if (it != this->m_textures.end()) {
+                return it->second.asset;
+            }
+            ref<texture> asset = async ? texture::load_async(canonical) : texture::from_file(canonical);
+            this->m_textures.insert({ key, { asset, canonical } });
+            return asset;
+        }
+        ref<shader> asset_manager::load_shader(const std::string& path) {
+            std::string key = canonicalize(path);
+            auto it = this->m_shaders.find(key);
+            if (it != this->m_shaders.end()) {
+                return it->second.asset;
+            }
+            shader_factory factory;
+            ref<shader> asset = factory.single_file(key);
+            this->m_shaders.insert({ key, { asset, key } });
+            return asset;
+        }
+        ref<shader> asset_manager::load_shader(const std::string& vertex_path, const std::string& fragment_path, const std::string& geometry_path) {
+            std::string vertex = canonicalize(vertex_path), fragment = canonicalize(fragment_path);
+            std::string geometry = geometry_path.empty() ? "" : canonicalize(geometry_path);
+            std::string key = vertex + "|" + fragment + "|" + geometry;
+            auto it = this->m_shaders.find(key);
+            if (it != this->m_shaders.end()) {
+                return it->second.asset;
+            }
+            shader_factory factory;
+            ref<shader> asset = factory.multiple_files(vertex, fragment, geometry);
+            this->m_shaders.insert({ key, { asset, key } });
+            return asset;
+        }
+        void asset_manager::set_content_deduplication(bool enabled) {
+            this->m_content_deduplication = enabled;
+        }
+        bool asset_manager::get_content_deduplication() const {
+            return this->m_content_deduplication;
+        }
+        size_t asset_manager::collect_garbage() {
+            size_t released = release_unreferenced(this->m_models);
+            released += release_unreferenced(this->m_textures);
+            released += release_unreferenced(this->m_shaders);
+            if (released > 0) {
+                spdlog::info("Released " + std::to_string(released) + " unreferenced asset(s)");
+            }
+            return released;
+        }
+        void asset_manager::clear() {
+            this->m_models.clear();
+            this->m_textures.clear();
+            this->m_shaders.clear();
+        }
+        std::vector<asset_manager::asset_info> asset_manager::get_assets() const {
+            std::vector<asset_info> assets;
+            assets.reserve(this->m_models.size() + this->m_textures.size() + this->m_shaders.size());
+            for (const auto& [key, e] : this->m_models) {
+                assets.push_back({ asset_type::model, e.path, e.asset->get_ref_count() - 1, e.asset->get_gpu_memory_usage(), e.asset->get_cpu_memory_usage() });
+            }
+            for (const auto& [key, e] : this->m_textures) {
+                assets.push_back({ asset_type::texture, e.path, e.asset->get_ref_count() - 1, e.asset->get_memory_usage(), 0 });
+            }
+            for (const auto& [key, e] : this->m_shaders) {
+                // program sizes are not exposed by opengl
+                assets.push_back({ asset_type::shader, e.path, e.asset->get_ref_count() - 1, 0, 0 });
+            }
+            return assets;
+        }
+        size_t asset_manager::get_gpu_memory_usage() const {
+            size_t size = 0;
+            for (const auto& info : this->get_assets()) {
+                size += info.gpu_memory;
+            }
+            return size;
+        }
+    }
+}
\ No newline at end of file
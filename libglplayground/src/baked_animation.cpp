@@ -0,0 +1,283 @@
+#include "libglppch.h"
+#include "baked_animation.h"
+#include "cooked_file.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIBGLPLAYGROUND_SSE2
+#include <emmintrin.h>
+#endif
+namespace libplayground {
+    namespace gl {
+        // the three smallest components of a unit quaternion are within [-1/sqrt(2), 1/sqrt(2)]
+        constexpr float smallest_three_range = 0.70710678f;
+        constexpr float max_quantized_component = 32767.f; // 15 bits; the low bit of each word holds part of the index
+        constexpr float max_quantized_value = 65535.f;
+        static void encode_rotation(const glm::quat& rotation, uint16_t* words) {
+            float values[4] = { rotation.x, rotation.y, rotation.z, rotation.w };
+            size_t largest = 0;
+            for (size_t i = 1; i < 4; i++) {
+                if (fabsf(values[i]) > fabsf(values[largest])) {
+                    largest = i;
+                }
+            }
+            // q and -q are the same rotation, so the largest component can always be made positive
+            float sign = values[largest] < 0.f ? -1.f : 1.f;
+            size_t slot = 0;
+            for (size_t i = 0; i < 4; i++) {
+                if (i == largest) {
+                    continue;
+                }
+                float normalized = glm::clamp(values[i] * sign / smallest_three_range * 0.5f + 0.5f, 0.f, 1.f);
+                words[slot++] = (uint16_t)((uint16_t)lroundf(normalized * max_quantized_component) << 1);
+            }
+            words[0] |= (uint16_t)(largest & 1);
+            words[1] |= (uint16_t)((largest >> 1) & 1);
+        }
+        static glm::quat decode_rotation(uint16_t a, uint16_t b, uint16_t c) {
+            size_t largest = (size_t)((a & 1) | ((b & 1) << 1));
+            float components[3];
+            uint16_t words[3] = { a, b, c };
+            for (size_t i = 0; i < 3; i++) {
+                components[i] = ((float)(words[i] >> 1) / max_quantized_component * 2.f - 1.f) * smallest_three_range;
+            }
+            float largest_value = sqrtf(std::max(0.f, 1.f - components[0] * components[0] - components[1] * components[1] - components[2] * components[2]));
+            float values[4];
+            size_t slot = 0;
+            for (size_t i = 0; i < 4; i++) {
+                values[i] = i == largest ? largest_value : components[slot++];
+            }
+            return glm::quat(values[3], values[0], values[1], values[2]);
+        }
+        static uint16_t quantize(float value, float min, float range) {
+            if (range <= 0.f) {
+                return 0;
+            }
+            return (uint16_t)lroundf(glm::clamp((value - min) / range, 0.f, 1.f) * max_quantized_value);
+        }
+        void baked_animation::encode(const std::vector<sample>& samples, size_t channel_count, size_t frame_count, float duration) {
+            this->m_channel_count = channel_count;
+            this->m_stride = (channel_count + 3) & ~(size_t)3;
+            this->m_frame_count = frame_count;
+            this->m_ticks_per_frame = duration / (float)(frame_count - 1);
+            for (size_t k = 0; k < 3; k++) {
+                this->m_translation_min[k].assign(this->m_stride, 0.f);
+                this->m_translation_scale[k].assign(this->m_stride, 0.f);
+                this->m_scale_min[k].assign(this->m_stride, 0.f);
+                this->m_scale_scale[k].assign(this->m_stride, 0.f);
+                this->m_translations[k].assign(this->m_stride * frame_count, 0);
+                this->m_scales[k].assign(this->m_stride * frame_count, 0);
+                this->m_rotations[k].assign(this->m_stride * frame_count, 0);
+            }
+            for (size_t channel = 0; channel < this->m_stride; channel++) {
+                if (channel >= channel_count) {
+                    // padding decodes to an identity rotation
+                    uint16_t words[3];
+                    encode_rotation(glm::quat(1.f, 0.f, 0.f, 0.f), words);
+                    for (size_t frame = 0; frame < frame_count; frame++) {
+                        for (size_t k = 0; k < 3; k++) {
+                            this->m_rotations[k][frame * this->m_stride + channel] = words[k];
+                        }
+                    }
+                    continue;
+                }
+                glm::vec3 translation_min(std::numeric_limits<float>::max()), translation_max(-std::numeric_limits<float>::max());
+                glm::vec3 scale_min = translation_min, scale_max = translation_max;
+                for (size_t frame = 0; frame < frame_count; frame++) {
+                    const auto& s = samples[frame * channel_count + channel];
+                    translation_min = glm::min(translation_min, s.translation);
+                    translation_max = glm::max(translation_max, s.translation);
+                    scale_min = glm::min(scale_min, s.scale);
+                    scale_max = glm::max(scale_max, s.scale);
+                }
+                glm::vec3 translation_range = translation_max - translation_min;
+                glm::vec3 scale_range = scale_max - scale_min;
+                for (glm::length_t k = 0; k < 3; k++) {
+                    this->m_translation_min[k][channel] = translation_min[k];
+                    this->m_translation_scale[k][channel] = translation_range[k] / max_quantized_value;
+                    this->m_scale_min[k][channel] = scale_min[k];
+                    this->m_scale_scale[k][channel] = scale_range[k] / max_quantized_value;
+                }
+                for (size_t frame = 0; frame < frame_count; frame++) {
+                    const auto& s = samples[frame * channel_count + channel];
+                    size_t index = frame * this->m_stride + channel;
+                    uint16_t words[3];
+                    encode_rotation(glm::normalize(s.rotation), words);
+                    for (glm::length_t k = 0; k < 3; k++) {
+                        this->m_translations[k][index] = quantize(s.translation[k], translation_min[k], translation_range[k]);
+                        this->m_scales[k][index] = quantize(s.scale[k], scale_min[k], scale_range[k]);
+                        this->m_rotations[k][index] = words[k];
+                    }
+                }
+            }
+        }
+#if defined(LIBGLPLAYGROUND_SSE2)
+        static __m128 load_quantized(const uint16_t* data) {
+            __m128i words = _mm_loadl_epi64((const __m128i*)data);
+            return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, _mm_setzero_si128()));
+        }
+        static __m128 select_lanes(__m128 mask, __m128 a, __m128 b) {
+            return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+        }
+        static void decode_rotations(const uint16_t* a, const uint16_t* b, const uint16_t* c, __m128* result) {
+            __m128i words[3] = {
+                _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)a), _mm_setzero_si128()),
+                _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)b), _mm_setzero_si128()),
+                _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)c), _mm_setzero_si128())
+            };
+            __m128i one = _mm_set1_epi32(1);
+            __m128i largest = _mm_or_si128(_mm_and_si128(words[0], one), _mm_slli_epi32(_mm_and_si128(words[1], one), 1));
+            __m128 components[3];
+            __m128 sum = _mm_setzero_ps();
+            for (size_t i = 0; i < 3; i++) {
+                __m128 value = _mm_cvtepi32_ps(_mm_srli_epi32(words[i], 1));
+                value = _mm_sub_ps(_mm_mul_ps(value, _mm_set1_ps(2.f / max_quantized_component)), _mm_set1_ps(1.f));
+                components[i] = _mm_mul_ps(value, _mm_set1_ps(smallest_three_range));
+                sum = _mm_add_ps(sum, _mm_mul_ps(components[i], components[i]));
+            }
+            __m128 largest_value = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.f), sum), _mm_setzero_ps()));
+            __m128 is_x = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_set1_epi32(0)));
+            __m128 is_y = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_set1_epi32(1)));
+            __m128 is_z = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_set1_epi32(2)));
+            __m128 is_w = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_set1_epi32(3)));
+            // the stored components are the other three, in order
+            result[0] = select_lanes(is_x, largest_value, components[0]);
+            result[1] = select_lanes(is_x, components[0], select_lanes(is_y, largest_value, components[1]));
+            result[2] = select_lanes(is_w, components[2], select_lanes(is_z, largest_value, components[1]));
+            result[3] = select_lanes(is_w, largest_value, components[2]);
+        }
+#endif
+        void baked_animation::evaluate(float time, sample* samples) const {
+            if (this->m_frame_count == 0) {
+                return;
+            }
+            // a clip without duration (a single pose) bakes every frame identically, and would divide 0 by 0
+            float frame = 0.f;
+            if (this->m_ticks_per_frame > 0.f) {
+                frame = glm::clamp(time / this->m_ticks_per_frame, 0.f, (float)(this->m_frame_count - 1));
+            }
+            size_t first_frame = (size_t)frame;
+            size_t second_frame = std::min(first_frame + 1, this->m_frame_count - 1);
+            float factor = frame - (float)first_frame;
+            size_t first = first_frame * this->m_stride, second = second_frame * this->m_stride;
+            // translation xyz, rotation xyzw, scale xyz
+            thread_local std::vector<float> decoded;
+            decoded.resize(this->m_stride * 10);
+            size_t channel = 0;
+#if defined(LIBGLPLAYGROUND_SSE2)
+            __m128 t = _mm_set1_ps(factor);
+            for (; channel < this->m_stride; channel += 4) {
+                for (size_t k = 0; k < 3; k++) {
+                    __m128 translation_min = _mm_loadu_ps(&this->m_translation_min[k][channel]);
+                    __m128 translation_scale = _mm_loadu_ps(&this->m_translation_scale[k][channel]);
+                    __m128 a = _mm_add_ps(translation_min, _mm_mul_ps(load_quantized(&this->m_translations[k][first + channel]), translation_scale));
+                    __m128 b = _mm_add_ps(translation_min, _mm_mul_ps(load_quantized(&this->m_translations[k][second + channel]), translation_scale));
+                    _mm_storeu_ps(&decoded[k * this->m_stride + channel], _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)));
+                    __m128 scale_min = _mm_loadu_ps(&this->m_scale_min[k][channel]);
+                    __m128 scale_scale = _mm_loadu_ps(&this->m_scale_scale[k][channel]);
+                    a = _mm_add_ps(scale_min, _mm_mul_ps(load_quantized(&this->m_scales[k][first + channel]), scale_scale));
+                    b = _mm_add_ps(scale_min, _mm_mul_ps(load_quantized(&this->m_scales[k][second + channel]), scale_scale));
+                    _mm_storeu_ps(&decoded[(7 + k) * this->m_stride + channel], _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)));
+                }
+                __m128 a[4], b[4];
+                decode_rotations(&this->m_rotations[0][first + channel], &this->m_rotations[1][first + channel], &this->m_rotations[2][first + channel], a);
+                decode_rotations(&this->m_rotations[0][second + channel], &this->m_rotations[1][second + channel], &this->m_rotations[2][second + channel], b);
+                // nlerp along the shortest path
+                __m128 dot = _mm_setzero_ps();
+                for (size_t k = 0; k < 4; k++) {
+                    dot = _mm_add_ps(dot, _mm_mul_ps(a[k], b[k]));
+                }
+                __m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.f));
+                __m128 result[4];
+                __m128 length = _mm_setzero_ps();
+                for (size_t k = 0; k < 4; k++) {
+                    __m128 target = _mm_xor_ps(b[k], flip);
+                    result[k] = _mm_add_ps(a[k], _mm_mul_ps(_mm_sub_ps(target, a[k]), t));
+                    length = _mm_add_ps(length, _mm_mul_ps(result[k], result[k]));
+                }
+                __m128 inverse_length = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(length));
+                for (size_t k = 0; k < 4; k++) {
+                    _mm_storeu_ps(&decoded[(3 + k) * this->m_stride + channel], _mm_mul_ps(result[k], inverse_length));
+                }
+            }
+#endif
+            for (; channel < this->m_stride; channel++) {
+                for (size_t k = 0; k < 3; k++) {
+                    float translation_min = this->m_translation_min[k][channel], translation_scale = this->m_translation_scale[k][channel];
+                    float a = translation_min + (float)this->m_translations[k][first + channel] * translation_scale;
+                    float b = translation_min + (float)this->m_translations[k][second + channel] * translation_scale;
+                    decoded[k * this->m_stride + channel] = a + (b - a) * factor;
+                    float scale_min = this->m_scale_min[k][channel], scale_scale = this->m_scale_scale[k][channel];
+                    a = scale_min + (float)this->m_scales[k][first + channel] * scale_scale;
+                    b = scale_min + (float)this->m_scales[k][second + channel] * scale_scale;
+                    decoded[(7 + k) * this->m_stride + channel] = a + (b - a) * factor;
+                }
+                glm::quat a = decode_rotation(this->m_rotations[0][first + channel], this->m_rotations[1][first + channel], this->m_rotations[2][first + channel]);
+                glm::quat b = decode_rotation(this->m_rotations[0][second + channel], this->m_rotations[1][second + channel], this->m_rotations[2][second + channel]);
+                if (glm::dot(a, b) < 0.f) {
+                    b = -b;
+                }
+                glm::quat result = glm::normalize(a + (b - a) * factor);
+                decoded[3 * this->m_stride + channel] = result.x;
+                decoded[4 * this->m_stride + channel] = result.y;
+                decoded[5 * this->m_stride + channel] = result.z;
+                decoded[6 * this->m_stride + channel] = result.w;
+            }
+            for (size_t i = 0; i < this->m_channel_count; i++) {
+                auto& s = samples[i];
+                s.translation = glm::vec3(decoded[i], decoded[this->m_stride + i], decoded[2 * this->m_stride + i]);
+                s.rotation = glm::quat(decoded[6 * this->m_stride + i], decoded[3 * this->m_stride + i], decoded[4 * this->m_stride + i], decoded[5 * this->m_stride + i]);
+                s.scale = glm::vec3(decoded[7 * this->m_stride + i], decoded[8 * this->m_stride + i], decoded[9 * this->m_stride + i]);
+            }
+        }
+        size_t baked_animation::get_channel_count() const {
+            return this->m_channel_count;
+        }
+        size_t baked_animation::get_memory_usage() const {
+            size_t size = sizeof(baked_animation);
+            for (size_t k = 0; k < 3; k++) {
+                size += (this->m_translation_min[k].size() + this->m_translation_scale[k].size() + this->m_scale_min[k].size() + this->m_scale_scale[k].size()) * sizeof(float);
+                size += (this->m_translations[k].size() + this->m_rotations[k].size() + this->m_scales[k].size()) * sizeof(uint16_t);
+            }
+            return size;
+        }
+        void baked_animation::write(binary_writer& writer) const {
+            writer.write((uint64_t)this->m_channel_count);
+            writer.write((uint64_t)this->m_frame_count);
+            writer.write(this->m_ticks_per_frame);
+            for (size_t k = 0; k < 3; k++) {
+                writer.write_array(this->m_translation_min[k]);
+                writer.write_array(this->m_translation_scale[k]);
+                writer.write_array(this->m_scale_min[k]);
+                writer.write_array(this->m_scale_scale[k]);
+                writer.write_array(this->m_translations[k]);
+                writer.write_array(this->m_rotations[k]);
+                writer.write_array(this->m_scales[k]);
+            }
+        }
+        void baked_animation::read(binary_reader& reader) {
+            this->m_channel_count = (size_t)reader.read<uint64_t>();
+            this->m_frame_count = (size_t)reader.read<uint64_t>();
+            this->m_ticks_per_frame = reader.read<float>();
+            this->m_stride = (this->m_channel_count + 3) & ~(size_t)3;
+            for (size_t k = 0; k < 3; k++) {
+                reader.read_array(this->m_translation_min[k]);
+                reader.read_array(this->m_translation_scale[k]);
+                reader.read_array(this->m_scale_min[k]);
+                reader.read_array(this->m_scale_scale[k]);
+                reader.read_array(this->m_translations[k]);
+                reader.read_array(this->m_rotations[k]);
+                reader.read_array(this->m_scales[k]);
+            }
+            // evaluate does no bounds checking, so a damaged file has to be caught here
+            bool valid = this->m_frame_count >= 2;
+            size_t track_size = this->m_stride * this->m_frame_count;
+            for (size_t k = 0; k < 3 && valid; k++) {
+                valid = this->m_translation_min[k].size() == this->m_stride && this->m_translation_scale[k].size() == this->m_stride &&
+                    this->m_scale_min[k].size() == this->m_stride && this->m_scale_scale[k].size() == this->m_stride &&
+                    this->m_translations[k].size() == track_size && this->m_rotations[k].size() == track_size && this->m_scales[k].size() == track_size;
+            }
+            if (!valid) {
+                throw std::runtime_error("Baked animation data is inconsistent!");
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,348 @@
+#include "libglppch.h"
+#include "bvh.h"
+#include "thread_pool.h"
+namespace libplayground {
+    namespace gl {
+        // subtrees with more leaves than this build their halves on the thread pool, down to the given depth
+        constexpr size_t parallel_build_threshold = 4096;
+        constexpr uint32_t max_parallel_build_depth = 3;
+        constexpr size_t sah_bin_count = 16;
+        static float surface_area(const aabb& box) {
+            if (!box.is_valid()) {
+                return 0.f;
+            }
+            glm::vec3 size = box.max - box.min;
+            return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+        }
+        static aabb merge(const aabb& lhs, const aabb& rhs) {
+            aabb result = lhs;
+            result.expand(rhs);
+            return result;
+        }
+        static bool contains(const aabb& outer, const aabb& inner) {
+            return glm::all(glm::lessThanEqual(outer.min, inner.min)) && glm::all(glm::lessThanEqual(inner.max, outer.max));
+        }
+        bvh::bvh() {
+            this->m_root = null_index;
+            this->m_leaf_count = 0;
+            this->m_built_cost = 0.f;
+        }
+        uint32_t bvh::insert(const aabb& box, uint64_t user_data) {
+            uint32_t proxy;
+            if (this->m_free_proxies.empty()) {
+                proxy = (uint32_t)this->m_proxies.size();
+                this->m_proxies.push_back(proxy_data());
+            } else {
+                proxy = this->m_free_proxies.back();
+                this->m_free_proxies.pop_back();
+            }
+            uint32_t leaf = this->allocate_node();
+            this->m_nodes[leaf].box = fatten(box);
+            this->m_nodes[leaf].proxy = proxy;
+            this->m_proxies[proxy] = { box, user_data, leaf };
+            this->insert_leaf(leaf);
+            this->m_leaf_count++;
+            return proxy;
+        }
+        void bvh::remove(uint32_t proxy) {
+            uint32_t leaf = this->m_proxies[proxy].node;
+            this->remove_leaf(leaf);
+            this->free_node(leaf);
+            this->m_proxies[proxy].node = null_index;
+            this->m_free_proxies.push_back(proxy);
+            this->m_leaf_count--;
+        }
+        bool bvh::update(uint32_t proxy, const aabb& box) {
+            auto& data = this->m_proxies[proxy];
+            data.bounds = box;
+            if (contains(this->m_nodes[data.node].box, box)) {
+                // still inside the fat box; nothing to do
+                return false;
+            }
+            this->m_nodes[data.node].box = fatten(box);
+            this->refit(this->m_nodes[data.node].parent);
+            return true;
+        }
+        void bvh::rebuild() {
+            std::vector<build_item> items;
+            items.reserve(this->m_leaf_count);
+            for (uint32_t proxy = 0; proxy < (uint32_t)this->m_proxies.size(); proxy++) {
+                const auto& data = this->m_proxies[proxy];
+                if (data.node != null_index) {
+                    aabb box = fatten(data.bounds);
+                    items.push_back({ box, box.get_center(), proxy });
+                }
+            }
+            this->m_free_nodes.clear();
+            this->m_nodes.clear();
+            if (items.empty()) {
+                this->m_root = null_index;
+                this->m_built_cost = 0.f;
+                return;
+            }
+            // a tree with n leaves has exactly 2n - 1 nodes, so every subtree knows its node range up front, and can be built in parallel
+            this->m_nodes.resize(items.size() * 2 - 1);
+            this->build_range(items, 0, items.size(), 0, null_index, 0);
+            this->m_root = 0;
+            this->m_built_cost = this->get_sah_cost();
+        }
+        bool bvh::rebuild_if_degraded(float max_cost_ratio) {
+            if (this->m_leaf_count < 2) {
+                return false;
+            }
+            if (this->m_built_cost <= 0.f || this->get_sah_cost() > this->m_built_cost * max_cost_ratio) {
+                this->rebuild();
+                return true;
+            }
+            return false;
+        }
+        float bvh::get_sah_cost() const {
+            if (this->m_root == null_index) {
+                return 0.f;
+            }
+            float root_area = surface_area(this->m_nodes[this->m_root].box);
+            if (root_area <= 0.f) {
+                return 0.f;
+            }
+            float cost = 0.f;
+            std::vector<uint32_t> stack = { this->m_root };
+            while (!stack.empty()) {
+                const node& n = this->m_nodes[stack.back()];
+                stack.pop_back();
+                if (!n.is_leaf()) {
+                    cost += surface_area(n.box);
+                    stack.push_back(n.left);
+                    stack.push_back(n.right);
+                }
+            }
+            return cost / root_area;
+        }
+        size_t bvh::size() const {
+            return this->m_leaf_count;
+        }
+        uint64_t bvh::get_user_data(uint32_t proxy) const {
+            return this->m_proxies[proxy].user_data;
+        }
+        const aabb& bvh::get_bounds(uint32_t proxy) const {
+            return this->m_proxies[proxy].bounds;
+        }
+        bvh::classification bvh::classify(const frustum& f, const aabb& box) {
+            glm::vec3 center = box.get_center();
+            glm::vec3 extent = box.get_extent();
+            bool intersecting = false;
+            for (const auto& plane : f.planes) {
+                glm::vec3 normal = glm::vec3(plane);
+                float distance = glm::dot(normal, center) + plane.w;
+                float radius = glm::dot(glm::abs(normal), extent);
+                if (distance + radius < 0.f) {
+                    return classification::outside;
+                }
+                if (distance - radius < 0.f) {
+                    intersecting = true;
+                }
+            }
+            return intersecting ? classification::intersecting : classification::inside;
+        }
+        bool bvh::intersect_ray(const aabb& box, const glm::vec3& origin, const glm::vec3& inverse_direction, float max_distance, float& entry) {
+            glm::vec3 t0 = (box.min - origin) * inverse_direction;
+            glm::vec3 t1 = (box.max - origin) * inverse_direction;
+            glm::vec3 near_ = glm::min(t0, t1), far_ = glm::max(t0, t1);
+            float t_enter = glm::max(glm::max(near_.x, near_.y), glm::max(near_.z, 0.f));
+            float t_exit = glm::min(glm::min(far_.x, far_.y), far_.z);
+            entry = t_enter;
+            return t_enter <= t_exit && t_enter <= max_distance;
+        }
+        aabb bvh::fatten(const aabb& box) {
+            // a margin lets small movements update the proxy without touching the tree
+            glm::vec3 margin = box.get_extent() * 0.1f + glm::vec3(0.05f);
+            return aabb(box.min - margin, box.max + margin);
+        }
+        uint32_t bvh::allocate_node() {
+            if (this->m_free_nodes.empty()) {
+                this->m_nodes.push_back(node());
+                return (uint32_t)this->m_nodes.size() - 1;
+            }
+            uint32_t index = this->m_free_nodes.back();
+            this->m_free_nodes.pop_back();
+            this->m_nodes[index] = node();
+            return index;
+        }
+        void bvh::free_node(uint32_t index) {
+            this->m_free_nodes.push_back(index);
+        }
+        void bvh::insert_leaf(uint32_t leaf) {
+            if (this->m_root == null_index) {
+                this->m_root = leaf;
+                this->m_nodes[leaf].parent = null_index;
+                return;
+            }
+            // descend towards the sibling with the smallest increase in surface area
+            aabb leaf_box = this->m_nodes[leaf].box;
+            uint32_t index = this->m_root;
+            while (!this->m_nodes[index].is_leaf()) {
+                const node& n = this->m_nodes[index];
+                float area = surface_area(n.box);
+                float combined_area = surface_area(merge(n.box, leaf_box));
+                float cost = 2.f * combined_area;
+                float inheritance_cost = 2.f * (combined_area - area);
+                auto child_cost = [&](uint32_t child) {
+                    const node& c = this->m_nodes[child];
+                    float merged = surface_area(merge(c.box, leaf_box));
+                    return (c.is_leaf() ? merged : merged - surface_area(c.box)) + inheritance_cost;
+                };
+                float left_cost = child_cost(n.left);
+                float right_cost = child_cost(n.right);
+                if (cost < left_cost && cost < right_cost) {
+                    break;
+                }
+                index = left_cost < right_cost ? n.left : n.right;
+            }
+            uint32_t sibling = index;
+            uint32_t old_parent = this->m_nodes[sibling].parent;
+            uint32_t new_parent = this->allocate_node();
+            this->m_nodes[new_parent].parent = old_parent;
+            this->m_nodes[new_parent].box = merge(leaf_box, this->m_nodes[sibling].box);
+            this->m_nodes[new_parent].left = sibling;
+            this->m_nodes[new_parent].right = leaf;
+            this->m_nodes[sibling].parent = new_parent;
+            this->m_nodes[leaf].parent = new_parent;
+            if (old_parent == null_index) {
+                this->m_root = new_parent;
+            } else {
+                node& parent = this->m_nodes[old_parent];
+                if (parent.left == sibling) {
+                    parent.left = new_parent;
+                } else {
+                    parent.right = new_parent;
+                }
+                this->refit(old_parent);
+            }
+        }
+        void bvh::remove_leaf(uint32_t leaf) {
+            if (leaf == this->m_root) {
+                this->m_root = null_index;
+                return;
+            }
+            uint32_t parent = this->m_nodes[leaf].parent;
+            uint32_t grandparent = this->m_nodes[parent].parent;
+            uint32_t sibling = this->m_nodes[parent].left == leaf ? this->m_nodes[parent].right : this->m_nodes[parent].left;
+            this->m_nodes[sibling].parent = grandparent;
+            this->free_node(parent);
+            if (grandparent == null_index) {
+                this->m_root = sibling;
+            } else {
+                node& n = this->m_nodes[grandparent];
+                if (n.left == parent) {
+                    n.left = sibling;
+                } else {
+                    n.right = sibling;
+                }
+                this->refit(grandparent);
+            }
+        }
+        void bvh::refit(uint32_t index) {
+            while (index != null_index) {
+                node& n = this->m_nodes[index];
+                aabb box = merge(this->m_nodes[n.left].box, this->m_nodes[n.right].box);
+                if (box.min == n.box.min && box.max == n.box.max) {
+                    // every ancestor already has the right bounds
+                    break;
+                }
+                n.box = box;
+                index = n.parent;
+            }
+        }
+        void bvh::build_range(std::vector<build_item>& items, size_t begin, size_t end, uint32_t node_index, uint32_t parent, uint32_t depth) {
+            node& n = this->m_nodes[node_index];
+            n.parent = parent;
+            if (end - begin == 1) {
+                n.box = items[begin].box;
+                n.proxy = items[begin].proxy;
+                this->m_proxies[n.proxy].node = node_index;
+                return;
+            }
+            aabb centroid_bounds;
+            for (size_t i = begin; i < end; i++) {
+                centroid_bounds.expand(items[i].centroid);
+            }
+            glm::vec3 size = centroid_bounds.max - centroid_bounds.min;
+            glm::length_t axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+            size_t middle = begin + (end - begin) / 2;
+            if (size[axis] > 0.f) {
+                struct bin {
+                    aabb box;
+                    size_t count = 0;
+                };
+                bin bins[sah_bin_count];
+                float scale = (float)sah_bin_count / size[axis];
+                auto get_bin = [&](const build_item& item) {
+                    size_t index = (size_t)((item.centroid[axis] - centroid_bounds.min[axis]) * scale);
+                    return std::min(index, sah_bin_count - 1);
+                };
+                for (size_t i = begin; i < end; i++) {
+                    bin& b = bins[get_bin(items[i])];
+                    b.box.expand(items[i].box);
+                    b.count++;
+                }
+                // sweep from the right, then evaluate every split from the left
+                float right_area[sah_bin_count];
+                size_t right_count[sah_bin_count];
+                aabb accumulated;
+                size_t count = 0;
+                for (size_t i = sah_bin_count - 1; i > 0; i--) {
+                    accumulated.expand(bins[i].box);
+                    count += bins[i].count;
+                    right_area[i] = surface_area(accumulated);
+                    right_count[i] = count;
+                }
+                accumulated = aabb();
+                count = 0;
+                float best_cost = std::numeric_limits<float>::max();
+                size_t best_split = 0;
+                for (size_t i = 0; i < sah_bin_count - 1; i++) {
+                    accumulated.expand(bins[i].box);
+                    count += bins[i].count;
+                    if (count == 0 || right_count[i + 1] == 0) {
+                        continue;
+                    }
+                    float cost = (float)count * surface_area(accumulated) + (float)right_count[i + 1] * right_area[i + 1];
+                    if (cost < best_cost) {
+                        best_cost = cost;
+                        best_split = i;
+                    }
+                }
+                if (best_cost < std::numeric_limits<float>::max()) {
+                    auto it = std::partition(items.begin() + begin, items.begin() + end, [&](const build_item& item) {
+                        return get_bin(item) <= best_split;
+                    });
+                    middle = (size_t)(it - items.begin());
+                }
+            }
+            if (middle == begin || middle == end) {
+                middle = begin + (end - begin) / 2;
+            }
+            // the left subtree occupies the next 2 * (middle - begin) - 1 nodes
+            uint32_t left = node_index + 1;
+            uint32_t right = node_index + 2 * (uint32_t)(middle - begin);
+            n.left = left;
+            n.right = right;
+            n.proxy = null_index;
+            if (end - begin > parallel_build_threshold && depth < max_parallel_build_depth) {
+                // the calling thread builds whichever half no worker has picked up, so nested builds cannot starve the pool
+                thread_pool::get().parallel_for(2, [&](size_t first_half, size_t last_half) {
+                    for (size_t half = first_half; half < last_half; half++) {
+                        if (half == 0) {
+                            this->build_range(items, begin, middle, left, node_index, depth + 1);
+                        } else {
+                            this->build_range(items, middle, end, right, node_index, depth + 1);
+                        }
+                    }
+                }, 1);
+            } else {
+                this->build_range(items, begin, middle, left, node_index, depth + 1);
+                this->build_range(items, middle, end, right, node_index, depth + 1);
+            }
+            n.box = merge(this->m_nodes[left].box, this->m_nodes[right].box);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include "libglppch.h"
+#include "cooked_file.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+namespace libplayground {
+    namespace gl {
+#ifdef _WIN32
+        mapped_file::mapped_file(const std::string& path) {
+            this->m_data = nullptr;
+            this->m_size = 0;
+            this->m_mapping = nullptr;
+            this->m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (this->m_file == INVALID_HANDLE_VALUE) {
+                throw std::runtime_error("Could not open file: " + path);
+            }
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(this->m_file, &size)) {
+                CloseHandle(this->m_file);
+                throw std::runtime_error("Could not get the size of file: " + path);
+            }
+            this->m_size = (size_t)size.QuadPart;
+            if (this->m_size == 0) {
+                return;
+            }
+            this->m_mapping = CreateFileMappingA(this->m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (this->m_mapping) {
+                this->m_data = (const uint8_t*)MapViewOfFile(this->m_mapping, FILE_MAP_READ, 0, 0, 0);
+            }
+            if (!this->m_data) {
+                if (this->m_mapping) {
+                    CloseHandle(this->m_mapping);
+                }
+                CloseHandle(this->m_file);
+                throw std::runtime_error("Could not map file: " + path);
+            }
+        }
+        mapped_file::~mapped_file() {
+            if (this->m_data) {
+                UnmapViewOfFile(this->m_data);
+            }
+            if (this->m_mapping) {
+                CloseHandle(this->m_mapping);
+            }
+            CloseHandle(this->m_file);
+        }
+#else
+        mapped_file::mapped_file(const std::string& path) {
+            this->m_data = nullptr;
+            this->m_size = 0;
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw std::runtime_error("Could not open file: " + path);
+            }
+            struct stat info;
+            if (fstat(fd, &info) != 0) {
+                close(fd);
+                throw std::runtime_error("Could not get the size of file: " + path);
+            }
+            this->m_size = (size_t)info.st_size;
+            if (this->m_size == 0) {
+                close(fd);
+                return;
+            }
+            void* data = mmap(nullptr, this->m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd); // the mapping keeps the file alive
+            if (data == MAP_FAILED) {
+                throw std::runtime_error("Could not map file: " + path);
+            }
+            // the whole file is about to be read front to back
+            madvise(data, this->m_size, MADV_WILLNEED);
+            this->m_data = (const uint8_t*)data;
+        }
+        mapped_file::~mapped_file() {
+            if (this->m_data) {
+                munmap((void*)this->m_data, this->m_size);
+            }
+        }
+#endif
+        const uint8_t* mapped_file::get_data() const {
+            return this->m_data;
+        }
+        size_t mapped_file::get_size() const {
+            return this->m_size;
+        }
+        void binary_writer::write_string(const std::string& value) {
+            this->write((uint64_t)value.length());
+            this->write_bytes(value.data(), value.length());
+        }
+        // unique per process, thread and call, so that two writers of the same file never share a temporary file
+        static std::string get_temporary_path(const std::string& path) {
+            static std::atomic<uint64_t> counter = 0;
+#ifdef _WIN32
+            uint64_t process_id = (uint64_t)GetCurrentProcessId();
+#else
+            uint64_t process_id = (uint64_t)getpid();
+#endif
+            std::stringstream stream;
+            stream << path << "." << process_id << "." << std::this_thread::get_id() << "." << counter++ << ".tmp";
+            return stream.str();
+        }
+        void binary_writer::save(const std::string& path) const {
+            std::string temporary_path = get_temporary_path(path);
+            {
+                std::ofstream stream(temporary_path, std::ios::binary | std::ios::trunc);
+                if (!stream.is_open()) {
+                    throw std::runtime_error("Could not open file for writing: " + temporary_path);
+                }
+                stream.write((const char*)this->m_data.data(), (std::streamsize)this->m_data.size());
+                if (!stream.good()) {
+                    throw std::runtime_error("Could not write file: " + temporary_path);
+                }
+            }
+            std::error_code error;
+            std::filesystem::rename(temporary_path, path, error);
+            if (error) {
+                std::filesystem::remove(temporary_path, error);
+                throw std::runtime_error("Could not replace file: " + path);
+            }
+        }
+        void binary_writer::write_bytes(const void* data, size_t size) {
+            if (size == 0) {
+                return;
+            }
+            size_t offset = this->m_data.size();
+            this->m_data.resize(offset + size);
+            memcpy(this->m_data.data() + offset, data, size);
+        }
+        void binary_writer::align(size_t alignment) {
+            size_t remainder = this->m_data.size() % alignment;
+            if (remainder != 0) {
+                this->m_data.resize(this->m_data.size() + alignment - remainder, 0);
+            }
+        }
+        binary_reader::binary_reader(const uint8_t* data, size_t size) {
+            this->m_data = data;
+            this->m_size = size;
+            this->m_position = 0;
+        }
+        std::string binary_reader::read_string() {
+            size_t length = (size_t)this->read<uint64_t>();
+            if (length > this->m_size - this->m_position) {
+                throw std::runtime_error("String extends past the end of the file!");
+            }
+            return std::string((const char*)this->read_bytes(length), length);
+        }
+        const uint8_t* binary_reader::read_bytes(size_t size) {
+            if (size > this->m_size - this->m_position) {
+                throw std::runtime_error("Unexpected end of file!");
+            }
+            const uint8_t* data = this->m_data + this->m_position;
+            this->m_position += size;
+            return data;
+        }
+        void binary_reader::align(size_t alignment) {
+            size_t remainder = this->m_position % alignment;
+            if (remainder != 0) {
+                this->read_bytes(alignment - remainder);
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "libglppch.h"
+#include "culling.h"
+#if defined(__AVX__)
+#define LIBGLPLAYGROUND_AVX
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define LIBGLPLAYGROUND_SSE
+#include <xmmintrin.h>
+#endif
+namespace libplayground {
+    namespace gl {
+        aabb aabb::transformed(const glm::mat4& matrix) const {
+            if (!this->is_valid()) {
+                return *this;
+            }
+            glm::vec3 center = glm::vec3(matrix * glm::vec4(this->get_center(), 1.f));
+            glm::mat3 absolute(glm::abs(glm::vec3(matrix[0])), glm::abs(glm::vec3(matrix[1])), glm::abs(glm::vec3(matrix[2])));
+            glm::vec3 extent = absolute * this->get_extent();
+            return aabb(center - extent, center + extent);
+        }
+        frustum frustum::from_matrix(const glm::mat4& view_projection) {
+            auto row = [&](glm::length_t index) {
+                return glm::vec4(view_projection[0][index], view_projection[1][index], view_projection[2][index], view_projection[3][index]);
+            };
+            frustum f;
+            f.planes[0] = row(3) + row(0);
+            f.planes[1] = row(3) - row(0);
+            f.planes[2] = row(3) + row(1);
+            f.planes[3] = row(3) - row(1);
+            f.planes[4] = row(3) + row(2);
+            f.planes[5] = row(3) - row(2);
+            for (auto& plane : f.planes) {
+                plane /= glm::length(glm::vec3(plane));
+            }
+            return f;
+        }
+        bool frustum::intersects(const aabb& box) const {
+            glm::vec3 center = box.get_center();
+            glm::vec3 extent = box.get_extent();
+            for (const auto& plane : this->planes) {
+                glm::vec3 normal = glm::vec3(plane);
+                float distance = glm::dot(normal, center) + plane.w;
+                float radius = glm::dot(glm::abs(normal), extent);
+                if (distance + radius < 0.f) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        void cull_boxes(const frustum& f, const aabb* boxes, size_t count, uint8_t* visible) {
+            size_t i = 0;
+#if defined(LIBGLPLAYGROUND_AVX)
+            for (; i + 8 <= count; i += 8) {
+                float values[6][8];
+                for (size_t j = 0; j < 8; j++) {
+                    glm::vec3 center = boxes[i + j].get_center();
+                    glm::vec3 extent = boxes[i + j].get_extent();
+                    values[0][j] = center.x; values[1][j] = center.y; values[2][j] = center.z;
+                    values[3][j] = extent.x; values[4][j] = extent.y; values[5][j] = extent.z;
+                }
+                __m256 cx = _mm256_loadu_ps(values[0]), cy = _mm256_loadu_ps(values[1]), cz = _mm256_loadu_ps(values[2]);
+                __m256 ex = _mm256_loadu_ps(values[3]), ey = _mm256_loadu_ps(values[4]), ez = _mm256_loadu_ps(values[5]);
+                __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+                for (const auto& plane : f.planes) {
+                    __m256 nx = _mm256_set1_ps(plane.x), ny = _mm256_set1_ps(plane.y), nz = _mm256_set1_ps(plane.z);
+                    __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)), _mm256_add_ps(_mm256_mul_ps(nz, cz), _mm256_set1_ps(plane.w)));
+                    __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(fabsf(plane.x)), ex), _mm256_mul_ps(_mm256_set1_ps(fabsf(plane.y)), ey)), _mm256_mul_ps(_mm256_set1_ps(fabsf(plane.z)), ez));
+                    inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+                }
+                int mask = _mm256_movemask_ps(inside);
+                for (size_t j = 0; j < 8; j++) {
+                    visible[i + j] = (uint8_t)((mask >> j) & 1);
+                }
+            }
+#elif defined(LIBGLPLAYGROUND_SSE)
+            for (; i + 4 <= count; i += 4) {
+                glm::vec3 centers[4], extents[4];
+                for (size_t j = 0; j < 4; j++) {
+                    centers[j] = boxes[i + j].get_center();
+                    extents[j] = boxes[i + j].get_extent();
+                }
+                __m128 cx = _mm_setr_ps(centers[0].x, centers[1].x, centers[2].x, centers[3].x);
+                __m128 cy = _mm_setr_ps(centers[0].y, centers[1].y, centers[2].y, centers[3].y);
+                __m128 cz = _mm_setr_ps(centers[0].z, centers[1].z, centers[2].z, centers[3].z);
+                __m128 ex = _mm_setr_ps(extents[0].x, extents[1].x, extents[2].x, extents[3].x);
+                __m128 ey = _mm_setr_ps(extents[0].y, extents[1].y, extents[2].y, extents[3].y);
+                __m128 ez = _mm_setr_ps(extents[0].z, extents[1].z, extents[2].z, extents[3].z);
+                __m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps()); // all bits set
+                for (const auto& plane : f.planes) {
+                    __m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+                    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w)));
+                    __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(fabsf(plane.x)), ex), _mm_mul_ps(_mm_set1_ps(fabsf(plane.y)), ey)), _mm_mul_ps(_mm_set1_ps(fabsf(plane.z)), ez));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+                }
+                int mask = _mm_movemask_ps(inside);
+                for (size_t j = 0; j < 4; j++) {
+                    visible[i + j] = (uint8_t)((mask >> j) & 1);
+                }
+            }
+#endif
+            for (; i < count; i++) {
+                visible[i] = f.intersects(boxes[i]) ? 1 : 0;
+            }
+        }
+    }
+}
\ No newline at end of file
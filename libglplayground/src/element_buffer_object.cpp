@@ -1,27 +1,89 @@
 #include "libglppch.h"
 #include "element_buffer_object.h"
+#include "state_tracker.h"
 namespace libplayground {
     namespace gl {
-        element_buffer_object::element_buffer_object(const std::vector<uint32_t>& data) {
+        extern bool _context_destroyed_;
+        element_buffer_object::element_buffer_object(const std::vector<uint32_t>& data) : element_buffer_object(data.data(), data.size()) { }
+        element_buffer_object::element_buffer_object(const uint32_t* data, size_t count) {
             glGenBuffers(1, &this->m_id);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->m_id);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.size() * sizeof(uint32_t), data.data(), GL_STATIC_DRAW); // for now
-            this->m_index_count = data.size();
+            this->m_capacity = 0;
+            this->upload(data, count);
         }
         element_buffer_object::~element_buffer_object() {
-            glDeleteBuffers(1, &this->m_id);
+            if (!_context_destroyed_) {
+                glDeleteBuffers(1, &this->m_id);
+                state_tracker::get().on_buffer_deleted(this->m_id);
+            }
+        }
+        void element_buffer_object::set_data(const std::vector<uint32_t>& data) {
+            this->upload(data.data(), data.size());
         }
         void element_buffer_object::bind() {
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->m_id);
+            state_tracker::get().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, this->m_id);
         }
         void element_buffer_object::unbind() {
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+            state_tracker::get().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
         }
         void element_buffer_object::draw(GLenum mode) {
-            glDrawElements(mode, (GLsizei)this->m_index_count, GL_UNSIGNED_INT, nullptr);
+            glDrawElements(mode, (GLsizei)this->m_index_count, this->m_index_type, nullptr);
+        }
+        void element_buffer_object::draw_instanced(GLenum mode, uint32_t instance_count) {
+            glDrawElementsInstanced(mode, (GLsizei)this->m_index_count, this->m_index_type, nullptr, (GLsizei)instance_count);
+        }
+        void element_buffer_object::draw_range(GLenum mode, size_t first, size_t count) {
+            size_t index_size = this->m_index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+            glDrawElements(mode, (GLsizei)count, this->m_index_type, (void*)(first * index_size));
         }
         GLuint element_buffer_object::get() {
             return this->m_id;
         }
+        std::vector<uint32_t> element_buffer_object::get_data() {
+            std::vector<uint32_t> indices(this->m_index_count);
+            // binding the element array target would change the bound vertex array
+            state_tracker::get().bind_buffer(GL_COPY_READ_BUFFER, this->m_id);
+            if (this->m_index_type == GL_UNSIGNED_SHORT) {
+                std::vector<uint16_t> narrowed(this->m_index_count);
+                glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)(narrowed.size() * sizeof(uint16_t)), narrowed.data());
+                std::copy(narrowed.begin(), narrowed.end(), indices.begin());
+            } else {
+                glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)(indices.size() * sizeof(uint32_t)), indices.data());
+            }
+            return indices;
+        }
+        GLenum element_buffer_object::get_index_type() const {
+            return this->m_index_type;
+        }
+        size_t element_buffer_object::get_memory_usage() const {
+            return this->m_capacity;
+        }
+        void element_buffer_object::upload(const uint32_t* data, size_t count) {
+            const void* source = data;
+            size_t length = count * sizeof(uint32_t);
+            this->m_index_type = GL_UNSIGNED_INT;
+            uint32_t max_index = 0;
+            for (size_t i = 0; i < count; i++) {
+                max_index = std::max(max_index, data[i]);
+            }
+            // half the memory and bandwidth when every index fits
+            thread_local std::vector<uint16_t> narrowed;
+            if (count > 0 && max_index <= (uint32_t)std::numeric_limits<uint16_t>::max()) {
+                narrowed.resize(count);
+                for (size_t i = 0; i < count; i++) {
+                    narrowed[i] = (uint16_t)data[i];
+                }
+                source = narrowed.data();
+                length = count * sizeof(uint16_t);
+                this->m_index_type = GL_UNSIGNED_SHORT;
+            }
+            state_tracker::get().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, this->m_id);
+            if (length > this->m_capacity || this->m_capacity == 0) {
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)length, source, GL_STATIC_DRAW); // for now
+                this->m_capacity = length;
+            } else if (length > 0) {
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, (GLsizeiptr)length, source);
+            }
+            this->m_index_count = count;
+        }
     }
 }
\ No newline at end of file
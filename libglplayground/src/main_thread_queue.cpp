@@ -0,0 +1,23 @@
+#include "libglppch.h"
+#include "main_thread_queue.h"
+namespace libplayground {
+    namespace gl {
+        static std::mutex queue_mutex;
+        static std::vector<std::function<void()>> queued_tasks;
+        void main_thread_queue::post(const std::function<void()>& task) {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            queued_tasks.push_back(task);
+        }
+        void main_thread_queue::flush() {
+            std::vector<std::function<void()>> tasks;
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                tasks.swap(queued_tasks);
+            }
+            // tasks may post more tasks; those run on the next flush
+            for (const auto& task : tasks) {
+                task();
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,498 @@
+#include "libglppch.h"
+#include "mesh_optimizer.h"
+namespace libplayground {
+    namespace gl {
+        namespace mesh_optimizer {
+            // the cache that vertices are scored against; bigger than any real cache, which works out well in practice
+            constexpr size_t forsyth_cache_size = 32;
+            constexpr float forsyth_decay_power = 1.5f;
+            constexpr float forsyth_last_triangle_score = 0.75f;
+            constexpr float forsyth_valence_boost_scale = 2.f;
+            constexpr float forsyth_valence_boost_power = 0.5f;
+            // used to find cluster boundaries for overdraw ordering
+            constexpr size_t overdraw_cache_size = 16;
+            constexpr uint32_t invalid_triangle = std::numeric_limits<uint32_t>::max();
+            struct weld_hasher {
+                const std::vector<vertex_stream>* streams;
+                size_t operator()(uint32_t index) const {
+                    // fnv-1a
+                    uint64_t hash = 14695981039346656037ull;
+                    for (const auto& stream : *this->streams) {
+                        const uint8_t* bytes = (const uint8_t*)stream.data + (size_t)index * stream.stride;
+                        for (size_t i = 0; i < stream.size; i++) {
+                            hash = (hash ^ bytes[i]) * 1099511628211ull;
+                        }
+                    }
+                    return (size_t)hash;
+                }
+            };
+            struct weld_equal {
+                const std::vector<vertex_stream>* streams;
+                bool operator()(uint32_t lhs, uint32_t rhs) const {
+                    for (const auto& stream : *this->streams) {
+                        const uint8_t* data = (const uint8_t*)stream.data;
+                        if (memcmp(data + (size_t)lhs * stream.stride, data + (size_t)rhs * stream.stride, stream.size) != 0) {
+                            return false;
+                        }
+                    }
+                    return true;
+                }
+            };
+            size_t generate_weld_remap(std::vector<uint32_t>& remap, const std::vector<uint32_t>& indices, size_t vertex_count, const std::vector<vertex_stream>& streams) {
+                remap.assign(vertex_count, unused_vertex);
+                std::unordered_map<uint32_t, uint32_t, weld_hasher, weld_equal> unique_vertices(vertex_count, weld_hasher{ &streams }, weld_equal{ &streams });
+                size_t next = 0;
+                for (uint32_t index : indices) {
+                    if (remap[index] != unused_vertex) {
+                        continue;
+                    }
+                    auto [it, inserted] = unique_vertices.insert({ index, (uint32_t)next });
+                    if (inserted) {
+                        next++;
+                    }
+                    remap[index] = it->second;
+                }
+                return next;
+            }
+            size_t generate_fetch_remap(std::vector<uint32_t>& remap, const std::vector<uint32_t>& indices, size_t vertex_count) {
+                remap.assign(vertex_count, unused_vertex);
+                size_t next = 0;
+                for (uint32_t index : indices) {
+                    if (remap[index] == unused_vertex) {
+                        remap[index] = (uint32_t)next++;
+                    }
+                }
+                return next;
+            }
+            void remap_indices(std::vector<uint32_t>& indices, const std::vector<uint32_t>& remap) {
+                for (auto& index : indices) {
+                    index = remap[index];
+                }
+            }
+            static float score_vertex(int32_t cache_position, uint32_t live_triangles) {
+                if (live_triangles == 0) {
+                    // nothing left to draw with this vertex
+                    return -1.f;
+                }
+                float score = 0.f;
+                if (cache_position >= 0) {
+                    if (cache_position < 3) {
+                        // used by the last triangle; a fixed score, so that the next triangle does not just reuse the same edge
+                        score = forsyth_last_triangle_score;
+                    } else {
+                        float scale = 1.f / (float)(forsyth_cache_size - 3);
+                        score = powf(1.f - (float)(cache_position - 3) * scale, forsyth_decay_power);
+                    }
+                }
+                // finish off vertices with few triangles left, so that they do not get stranded
+                score += forsyth_valence_boost_scale * powf((float)live_triangles, -forsyth_valence_boost_power);
+                return score;
+            }
+            void optimize_vertex_cache(std::vector<uint32_t>& indices, size_t vertex_count) {
+                size_t triangle_count = indices.size() / 3;
+                if (triangle_count == 0) {
+                    return;
+                }
+                // the first live[v] entries of a vertex's adjacency are the triangles that have not been emitted yet
+                std::vector<uint32_t> live(vertex_count, 0);
+                for (uint32_t index : indices) {
+                    live[index]++;
+                }
+                std::vector<uint32_t> offsets(vertex_count + 1, 0);
+                for (size_t i = 0; i < vertex_count; i++) {
+                    offsets[i + 1] = offsets[i] + live[i];
+                }
+                std::vector<uint32_t> adjacency(triangle_count * 3);
+                std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+                for (size_t i = 0; i < triangle_count * 3; i++) {
+                    adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+                }
+                std::vector<int32_t> cache_positions(vertex_count, -1);
+                std::vector<float> vertex_scores(vertex_count);
+                for (size_t i = 0; i < vertex_count; i++) {
+                    vertex_scores[i] = score_vertex(-1, live[i]);
+                }
+                std::vector<float> triangle_scores(triangle_count);
+                uint32_t best_triangle = 0;
+                for (size_t i = 0; i < triangle_count; i++) {
+                    triangle_scores[i] = vertex_scores[indices[i * 3]] + vertex_scores[indices[i * 3 + 1]] + vertex_scores[indices[i * 3 + 2]];
+                    if (triangle_scores[i] > triangle_scores[best_triangle]) {
+                        best_triangle = (uint32_t)i;
+                    }
+                }
+                std::vector<uint8_t> emitted(triangle_count, 0);
+                std::vector<uint32_t> result;
+                result.reserve(indices.size());
+                uint32_t cache[forsyth_cache_size + 3], new_cache[forsyth_cache_size + 3];
+                size_t cache_count = 0;
+                size_t next_unemitted = 0;
+                while (result.size() < triangle_count * 3) {
+                    if (best_triangle == invalid_triangle) {
+                        // nothing in the cache has triangles left; start again from anywhere
+                        while (emitted[next_unemitted]) {
+                            next_unemitted++;
+                        }
+                        best_triangle = (uint32_t)next_unemitted;
+                    }
+                    emitted[best_triangle] = 1;
+                    const uint32_t* triangle = &indices[(size_t)best_triangle * 3];
+                    size_t new_count = 0;
+                    for (size_t i = 0; i < 3; i++) {
+                        uint32_t v = triangle[i];
+                        result.push_back(v);
+                        new_cache[new_count++] = v;
+                        uint32_t* begin = &adjacency[offsets[v]];
+                        uint32_t* end = begin + live[v];
+                        uint32_t* it = std::find(begin, end, best_triangle);
+                        std::swap(*it, *(end - 1));
+                        live[v]--;
+                    }
+                    for (size_t i = 0; i < cache_count; i++) {
+                        uint32_t v = cache[i];
+                        if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                            new_cache[new_count++] = v;
+                        }
+                    }
+                    // rescore everything that moved, including the vertices that fell out
+                    for (size_t i = 0; i < new_count; i++) {
+                        uint32_t v = new_cache[i];
+                        int32_t position = i < forsyth_cache_size ? (int32_t)i : -1;
+                        cache_positions[v] = position;
+                        float score = score_vertex(position, live[v]);
+                        float delta = score - vertex_scores[v];
+                        vertex_scores[v] = score;
+                        for (uint32_t j = 0; j < live[v]; j++) {
+                            triangle_scores[adjacency[offsets[v] + j]] += delta;
+                        }
+                    }
+                    cache_count = std::min(new_count, forsyth_cache_size);
+                    std::copy(new_cache, new_cache + cache_count, cache);
+                    best_triangle = invalid_triangle;
+                    float best_score = -std::numeric_limits<float>::max();
+                    for (size_t i = 0; i < cache_count; i++) {
+                        uint32_t v = cache[i];
+                        for (uint32_t j = 0; j < live[v]; j++) {
+                            uint32_t t = adjacency[offsets[v] + j];
+                            if (triangle_scores[t] > best_score) {
+                                best_score = triangle_scores[t];
+                                best_triangle = t;
+                            }
+                        }
+                    }
+                }
+                indices.swap(result);
+            }
+            // a fifo cache; a vertex is a hit if it was loaded within the last cache_size misses
+            class fifo_cache {
+            public:
+                fifo_cache(size_t vertex_count, size_t cache_size) : m_timestamps(vertex_count, 0) {
+                    this->m_cache_size = (uint32_t)cache_size;
+                    this->m_time = this->m_cache_size + 1;
+                }
+                // returns true on a miss
+                bool access(uint32_t index) {
+                    if (this->m_time - this->m_timestamps[index] > this->m_cache_size) {
+                        this->m_timestamps[index] = this->m_time++;
+                        return true;
+                    }
+                    return false;
+                }
+                void flush() {
+                    this->m_time += this->m_cache_size + 1;
+                }
+            private:
+                std::vector<uint32_t> m_timestamps;
+                uint32_t m_cache_size, m_time;
+            };
+            float compute_acmr(const std::vector<uint32_t>& indices, size_t vertex_count, size_t cache_size) {
+                size_t triangle_count = indices.size() / 3;
+                if (triangle_count == 0) {
+                    return 0.f;
+                }
+                fifo_cache cache(vertex_count, cache_size);
+                size_t misses = 0;
+                for (uint32_t index : indices) {
+                    misses += cache.access(index) ? 1 : 0;
+                }
+                return (float)misses / (float)triangle_count;
+            }
+            static glm::vec3 read_position(const vertex_stream& positions, uint32_t index) {
+                glm::vec3 position;
+                memcpy(&position, (const uint8_t*)positions.data + (size_t)index * positions.stride, sizeof(glm::vec3));
+                return position;
+            }
+            void optimize_overdraw(std::vector<uint32_t>& indices, const vertex_stream& positions, size_t vertex_count, float threshold) {
+                size_t triangle_count = indices.size() / 3;
+                if (triangle_count == 0) {
+                    return;
+                }
+                float mesh_acmr = compute_acmr(indices, vertex_count, overdraw_cache_size);
+                // a triangle that misses on every vertex is a natural place to split, since the cache was useless there anyway
+                std::vector<size_t> hard_boundaries;
+                {
+                    fifo_cache cache(vertex_count, overdraw_cache_size);
+                    for (size_t i = 0; i < triangle_count; i++) {
+                        size_t misses = 0;
+                        for (size_t j = 0; j < 3; j++) {
+                            misses += cache.access(indices[i * 3 + j]) ? 1 : 0;
+                        }
+                        if (misses == 3 || i == 0) {
+                            hard_boundaries.push_back(i);
+                        }
+                    }
+                    hard_boundaries.push_back(triangle_count);
+                }
+                // within those, split wherever the cluster so far has been cheap enough, counting from a cold cache
+                std::vector<size_t> clusters;
+                {
+                    fifo_cache cache(vertex_count, overdraw_cache_size);
+                    for (size_t b = 0; b + 1 < hard_boundaries.size(); b++) {
+                        size_t start = hard_boundaries[b], end = hard_boundaries[b + 1];
+                        size_t cluster_start = start, cluster_misses = 0;
+                        clusters.push_back(start);
+                        cache.flush();
+                        for (size_t i = start; i < end; i++) {
+                            for (size_t j = 0; j < 3; j++) {
+                                cluster_misses += cache.access(indices[i * 3 + j]) ? 1 : 0;
+                            }
+                            float cluster_acmr = (float)cluster_misses / (float)(i + 1 - cluster_start);
+                            if (i + 1 < end && cluster_acmr <= mesh_acmr * threshold) {
+                                clusters.push_back(i + 1);
+                                cluster_start = i + 1;
+                                cluster_misses = 0;
+                                cache.flush();
+                            }
+                        }
+                    }
+                    clusters.push_back(triangle_count);
+                }
+                size_t cluster_count = clusters.size() - 1;
+                std::vector<glm::vec3> centroids(cluster_count, glm::vec3(0.f)), normals(cluster_count, glm::vec3(0.f));
+                glm::vec3 mesh_centroid = glm::vec3(0.f);
+                float mesh_area = 0.f;
+                for (size_t c = 0; c < cluster_count; c++) {
+                    float cluster_area = 0.f;
+                    for (size_t i = clusters[c]; i < clusters[c + 1]; i++) {
+                        glm::vec3 p0 = read_position(positions, indices[i * 3]);
+                        glm::vec3 p1 = read_position(positions, indices[i * 3 + 1]);
+                        glm::vec3 p2 = read_position(positions, indices[i * 3 + 2]);
+                        // twice the area, pointing along the face normal
+                        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                        float area = glm::length(normal);
+                        centroids[c] += (p0 + p1 + p2) * (area / 3.f);
+                        normals[c] += normal;
+                        cluster_area += area;
+                    }
+                    mesh_centroid += centroids[c];
+                    mesh_area += cluster_area;
+                    centroids[c] = cluster_area > 0.f ? centroids[c] / cluster_area : centroids[c];
+                }
+                if (mesh_area > 0.f) {
+                    mesh_centroid /= mesh_area;
+                }
+                // clusters on the outside, facing away from the center, are likely to occlude the rest
+                std::vector<float> sort_keys(cluster_count);
+                for (size_t c = 0; c < cluster_count; c++) {
+                    float length = glm::length(normals[c]);
+                    sort_keys[c] = length > 0.f ? glm::dot(centroids[c] - mesh_centroid, normals[c] / length) : 0.f;
+                }
+                std::vector<size_t> order(cluster_count);
+                for (size_t c = 0; c < cluster_count; c++) {
+                    order[c] = c;
+                }
+                std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+                    return sort_keys[lhs] > sort_keys[rhs];
+                });
+                std::vector<uint32_t> result;
+                result.reserve(indices.size());
+                for (size_t c : order) {
+                    result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+                }
+                indices.swap(result);
+            }
+            // sum of squared distances to a set of planes, weighted by triangle area
+            struct quadric {
+                double a2 = 0.0, b2 = 0.0, c2 = 0.0, d2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0, bc = 0.0, bd = 0.0, cd = 0.0;
+                double weight = 0.0;
+                void add_plane(const glm::vec3& normal, float distance, double w) {
+                    double a = normal.x, b = normal.y, c = normal.z, d = distance;
+                    this->a2 += a * a * w; this->b2 += b * b * w; this->c2 += c * c * w; this->d2 += d * d * w;
+                    this->ab += a * b * w; this->ac += a * c * w; this->ad += a * d * w;
+                    this->bc += b * c * w; this->bd += b * d * w; this->cd += c * d * w;
+                    this->weight += w;
+                }
+                void add(const quadric& other) {
+                    this->a2 += other.a2; this->b2 += other.b2; this->c2 += other.c2; this->d2 += other.d2;
+                    this->ab += other.ab; this->ac += other.ac; this->ad += other.ad;
+                    this->bc += other.bc; this->bd += other.bd; this->cd += other.cd;
+                    this->weight += other.weight;
+                }
+                double evaluate(const glm::vec3& point) const {
+                    double x = point.x, y = point.y, z = point.z;
+                    double result = this->a2 * x * x + this->b2 * y * y + this->c2 * z * z + this->d2
+                        + 2.0 * (this->ab * x * y + this->ac * x * z + this->ad * x + this->bc * y * z + this->bd * y + this->cd * z);
+                    return std::max(result, 0.0);
+                }
+            };
+            struct collapse {
+                uint32_t from, to;
+                double error; // squared distance
+            };
+            float simplify(std::vector<uint32_t>& destination, const std::vector<uint32_t>& indices, const vertex_stream& positions, size_t vertex_count, size_t target_index_count, float max_error) {
+                destination = indices;
+                std::vector<glm::vec3> points(vertex_count);
+                for (size_t i = 0; i < vertex_count; i++) {
+                    points[i] = read_position(positions, (uint32_t)i);
+                }
+                // vertices that share a position sit on a uv or normal seam
+                std::vector<uint32_t> position_ids;
+                generate_weld_remap(position_ids, indices, vertex_count, { { points.data(), sizeof(glm::vec3), sizeof(glm::vec3) } });
+                std::vector<uint32_t> first_vertex(vertex_count, unused_vertex);
+                std::vector<uint8_t> locked(vertex_count, 0);
+                for (size_t i = 0; i < vertex_count; i++) {
+                    uint32_t id = position_ids[i];
+                    if (id == unused_vertex) {
+                        continue;
+                    }
+                    if (first_vertex[id] == unused_vertex) {
+                        first_vertex[id] = (uint32_t)i;
+                    } else {
+                        locked[i] = locked[first_vertex[id]] = 1;
+                    }
+                }
+                // an edge used by only one triangle is on an open border
+                std::unordered_map<uint64_t, uint32_t> edge_counts;
+                edge_counts.reserve(indices.size());
+                for (size_t i = 0; i < indices.size(); i += 3) {
+                    for (size_t j = 0; j < 3; j++) {
+                        uint32_t a = position_ids[indices[i + j]], b = position_ids[indices[i + (j + 1) % 3]];
+                        edge_counts[((uint64_t)std::min(a, b) << 32) | (uint64_t)std::max(a, b)]++;
+                    }
+                }
+                std::vector<uint8_t> border_positions(vertex_count, 0);
+                for (const auto& [edge, count] : edge_counts) {
+                    if (count == 1) {
+                        border_positions[(uint32_t)(edge >> 32)] = border_positions[(uint32_t)edge] = 1;
+                    }
+                }
+                std::vector<quadric> quadrics(vertex_count);
+                for (size_t i = 0; i < indices.size(); i += 3) {
+                    glm::vec3 p0 = points[indices[i]], p1 = points[indices[i + 1]], p2 = points[indices[i + 2]];
+                    glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                    float area = glm::length(normal);
+                    if (area <= 0.f) {
+                        continue;
+                    }
+                    normal = normal / area;
+                    for (size_t j = 0; j < 3; j++) {
+                        quadrics[indices[i + j]].add_plane(normal, -glm::dot(normal, p0), (double)area);
+                    }
+                }
+                for (size_t i = 0; i < vertex_count; i++) {
+                    if (position_ids[i] != unused_vertex && border_positions[position_ids[i]]) {
+                        locked[i] = 1;
+                    }
+                }
+                double max_error_squared = (double)max_error * (double)max_error;
+                double result_error = 0.0;
+                std::vector<uint32_t> offsets, adjacency, remap(vertex_count);
+                std::vector<uint8_t> touched(vertex_count);
+                std::vector<collapse> collapses;
+                // each pass collapses as many independent edges as it can, cheapest first
+                while (destination.size() > target_index_count) {
+                    size_t triangle_count = destination.size() / 3;
+                    offsets.assign(vertex_count + 1, 0);
+                    for (uint32_t index : destination) {
+                        offsets[index + 1]++;
+                    }
+                    for (size_t i = 0; i < vertex_count; i++) {
+                        offsets[i + 1] += offsets[i];
+                    }
+                    adjacency.resize(destination.size());
+                    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+                    for (size_t i = 0; i < destination.size(); i++) {
+                        adjacency[fill[destination[i]]++] = (uint32_t)(i / 3);
+                    }
+                    collapses.clear();
+                    for (size_t i = 0; i < destination.size(); i += 3) {
+                        for (size_t j = 0; j < 3; j++) {
+                            uint32_t a = destination[i + j], b = destination[i + (j + 1) % 3];
+                            for (auto [from, to] : { std::make_pair(a, b), std::make_pair(b, a) }) {
+                                if (locked[from]) {
+                                    continue;
+                                }
+                                quadric q = quadrics[from];
+                                q.add(quadrics[to]);
+                                double error = q.weight > 0.0 ? q.evaluate(points[to]) / q.weight : 0.0;
+                                collapses.push_back({ from, to, error });
+                            }
+                        }
+                    }
+                    std::sort(collapses.begin(), collapses.end(), [](const collapse& lhs, const collapse& rhs) {
+                        return lhs.error < rhs.error;
+                    });
+                    for (size_t i = 0; i < vertex_count; i++) {
+                        remap[i] = (uint32_t)i;
+                    }
+                    std::fill(touched.begin(), touched.end(), 0);
+                    size_t removed_triangles = 0, collapsed = 0;
+                    size_t target_triangles = target_index_count / 3;
+                    for (const auto& c : collapses) {
+                        if (c.error > max_error_squared || triangle_count - removed_triangles <= target_triangles) {
+                            break;
+                        }
+                        if (touched[c.from] || touched[c.to]) {
+                            continue;
+                        }
+                        // reject collapses that would fold a triangle over
+                        bool flips = false;
+                        size_t degenerate = 0;
+                        for (uint32_t k = offsets[c.from]; k < offsets[c.from + 1] && !flips; k++) {
+                            const uint32_t* triangle = &destination[(size_t)adjacency[k] * 3];
+                            if (triangle[0] == c.to || triangle[1] == c.to || triangle[2] == c.to) {
+                                degenerate++;
+                                continue;
+                            }
+                            glm::vec3 before[3], after[3];
+                            for (size_t j = 0; j < 3; j++) {
+                                before[j] = points[triangle[j]];
+                                after[j] = triangle[j] == c.from ? points[c.to] : before[j];
+                            }
+                            glm::vec3 normal_before = glm::cross(before[1] - before[0], before[2] - before[0]);
+                            glm::vec3 normal_after = glm::cross(after[1] - after[0], after[2] - after[0]);
+                            flips = glm::dot(normal_before, normal_after) <= 0.f;
+                        }
+                        if (flips) {
+                            continue;
+                        }
+                        // everything around the collapse is left alone for the rest of the pass, so that adjacency stays accurate
+                        for (uint32_t k = offsets[c.from]; k < offsets[c.from + 1]; k++) {
+                            const uint32_t* triangle = &destination[(size_t)adjacency[k] * 3];
+                            touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+                        }
+                        touched[c.to] = 1;
+                        remap[c.from] = c.to;
+                        quadrics[c.to].add(quadrics[c.from]);
+                        result_error = std::max(result_error, c.error);
+                        removed_triangles += degenerate;
+                        collapsed++;
+                    }
+                    if (collapsed == 0) {
+                        break;
+                    }
+                    size_t write = 0;
+                    for (size_t i = 0; i < destination.size(); i += 3) {
+                        uint32_t a = remap[destination[i]], b = remap[destination[i + 1]], c = remap[destination[i + 2]];
+                        if (a != b && b != c && c != a) {
+                            destination[write++] = a;
+                            destination[write++] = b;
+                            destination[write++] = c;
+                        }
+                    }
+                    destination.resize(write);
+                }
+                return (float)sqrt(result_error);
+            }
+        }
+    }
+}
\ No newline at end of file
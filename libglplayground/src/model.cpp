@@ -7,6 +7,12 @@
 #include "element_buffer_object.h"
 #include "model.h"
 #include "shader_library.h"
+#include "state_tracker.h"
+#include "thread_pool.h"
+#include "main_thread_queue.h"
+#include "texture_buffer.h"
+#include "cooked_file.h"
+#include "mesh_optimizer.h"
 namespace libplayground {
     namespace gl {
         static glm::mat4 from_assimp_matrix(const aiMatrix4x4& matrix) {
@@ -27,12 +33,52 @@ namespace libplayground {
         static glm::quat from_assimp_quaternion(const aiQuaternion& quat) {
             return glm::quat(quat.w, quat.x, quat.y, quat.z);
         }
+        // a cursor further behind than this is treated as a seek
+        constexpr size_t max_cursor_steps = 4;
+        // index of the last key at or before the given time
+        template<typename T> static size_t find_key(const std::vector<T>& keys, float time) {
+            auto it = std::upper_bound(keys.begin() + 1, keys.end(), time, [](float time, const T& key) {
+                return time < key.time;
+            });
+            return (size_t)(it - keys.begin()) - 1;
+        }
+        // same as above, but starts from where the last sample was taken; playing forward only steps over a key or two
+        template<typename T> static size_t find_key(const std::vector<T>& keys, float time, uint32_t* cursor) {
+            if (!cursor) {
+                return find_key(keys, time);
+            }
+            size_t index = (size_t)*cursor;
+            if (index < keys.size() && keys[index].time <= time) {
+                for (size_t step = 0; step < max_cursor_steps && index + 1 < keys.size() && keys[index + 1].time <= time; step++) {
+                    index++;
+                }
+                if (index + 1 < keys.size() && keys[index + 1].time <= time) {
+                    index = find_key(keys, time);
+                }
+            } else {
+                // looped or seeked backwards
+                index = find_key(keys, time);
+            }
+            *cursor = (uint32_t)index;
+            return index;
+        }
+        template<typename T> static float get_interpolation_factor(const std::vector<T>& keys, size_t index, float time) {
+            float delta_time = keys[index + 1].time - keys[index].time;
+            if (delta_time <= 0.f) {
+                return 0.f;
+            }
+            return glm::clamp((time - keys[index].time) / delta_time, 0.f, 1.f);
+        }
         struct log_stream : public Assimp::LogStream {
             static void initialize() {
-                if (Assimp::DefaultLogger::isNullLogger()) {
-                    Assimp::DefaultLogger::create("", Assimp::Logger::VERBOSE);
-                    Assimp::DefaultLogger::get()->attachStream(new log_stream, Assimp::Logger::Err | Assimp::Logger::Warn);
-                }
+                // models are imported on several thread_pool workers at once, and the logger is global
+                static std::once_flag created;
+                std::call_once(created, []() {
+                    if (Assimp::DefaultLogger::isNullLogger()) {
+                        Assimp::DefaultLogger::create("", Assimp::Logger::VERBOSE);
+                        Assimp::DefaultLogger::get()->attachStream(new log_stream, Assimp::Logger::Err | Assimp::Logger::Warn);
+                    }
+                });
             }
             virtual void write(const char* message) override {
                 spdlog::error("Assimp: " + std::string(message));
@@ -47,8 +93,20 @@ namespace libplayground {
         std::vector<vertex_bone_data>& assimp_mesh::get_bone_data() {
             return this->m_bone_data;
         }
-        aiMesh* assimp_mesh::get_assimp_pointer() {
-            return this->m_ptr;
+        std::vector<assimp_mesh::lod>& assimp_mesh::get_lods() {
+            return this->m_lods;
+        }
+        const std::vector<assimp_mesh::lod>& assimp_mesh::get_lods() const {
+            return this->m_lods;
+        }
+        const std::vector<vertex>& assimp_mesh::get_vertex_data() const {
+            return this->m_vertices;
+        }
+        const std::vector<uint32_t>& assimp_mesh::get_index_data() const {
+            return this->m_indices;
+        }
+        const std::vector<vertex_bone_data>& assimp_mesh::get_bone_data() const {
+            return this->m_bone_data;
         }
         ref<vertex_array_object> assimp_mesh::get_vao() {
             return this->m_vao;
@@ -62,55 +120,668 @@ namespace libplayground {
         ref<element_buffer_object> assimp_mesh::get_ebo() {
             return this->m_ebo;
         }
-        assimp_mesh::assimp_mesh(aiMesh* ptr, bool is_animated) {
-            this->m_ptr = ptr;
+        const aabb& assimp_mesh::get_bounds() const {
+            return this->m_bounds;
+        }
+        assimp_mesh::assimp_mesh(bool is_animated) {
             this->m_is_animated = is_animated;
+            this->m_position_offset = glm::vec3(0.f);
+            this->m_position_scale = glm::vec3(1.f);
+            this->m_vertex_count = this->m_vertex_size = 0;
+        }
+        void assimp_mesh::set_mapped_data(const mapped_data& data, const aabb& bounds) {
+            this->m_mapped_data = data;
+            this->m_bounds = bounds;
+        }
+        void assimp_mesh::compute_bounds() {
+            this->m_bounds = aabb::from_vertices(this->m_vertices);
+        }
+        const glm::vec3& assimp_mesh::get_position_offset() const {
+            return this->m_position_offset;
+        }
+        const glm::vec3& assimp_mesh::get_position_scale() const {
+            return this->m_position_scale;
+        }
+        size_t assimp_mesh::get_vertex_count() const {
+            return this->m_vertex_count;
+        }
+        size_t assimp_mesh::get_vertex_size() const {
+            return this->m_vertex_size;
+        }
+        size_t assimp_mesh::get_gpu_memory_usage() const {
+            size_t size = 0;
+            if (this->m_vbo) {
+                size += this->m_vbo->get_memory_usage();
+            }
+            if (this->m_bone_buffer) {
+                size += this->m_bone_buffer->get_memory_usage();
+            }
+            if (this->m_ebo) {
+                size += this->m_ebo->get_memory_usage();
+            }
+            return size;
         }
-        void assimp_mesh::setup() {
+        size_t assimp_mesh::get_cpu_memory_usage() const {
+            return this->m_vertices.capacity() * sizeof(vertex) + this->m_indices.capacity() * sizeof(uint32_t) + this->m_bone_data.capacity() * sizeof(vertex_bone_data);
+        }
+        // byte offsets into a packed vertex
+        struct packed_vertex_layout {
+            size_t position, normal, uv, bone_ids, weights, stride;
+        };
+        static packed_vertex_layout get_packed_layout(const vertex_format& format, bool pack_skinning) {
+            packed_vertex_layout layout;
+            size_t offset = 0;
+            // quantized positions are padded to 4 components, so that everything after them stays aligned
+            layout.position = offset;
+            offset += format.quantize_positions ? 4 * sizeof(uint16_t) : sizeof(glm::vec3);
+            layout.normal = offset;
+            offset += format.normals == normal_encoding::full ? sizeof(glm::vec3) : sizeof(uint32_t);
+            layout.uv = offset;
+            offset += format.half_uvs ? sizeof(uint32_t) : sizeof(glm::vec2);
+            layout.bone_ids = layout.weights = 0;
+            if (pack_skinning) {
+                layout.bone_ids = offset;
+                offset += 4 * sizeof(uint8_t);
+                layout.weights = offset;
+                offset += 4 * sizeof(uint8_t);
+            }
+            layout.stride = offset;
+            return layout;
+        }
+        static glm::vec2 encode_octahedral(glm::vec3 normal) {
+            normal /= std::max(fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z), 1e-6f);
+            glm::vec2 result = glm::vec2(normal.x, normal.y);
+            if (normal.z < 0.f) {
+                // fold the lower hemisphere over the diagonals
+                glm::vec2 sign = glm::vec2(result.x >= 0.f ? 1.f : -1.f, result.y >= 0.f ? 1.f : -1.f);
+                result = (1.f - glm::abs(glm::vec2(result.y, result.x))) * sign;
+            }
+            return result;
+        }
+        static void pack_bone_data(const vertex_bone_data& data, uint8_t* ids, uint8_t* weights) {
+            float total = data.weights[0] + data.weights[1] + data.weights[2] + data.weights[3];
+            int32_t sum = 0;
+            size_t largest = 0;
+            for (size_t i = 0; i < 4; i++) {
+                ids[i] = (uint8_t)data.ids[i];
+                float weight = total > 0.f ? data.weights[i] / total : 0.f;
+                weights[i] = (uint8_t)lroundf(glm::clamp(weight, 0.f, 1.f) * 255.f);
+                sum += (int32_t)weights[i];
+                if (data.weights[i] > data.weights[largest]) {
+                    largest = i;
+                }
+            }
+            // rounding can leave the weights a step or two off; the largest one absorbs the difference
+            if (total > 0.f) {
+                weights[largest] = (uint8_t)glm::clamp((int32_t)weights[largest] + 255 - sum, 0, 255);
+            }
+        }
+        // compact skinning needs bone ids that fit in a byte
+        static bool packs_skinning(const vertex_format& format, bool is_animated, size_t bone_count) {
+            return is_animated && format.compact_skinning && bone_count <= 256;
+        }
+        // quantized positions are stored relative to the mesh's bounds
+        static void get_position_transform(const vertex_format& format, const aabb& bounds, glm::vec3& offset, glm::vec3& scale) {
+            offset = glm::vec3(0.f);
+            scale = glm::vec3(1.f);
+            if (format.quantize_positions && bounds.is_valid()) {
+                offset = bounds.min;
+                scale = bounds.max - bounds.min;
+            }
+        }
+        static void pack_vertex_data(const packed_vertex_layout& layout, const vertex_format& format, const vertex* vertices, const vertex_bone_data* bone_data, size_t count,
+            const glm::vec3& position_offset, const glm::vec3& position_scale, std::vector<uint8_t>& packed) {
+            packed.resize(count * layout.stride);
+            glm::vec3 inverse_scale = glm::vec3(0.f);
+            for (glm::length_t i = 0; i < 3; i++) {
+                inverse_scale[i] = position_scale[i] > 0.f ? 1.f / position_scale[i] : 0.f;
+            }
+            for (size_t i = 0; i < count; i++) {
+                const vertex& v = vertices[i];
+                uint8_t* destination = packed.data() + i * layout.stride;
+                if (format.quantize_positions) {
+                    glm::vec3 normalized = glm::clamp((v.pos - position_offset) * inverse_scale, 0.f, 1.f);
+                    uint64_t position = glm::packUnorm4x16(glm::vec4(normalized, 0.f));
+                    memcpy(destination + layout.position, &position, sizeof(uint64_t));
+                } else {
+                    memcpy(destination + layout.position, &v.pos, sizeof(glm::vec3));
+                }
+                if (format.normals == normal_encoding::packed) {
+                    uint32_t normal = glm::packSnorm3x10_1x2(glm::vec4(v.normal, 0.f));
+                    memcpy(destination + layout.normal, &normal, sizeof(uint32_t));
+                } else if (format.normals == normal_encoding::octahedral) {
+                    uint32_t normal = glm::packSnorm2x16(encode_octahedral(v.normal));
+                    memcpy(destination + layout.normal, &normal, sizeof(uint32_t));
+                } else {
+                    memcpy(destination + layout.normal, &v.normal, sizeof(glm::vec3));
+                }
+                if (format.half_uvs) {
+                    uint32_t uv = glm::packHalf2x16(v.uv);
+                    memcpy(destination + layout.uv, &uv, sizeof(uint32_t));
+                } else {
+                    memcpy(destination + layout.uv, &v.uv, sizeof(glm::vec2));
+                }
+                if (bone_data) {
+                    pack_bone_data(bone_data[i], destination + layout.bone_ids, destination + layout.weights);
+                }
+            }
+        }
+        void assimp_mesh::pack_vertices(const vertex_format& format, size_t bone_count, std::vector<uint8_t>& packed) const {
+            bool pack_skinning = packs_skinning(format, this->m_is_animated, bone_count);
+            glm::vec3 position_offset, position_scale;
+            get_position_transform(format, this->m_bounds, position_offset, position_scale);
+            const vertex_bone_data* bone_data = pack_skinning && !this->m_bone_data.empty() ? this->m_bone_data.data() : nullptr;
+            pack_vertex_data(get_packed_layout(format, pack_skinning), format, this->m_vertices.data(), bone_data, this->m_vertices.size(), position_offset, position_scale, packed);
+        }
+        void assimp_mesh::setup(const vertex_format& format, size_t bone_count) {
             this->m_vao = ref<vertex_array_object>::create();
             this->m_vao->bind();
-            this->m_vbo = ref<vertex_buffer_object>::create(this->m_vertices);
-            this->m_bone_buffer = ref<vertex_buffer_object>::create(this->m_bone_data);
-            this->m_ebo = ref<element_buffer_object>::create(this->m_indices);
-            std::vector<vertex_attribute> attributes = {
-                { GL_FLOAT, 3, sizeof(vertex), offsetof(vertex, pos), false },
-                { GL_FLOAT, 3, sizeof(vertex), offsetof(vertex, normal), false },
-                { GL_FLOAT, 2, sizeof(vertex), offsetof(vertex, uv), false }
-            };
-            if (this->m_is_animated) {
+            const auto& mapped = this->m_mapped_data;
+            bool pack_skinning = packs_skinning(format, this->m_is_animated, bone_count);
+            auto layout = get_packed_layout(format, pack_skinning);
+            get_position_transform(format, this->m_bounds, this->m_position_offset, this->m_position_scale);
+            this->m_vertex_size = layout.stride;
+            const vertex_bone_data* bone_data;
+            if (mapped.vertices) {
+                // straight from the cooked file, which was packed when it was cooked
+                this->m_vertex_count = mapped.vertex_count;
+                this->m_vbo = ref<vertex_buffer_object>::create(mapped.vertices, mapped.vertex_count * layout.stride);
+                this->m_ebo = ref<element_buffer_object>::create(mapped.indices, mapped.index_count);
+                bone_data = mapped.bone_data;
+            } else {
+                this->m_vertex_count = this->m_vertices.size();
+                if (format.is_full() && !pack_skinning) {
+                    // already laid out that way
+                    this->m_vbo = ref<vertex_buffer_object>::create(this->m_vertices);
+                } else {
+                    thread_local std::vector<uint8_t> packed;
+                    this->pack_vertices(format, bone_count, packed);
+                    this->m_vbo = ref<vertex_buffer_object>::create(packed.data(), packed.size());
+                }
+                this->m_ebo = ref<element_buffer_object>::create(this->m_indices);
+                bone_data = this->m_bone_data.empty() ? nullptr : this->m_bone_data.data();
+            }
+            std::vector<vertex_attribute> attributes;
+            if (format.quantize_positions) {
+                attributes.push_back({ GL_UNSIGNED_SHORT, 4, layout.stride, layout.position, true });
+            } else {
+                attributes.push_back({ GL_FLOAT, 3, layout.stride, layout.position, false });
+            }
+            switch (format.normals) {
+            case normal_encoding::packed:
+                attributes.push_back({ GL_INT_2_10_10_10_REV, 4, layout.stride, layout.normal, true });
+                break;
+            case normal_encoding::octahedral:
+                attributes.push_back({ GL_SHORT, 2, layout.stride, layout.normal, true });
+                break;
+            default:
+                attributes.push_back({ GL_FLOAT, 3, layout.stride, layout.normal, false });
+                break;
+            }
+            attributes.push_back({ format.half_uvs ? (GLenum)GL_HALF_FLOAT : (GLenum)GL_FLOAT, 2, layout.stride, layout.uv, false });
+            if (pack_skinning) {
                 attributes.insert(attributes.end(), {
-                    { GL_INT, 4, sizeof(vertex_bone_data), offsetof(vertex_bone_data, ids), false },
-                    { GL_FLOAT, 4, sizeof(vertex_bone_data), offsetof(vertex_bone_data, weights), false },
+                    { GL_UNSIGNED_BYTE, 4, layout.stride, layout.bone_ids, false },
+                    { GL_UNSIGNED_BYTE, 4, layout.stride, layout.weights, true },
                 });
             }
             this->m_vao->add_vertex_attributes(attributes);
+            if (this->m_is_animated && !pack_skinning) {
+                // a second buffer, bound to the same attribute locations
+                this->m_bone_buffer = ref<vertex_buffer_object>::create(bone_data, bone_data ? this->m_vertex_count : 0);
+                this->m_vertex_size += sizeof(vertex_bone_data);
+                this->m_vao->add_vertex_attributes({
+                    { GL_UNSIGNED_INT, 4, sizeof(vertex_bone_data), offsetof(vertex_bone_data, ids), false },
+                    { GL_FLOAT, 4, sizeof(vertex_bone_data), offsetof(vertex_bone_data, weights), false },
+                }, 3);
+            }
             this->m_vao->unbind();
+            // the mapping is released after upload
+            this->m_mapped_data = mapped_data();
         }
-        model::model(const std::string& path) {
+        // keeps models alive while they load; only touched on the main thread
+        static std::vector<ref<model>> pending_models;
+        static void release_pending_model(model* m) {
+            for (auto it = pending_models.begin(); it != pending_models.end(); it++) {
+                if (it->raw() == m) {
+                    pending_models.erase(it);
+                    return;
+                }
+            }
+        }
+        ref<model> model::load_async(const std::string& path, const settings& s) {
+            ref<model> m = ref<model>(new model);
+            m->m_file_path = path;
+            pending_models.push_back(m);
+            // the worker only gets a raw pointer; reference counts are not thread safe
+            model* instance = m.raw();
+            thread_pool::get().submit([instance, s]() {
+                try {
+                    instance->import(s);
+                    main_thread_queue::post([instance]() {
+                        instance->upload();
+                        instance->m_load_state = load_state::ready;
+                        release_pending_model(instance);
+                    });
+                } catch (const std::exception& exc) {
+                    std::string message = exc.what();
+                    main_thread_queue::post([instance, message]() {
+                        spdlog::error(message);
+                        instance->m_load_state = load_state::failed;
+                        release_pending_model(instance);
+                    });
+                }
+            });
+            return m;
+        }
+        model::model() {
+            this->m_is_animated = false;
+            this->m_load_state = load_state::loading;
+        }
+        model::model(const std::string& path, const settings& s) : model() {
             this->m_file_path = path;
+            this->import(s);
+            this->upload();
+            this->m_load_state = load_state::ready;
+        }
+        // bump whenever the layout of cooked files changes
+        constexpr uint32_t cooked_model_magic = 0x4c444d43; // "CMDL"
+        constexpr uint32_t cooked_model_version = 4;
+        struct cooked_model_header {
+            uint32_t magic, version;
+            // catches a change to the vertex layout that was not followed by a version bump
+            uint32_t vertex_size, bone_data_size;
+            // of the file that was cooked, to tell when the cache is stale
+            uint64_t source_size;
+            int64_t source_time;
+            uint32_t bake_animations;
+            float bake_sample_rate;
+            uint32_t optimization_flags;
+            float overdraw_threshold;
+            uint32_t lod_count;
+            float lod_reduction, lod_max_error;
+            // vertices are stored in this layout, ready to upload
+            uint32_t vertex_format;
+        };
+        static uint32_t get_vertex_format_flags(const vertex_format& format) {
+            return (format.quantize_positions ? 1u : 0u) | ((uint32_t)format.normals << 1) | (format.half_uvs ? 8u : 0u) | (format.compact_skinning ? 16u : 0u);
+        }
+        static vertex_format get_vertex_format(uint32_t flags) {
+            vertex_format format;
+            format.quantize_positions = (flags & 1u) != 0;
+            format.normals = (normal_encoding)((flags >> 1) & 3u);
+            format.half_uvs = (flags & 8u) != 0;
+            format.compact_skinning = (flags & 16u) != 0;
+            return format;
+        }
+        static uint32_t get_optimization_flags(const model::settings& s) {
+            bool passes[] = { s.merge_meshes, s.weld_vertices, s.optimize_vertex_cache, s.optimize_overdraw, s.optimize_vertex_fetch };
+            uint32_t flags = 0;
+            for (size_t i = 0; i < sizeof(passes) / sizeof(bool); i++) {
+                if (passes[i]) {
+                    flags |= 1u << i;
+                }
+            }
+            return flags;
+        }
+        static bool ends_with(const std::string& string, const std::string& suffix) {
+            return string.length() >= suffix.length() && string.compare(string.length() - suffix.length(), suffix.length(), suffix) == 0;
+        }
+        static bool get_source_stamp(const std::string& path, uint64_t& size, int64_t& time) {
+            std::error_code error;
+            size = (uint64_t)std::filesystem::file_size(path, error);
+            if (error) {
+                return false;
+            }
+            time = (int64_t)std::filesystem::last_write_time(path, error).time_since_epoch().count();
+            return !error;
+        }
+        static std::string cooked_cache_directory;
+        static std::string get_cooked_cache_path(const std::string& source_path) {
+            if (cooked_cache_directory.empty()) {
+                return source_path + model::cooked_extension;
+            }
+            // fnv-1a of the full path, so that sources with the same name in different directories get their own copies
+            std::error_code error;
+            std::string full_path = std::filesystem::absolute(source_path, error).string();
+            uint64_t hash = 0xcbf29ce484222325ull;
+            for (char c : full_path) {
+                hash ^= (uint64_t)(uint8_t)c;
+                hash *= 0x100000001b3ull;
+            }
+            std::stringstream file_name;
+            file_name << std::filesystem::path(source_path).filename().string() << "." << std::hex << hash << model::cooked_extension;
+            return (std::filesystem::path(cooked_cache_directory) / file_name.str()).string();
+        }
+        void model::set_cooked_cache_directory(const std::string& path) {
+            cooked_cache_directory = path;
+        }
+        const std::string& model::get_cooked_cache_directory() {
+            return cooked_cache_directory;
+        }
+        void model::cook(const std::string& source_path, const std::string& cooked_path, const settings& s) {
+            uint64_t source_size = 0;
+            int64_t source_time = 0;
+            get_source_stamp(source_path, source_size, source_time);
+            model m;
+            m.m_file_path = source_path;
+            m.import_assimp(s);
+            m.write_cooked(cooked_path, s, source_size, source_time);
+        }
+        void model::import(const settings& s) {
+            // a cooked file loaded directly replaces this with the layout it was cooked with
+            this->m_vertex_format = s.format;
+            if (ends_with(this->m_file_path, cooked_extension)) {
+                spdlog::info("Loading cooked model from: " + this->m_file_path);
+                this->load_cooked(this->m_file_path, nullptr, 0, 0);
+                return;
+            }
+            uint64_t source_size = 0;
+            int64_t source_time = 0;
+            bool use_cache = s.use_cooked_cache && get_source_stamp(this->m_file_path, source_size, source_time);
+            std::string cooked_path = get_cooked_cache_path(this->m_file_path);
+            if (use_cache && std::filesystem::exists(cooked_path)) {
+                try {
+                    if (this->load_cooked(cooked_path, &s, source_size, source_time)) {
+                        spdlog::info("Loaded model from cache: " + cooked_path);
+                        return;
+                    }
+                } catch (const std::exception& exc) {
+                    spdlog::warn("Ignoring damaged cooked model " + cooked_path + ": " + exc.what());
+                }
+                // start over from a clean slate
+                this->m_meshes.clear();
+                this->m_joints.clear();
+                this->m_bone_offsets.clear();
+                this->m_animations.clear();
+                this->m_bounds = aabb();
+                this->m_cooked_file.reset();
+                this->m_vertex_format = s.format;
+            }
+            this->import_assimp(s);
+            if (use_cache) {
+                try {
+                    if (!cooked_cache_directory.empty()) {
+                        std::filesystem::create_directories(cooked_cache_directory);
+                    }
+                    this->write_cooked(cooked_path, s, source_size, source_time);
+                } catch (const std::exception& exc) {
+                    spdlog::warn("Could not write cooked model " + cooked_path + ": " + exc.what());
+                }
+            }
+        }
+        bool model::load_cooked(const std::string& path, const settings* s, uint64_t source_size, int64_t source_time) {
+            this->m_cooked_file = ref<mapped_file>::create(path);
+            binary_reader reader(this->m_cooked_file->get_data(), this->m_cooked_file->get_size());
+            auto header = reader.read<cooked_model_header>();
+            if (header.magic != cooked_model_magic) {
+                throw std::runtime_error("Not a cooked model file!");
+            }
+            if (header.version != cooked_model_version || header.vertex_size != (uint32_t)sizeof(vertex) || header.bone_data_size != (uint32_t)sizeof(vertex_bone_data)) {
+                this->m_cooked_file.reset();
+                if (!s) {
+                    throw std::runtime_error("Cooked model was written by a different version; cook it again");
+                }
+                return false;
+            }
+            if (s && (header.source_size != source_size || header.source_time != source_time ||
+                (header.bake_animations != 0) != s->bake_animations || header.bake_sample_rate != s->bake_sample_rate ||
+                header.optimization_flags != get_optimization_flags(*s) || header.overdraw_threshold != s->overdraw_threshold ||
+                header.lod_count != s->lod_count || header.lod_reduction != s->lod_reduction || header.lod_max_error != s->lod_max_error ||
+                header.vertex_format != get_vertex_format_flags(s->format))) {
+                this->m_cooked_file.reset();
+                return false;
+            }
+            if (((header.vertex_format >> 1) & 3u) > (uint32_t)normal_encoding::octahedral) {
+                throw std::runtime_error("Unknown vertex format!");
+            }
+            this->m_vertex_format = get_vertex_format(header.vertex_format);
+            this->m_is_animated = reader.read<uint8_t>() != 0;
+            // decides the vertex size, but depends on the bone count, which comes after the meshes
+            bool pack_skinning = reader.read<uint8_t>() != 0;
+            size_t vertex_size = get_packed_layout(this->m_vertex_format, pack_skinning).stride;
+            bool separate_bone_data = this->m_is_animated && !pack_skinning;
+            this->m_inverse_transform = reader.read<glm::mat4>();
+            this->m_bounds = reader.read<aabb>();
+            size_t mesh_count = (size_t)reader.read<uint64_t>();
+            this->m_meshes.reserve(mesh_count);
+            for (size_t i = 0; i < mesh_count; i++) {
+                auto& mesh = this->m_meshes.emplace_back(this->m_is_animated);
+                aabb bounds = reader.read<aabb>();
+                assimp_mesh::mapped_data data;
+                size_t vertex_bytes, bone_data_count;
+                data.vertices = reader.view_array<uint8_t>(vertex_bytes);
+                if (vertex_bytes % vertex_size != 0) {
+                    throw std::runtime_error("Vertex data does not match the vertex format!");
+                }
+                data.vertex_count = vertex_bytes / vertex_size;
+                data.indices = reader.view_array<uint32_t>(data.index_count);
+                data.bone_data = reader.view_array<vertex_bone_data>(bone_data_count);
+                if (separate_bone_data ? bone_data_count != data.vertex_count : bone_data_count != 0) {
+                    throw std::runtime_error("Bone data does not match the vertices!");
+                }
+                if (!separate_bone_data) {
+                    data.bone_data = nullptr;
+                }
+                reader.read_array(mesh.get_lods());
+                for (const auto& level : mesh.get_lods()) {
+                    if ((size_t)level.index_offset + (size_t)level.index_count > data.index_count) {
+                        throw std::runtime_error("Mesh level of detail out of range!");
+                    }
+                }
+                // an index past the end would read outside the vertex buffer on the gpu; throwing makes the caller import instead
+                for (size_t j = 0; j < data.index_count; j++) {
+                    if (data.indices[j] >= data.vertex_count) {
+                        throw std::runtime_error("Mesh index out of range!");
+                    }
+                }
+                mesh.set_mapped_data(data, bounds);
+            }
+            reader.read_array(this->m_joints);
+            reader.read_array(this->m_bone_offsets);
+            for (size_t i = 0; i < this->m_joints.size(); i++) {
+                const auto& j = this->m_joints[i];
+                if (j.parent >= (int32_t)i || j.bone >= (int32_t)this->m_bone_offsets.size()) {
+                    throw std::runtime_error("Skeleton is out of order!");
+                }
+            }
+            if (pack_skinning != packs_skinning(this->m_vertex_format, this->m_is_animated, this->m_bone_offsets.size())) {
+                throw std::runtime_error("Bone data does not match the skeleton!");
+            }
+            size_t animation_count = (size_t)reader.read<uint64_t>();
+            this->m_animations.resize(animation_count);
+            for (auto& animation : this->m_animations) {
+                animation.name = reader.read_string();
+                animation.duration = reader.read<float>();
+                animation.ticks_per_second = reader.read<float>();
+                reader.read_array(animation.joint_channels);
+                animation.is_baked = reader.read<uint8_t>() != 0;
+                size_t channel_count;
+                if (animation.is_baked) {
+                    animation.baked.read(reader);
+                    channel_count = animation.baked.get_channel_count();
+                } else {
+                    channel_count = (size_t)reader.read<uint64_t>();
+                    animation.channels.resize(channel_count);
+                    for (auto& channel : animation.channels) {
+                        reader.read_array(channel.positions);
+                        reader.read_array(channel.rotations);
+                        reader.read_array(channel.scales);
+                        if (channel.positions.empty() || channel.rotations.empty() || channel.scales.empty()) {
+                            throw std::runtime_error("Animation channel has no keys!");
+                        }
+                    }
+                }
+                if (animation.joint_channels.size() != this->m_joints.size()) {
+                    throw std::runtime_error("Animation does not match the skeleton!");
+                }
+                for (int32_t channel : animation.joint_channels) {
+                    if (channel >= (int32_t)channel_count) {
+                        throw std::runtime_error("Animation channel out of range!");
+                    }
+                }
+            }
+            return true;
+        }
+        void model::write_cooked(const std::string& path, const settings& s, uint64_t source_size, int64_t source_time) const {
+            binary_writer writer;
+            cooked_model_header header;
+            header.magic = cooked_model_magic;
+            header.version = cooked_model_version;
+            header.vertex_size = (uint32_t)sizeof(vertex);
+            header.bone_data_size = (uint32_t)sizeof(vertex_bone_data);
+            header.source_size = source_size;
+            header.source_time = source_time;
+            header.bake_animations = s.bake_animations ? 1 : 0;
+            header.bake_sample_rate = s.bake_sample_rate;
+            header.optimization_flags = get_optimization_flags(s);
+            header.overdraw_threshold = s.overdraw_threshold;
+            header.lod_count = s.lod_count;
+            header.lod_reduction = s.lod_reduction;
+            header.lod_max_error = s.lod_max_error;
+            header.vertex_format = get_vertex_format_flags(s.format);
+            writer.write(header);
+            writer.write((uint8_t)(this->m_is_animated ? 1 : 0));
+            // packed now, so that loading the file only has to upload it
+            size_t bone_count = this->m_bone_offsets.size();
+            bool pack_skinning = packs_skinning(s.format, this->m_is_animated, bone_count);
+            writer.write((uint8_t)(pack_skinning ? 1 : 0));
+            writer.write(this->m_inverse_transform);
+            writer.write(this->m_bounds);
+            writer.write((uint64_t)this->m_meshes.size());
+            std::vector<uint8_t> packed;
+            for (const auto& mesh : this->m_meshes) {
+                writer.write(mesh.get_bounds());
+                mesh.pack_vertices(s.format, bone_count, packed);
+                writer.write_array(packed);
+                writer.write_array(mesh.get_index_data());
+                if (this->m_is_animated && !pack_skinning) {
+                    writer.write_array(mesh.get_bone_data());
+                } else {
+                    writer.write_array(std::vector<vertex_bone_data>());
+                }
+                writer.write_array(mesh.get_lods());
+            }
+            writer.write_array(this->m_joints);
+            writer.write_array(this->m_bone_offsets);
+            writer.write((uint64_t)this->m_animations.size());
+            for (const auto& animation : this->m_animations) {
+                writer.write_string(animation.name);
+                writer.write(animation.duration);
+                writer.write(animation.ticks_per_second);
+                writer.write_array(animation.joint_channels);
+                writer.write((uint8_t)(animation.is_baked ? 1 : 0));
+                if (animation.is_baked) {
+                    animation.baked.write(writer);
+                } else {
+                    writer.write((uint64_t)animation.channels.size());
+                    for (const auto& channel : animation.channels) {
+                        writer.write_array(channel.positions);
+                        writer.write_array(channel.rotations);
+                        writer.write_array(channel.scales);
+                    }
+                }
+            }
+            writer.save(path);
+        }
+        struct optimize_stats {
+            size_t vertices_before = 0, vertices_after = 0;
+            // acmr weighted by index count, so that the totals are not skewed by tiny meshes
+            double acmr_before = 0.0, acmr_after = 0.0;
+            size_t total_indices = 0;
+        };
+        static void optimize_mesh(assimp_mesh& mesh, const model::settings& s, optimize_stats& stats) {
+            auto& vertices = mesh.get_vertex_data();
+            auto& indices = mesh.get_index_data();
+            auto& bone_data = mesh.get_bone_data();
+            if (indices.empty()) {
+                return;
+            }
+            size_t vertex_count = vertices.size(), vertices_before = vertices.size();
+            float acmr_before = mesh_optimizer::compute_acmr(indices, vertex_count);
+            std::vector<uint32_t> remap;
+            auto apply_remap = [&](size_t new_vertex_count) {
+                mesh_optimizer::remap_indices(indices, remap);
+                mesh_optimizer::remap_vertices(vertices, remap, new_vertex_count);
+                if (!bone_data.empty()) {
+                    mesh_optimizer::remap_vertices(bone_data, remap, new_vertex_count);
+                }
+                vertex_count = new_vertex_count;
+            };
+            if (s.weld_vertices) {
+                std::vector<mesh_optimizer::vertex_stream> streams = { mesh_optimizer::make_stream(vertices) };
+                if (!bone_data.empty()) {
+                    streams.push_back(mesh_optimizer::make_stream(bone_data));
+                }
+                apply_remap(mesh_optimizer::generate_weld_remap(remap, indices, vertex_count, streams));
+            }
+            if (s.optimize_vertex_cache) {
+                mesh_optimizer::optimize_vertex_cache(indices, vertex_count);
+                if (s.optimize_overdraw) {
+                    mesh_optimizer::vertex_stream positions = { (const uint8_t*)vertices.data() + offsetof(vertex, pos), sizeof(glm::vec3), sizeof(vertex) };
+                    mesh_optimizer::optimize_overdraw(indices, positions, vertex_count, s.overdraw_threshold);
+                }
+            }
+            if (s.optimize_vertex_fetch) {
+                apply_remap(mesh_optimizer::generate_fetch_remap(remap, indices, vertex_count));
+            }
+            float acmr_after = mesh_optimizer::compute_acmr(indices, vertex_count);
+            stats.vertices_before += vertices_before;
+            stats.vertices_after += vertex_count;
+            stats.acmr_before += (double)acmr_before * (double)indices.size();
+            stats.acmr_after += (double)acmr_after * (double)indices.size();
+            stats.total_indices += indices.size();
+        }
+        static void generate_lods(assimp_mesh& mesh, const model::settings& s) {
+            auto& indices = mesh.get_index_data();
+            auto& lods = mesh.get_lods();
+            const auto& vertices = mesh.get_vertex_data();
+            lods.clear();
+            lods.push_back({ 0, (uint32_t)indices.size(), 0.f });
+            aabb bounds = aabb::from_vertices(vertices);
+            if (s.lod_count == 0 || indices.empty() || !bounds.is_valid()) {
+                return;
+            }
+            float max_error = s.lod_max_error * glm::length(bounds.get_extent());
+            mesh_optimizer::vertex_stream positions = { (const uint8_t*)vertices.data() + offsetof(vertex, pos), sizeof(glm::vec3), sizeof(vertex) };
+            // each level is simplified from the one before it, so errors add up
+            std::vector<uint32_t> source(indices), simplified;
+            float error = 0.f;
+            for (uint32_t i = 0; i < s.lod_count; i++) {
+                size_t target = (size_t)((float)source.size() * s.lod_reduction) / 3 * 3;
+                error += mesh_optimizer::simplify(simplified, source, positions, vertices.size(), target, max_error);
+                // not worth a level of its own
+                if (simplified.empty() || (float)simplified.size() > (float)source.size() * 0.9f) {
+                    break;
+                }
+                mesh_optimizer::optimize_vertex_cache(simplified, vertices.size());
+                lods.push_back({ (uint32_t)indices.size(), (uint32_t)simplified.size(), error });
+                indices.insert(indices.end(), simplified.begin(), simplified.end());
+                source.swap(simplified);
+            }
+        }
+        void model::import_assimp(const settings& s) {
             log_stream::initialize();
             spdlog::info("Loading model from: " + this->m_file_path);
-            this->m_importer = std::make_unique<Assimp::Importer>();
+            // everything needed is copied out of the scene, so the importer is released when the constructor returns
+            Assimp::Importer importer;
             uint32_t flags =
                 aiProcess_Triangulate |
                 aiProcess_FlipUVs |
                 aiProcess_LimitBoneWeights;
-            this->m_scene = this->m_importer->ReadFile(this->m_file_path, flags);
-            if (!this->m_scene || !this->m_scene->HasMeshes() || this->m_scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) {
-                throw std::runtime_error("Could not load model from: " + this->m_file_path);
+            if (s.merge_meshes) {
+                flags |= aiProcess_OptimizeMeshes;
             }
-            this->m_is_animated = this->m_scene->mAnimations != nullptr;
-            auto& library = shader_library::get();
-            if (this->m_is_animated) {
-                this->m_shader = library["model-animated"];
-            } else {
-                this->m_shader = library["model-static"];
+            const aiScene* scene = importer.ReadFile(this->m_file_path, flags);
+            if (!scene || !scene->HasMeshes() || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) {
+                throw std::runtime_error("Could not load model from: " + this->m_file_path);
             }
-            this->m_inverse_transform = glm::inverse(from_assimp_matrix(this->m_scene->mRootNode->mTransformation));
-            this->m_meshes.reserve((size_t)this->m_scene->mNumMeshes);
-            for (uint32_t m = 0; m < this->m_scene->mNumMeshes; m++) {
-                aiMesh* mesh = this->m_scene->mMeshes[m];
-                auto& mesh_ = this->m_meshes.emplace_back(mesh, this->m_is_animated);
+            this->m_is_animated = scene->mAnimations != nullptr;
+            this->m_inverse_transform = glm::inverse(from_assimp_matrix(scene->mRootNode->mTransformation));
+            this->m_meshes.reserve((size_t)scene->mNumMeshes);
+            for (uint32_t m = 0; m < scene->mNumMeshes; m++) {
+                aiMesh* mesh = scene->mMeshes[m];
+                auto& mesh_ = this->m_meshes.emplace_back(this->m_is_animated);
                 if (!mesh->HasPositions()) {
                     throw std::runtime_error("This mesh does not have vertex positions!");
                 }
@@ -135,10 +806,10 @@ namespace libplayground {
                     }
                 }
             }
-            this->traverse_nodes(this->m_scene->mRootNode);
             if (this->m_is_animated) {
-                for (size_t m = 0; m < (size_t)this->m_scene->mNumMeshes; m++) {
-                    aiMesh* mesh = this->m_scene->mMeshes[m];
+                std::unordered_map<std::string, uint32_t> bone_map;
+                for (size_t m = 0; m < (size_t)scene->mNumMeshes; m++) {
+                    aiMesh* mesh = scene->mMeshes[m];
                     auto& mesh_ = this->m_meshes[m];
                     auto& bone_data = mesh_.get_bone_data();
                     bone_data.resize(mesh_.get_vertex_data().size());
@@ -146,14 +817,13 @@ namespace libplayground {
                         aiBone* bone = mesh->mBones[i];
                         std::string bone_name = std::string(bone->mName.C_Str());
                         uint32_t bone_index = 0;
-                        if (this->m_bone_map.find(bone_name) == this->m_bone_map.end()) {
-                            bone_index = this->m_bone_count;
-                            this->m_bone_count++;
-                            this->m_bone_info.push_back(bone_info());
-                            this->m_bone_info[bone_index].bone_offset = from_assimp_matrix(bone->mOffsetMatrix);
-                            this->m_bone_map[bone_name] = bone_index;
+                        auto it = bone_map.find(bone_name);
+                        if (it == bone_map.end()) {
+                            bone_index = (uint32_t)this->m_bone_offsets.size();
+                            this->m_bone_offsets.push_back(from_assimp_matrix(bone->mOffsetMatrix));
+                            bone_map[bone_name] = bone_index;
                         } else {
-                            bone_index = this->m_bone_map[bone_name];
+                            bone_index = it->second;
                         }
                         for (size_t j = 0; j < (size_t)bone->mNumWeights; j++) {
                             uint32_t vertex_id = bone->mWeights[j].mVertexId;
@@ -162,18 +832,89 @@ namespace libplayground {
                         }
                     }
                 }
+                this->load_skeleton(scene, bone_map, s.bake_animations, s.bake_sample_rate);
+            }
+            optimize_stats stats;
+            for (auto& mesh : this->m_meshes) {
+                optimize_mesh(mesh, s, stats);
+            }
+            if (stats.total_indices > 0) {
+                spdlog::info("Optimized {0} mesh(es): {1} -> {2} vertices, acmr {3:.3f} -> {4:.3f}", this->m_meshes.size(),
+                    stats.vertices_before, stats.vertices_after, stats.acmr_before / (double)stats.total_indices, stats.acmr_after / (double)stats.total_indices);
+            }
+            for (auto& mesh : this->m_meshes) {
+                generate_lods(mesh, s);
             }
             // todo: materials
             for (auto& mesh : this->m_meshes) {
-                mesh.setup(); // generate opengl buffers
+                mesh.compute_bounds();
+                this->m_bounds.expand(mesh.get_bounds());
+            }
+            if (this->m_is_animated && this->m_bounds.is_valid()) {
+                // skinned vertices can leave the bind pose bounds; pad them so that animated models are not culled too eagerly
+                glm::vec3 padding = this->m_bounds.get_extent() * 0.5f;
+                this->m_bounds = aabb(this->m_bounds.min - padding, this->m_bounds.max + padding);
             }
         }
+        void model::upload() {
+            const auto& format = this->m_vertex_format;
+            auto& library = shader_library::get();
+            if (this->m_is_animated) {
+                this->m_shader = library["model-animated"];
+            } else {
+                this->m_shader = library["model-static"];
+            }
+            if (this->m_shader) {
+                this->m_bone_palette_uniform = this->m_shader->get_uniform_handle("bone_palette");
+                this->m_bone_offset_uniform = this->m_shader->get_uniform_handle("bone_offset");
+                this->m_bones_uniform = this->m_shader->get_uniform_handle("bones");
+                this->m_position_offset_uniform = this->m_shader->get_uniform_handle("position_offset");
+                this->m_position_scale_uniform = this->m_shader->get_uniform_handle("position_scale");
+                this->m_octahedral_normals_uniform = this->m_shader->get_uniform_handle("octahedral_normals");
+                if (format.quantize_positions && !this->m_position_scale_uniform.is_valid()) {
+                    spdlog::warn("Positions are quantized, but the model shader does not declare \"position_scale\"; the model will be drawn at the wrong size");
+                }
+            }
+            this->m_lod_errors.clear();
+            for (const auto& mesh : this->m_meshes) {
+                const auto& lods = mesh.get_lods();
+                if (this->m_lod_errors.size() < lods.size()) {
+                    this->m_lod_errors.resize(lods.size(), 0.f);
+                }
+            }
+            for (size_t level = 0; level < this->m_lod_errors.size(); level++) {
+                for (const auto& mesh : this->m_meshes) {
+                    const auto& lods = mesh.get_lods();
+                    if (!lods.empty()) {
+                        this->m_lod_errors[level] = std::max(this->m_lod_errors[level], lods[std::min(level, lods.size() - 1)].error);
+                    }
+                }
+            }
+            size_t vertex_count = 0, vertex_bytes = 0;
+            for (auto& mesh : this->m_meshes) {
+                mesh.setup(format, this->m_bone_offsets.size()); // generate opengl buffers
+                vertex_count += mesh.get_vertex_count();
+                vertex_bytes += mesh.get_vertex_count() * mesh.get_vertex_size();
+            }
+            if (vertex_count > 0) {
+                size_t full_size = sizeof(vertex) + (this->m_is_animated ? sizeof(vertex_bone_data) : 0);
+                spdlog::info("Uploaded " + std::to_string(vertex_count) + " vertices in " + std::to_string(vertex_bytes) + " bytes (" + std::to_string(vertex_count * full_size) + " in the full layout)");
+            }
+            this->m_cooked_file.reset();
+        }
         std::vector<assimp_mesh>& model::get_meshes() {
             return this->m_meshes;
         }
         const std::vector<assimp_mesh>& model::get_meshes() const {
             return this->m_meshes;
         }
+        const aabb& model::get_bounds() const {
+            static const aabb empty;
+            if (this->m_load_state != load_state::ready) {
+                return empty;
+            }
+            return this->m_bounds;
+        }
         ref<shader> model::get_mesh_shader() {
             return this->m_shader;
         }
@@ -181,188 +922,307 @@ namespace libplayground {
             return this->m_file_path;
         }
         uint32_t model::get_animation_count() const {
-            return this->m_scene->mNumAnimations;
+            return (uint32_t)this->m_animations.size();
         }
         int32_t model::find_animation_by_name(const std::string& name) const {
-            if (this->m_is_animated) {
-                for (uint32_t i = 0; i < this->m_scene->mNumAnimations; i++) {
-                    const aiAnimation* animation = this->m_scene->mAnimations[i];
-                    if (std::string(animation->mName.C_Str()) == name) {
-                        return (int32_t)i;
-                    }
+            for (size_t i = 0; i < this->m_animations.size(); i++) {
+                if (this->m_animations[i].name == name) {
+                    return (int32_t)i;
                 }
             }
             return -1;
         }
         float model::get_animation_length(uint32_t index) const {
-            if (this->m_is_animated || index < this->m_scene->mNumAnimations) {
-                const aiAnimation* animation = this->m_scene->mAnimations[index];
-                return static_cast<float>(animation->mDuration / (animation->mTicksPerSecond != 0.0 ? animation->mTicksPerSecond : 25.0));
+            if (index < this->m_animations.size()) {
+                const auto& animation = this->m_animations[index];
+                return animation.duration / animation.ticks_per_second;
             }
             return 0.f;
         }
-        void model::draw(int32_t animation_index, float animation_time) {
+        bool model::is_animated() const {
+            return this->m_load_state == load_state::ready && this->m_is_animated;
+        }
+        size_t model::get_gpu_memory_usage() const {
+            // the importer may still be filling in the meshes
+            if (this->m_load_state != load_state::ready) {
+                return 0;
+            }
+            size_t size = 0;
+            for (const auto& mesh : this->m_meshes) {
+                size += mesh.get_gpu_memory_usage();
+            }
+            return size;
+        }
+        size_t model::get_cpu_memory_usage() const {
+            if (this->m_load_state != load_state::ready) {
+                return 0;
+            }
+            size_t size = this->m_joints.capacity() * sizeof(joint) + this->m_bone_offsets.capacity() * sizeof(glm::mat4);
+            for (const auto& mesh : this->m_meshes) {
+                size += mesh.get_cpu_memory_usage();
+            }
+            for (const auto& animation : this->m_animations) {
+                size += animation.joint_channels.capacity() * sizeof(int32_t) + animation.baked.get_memory_usage();
+                for (const auto& c : animation.channels) {
+                    size += (c.positions.capacity() + c.scales.capacity()) * sizeof(vector_key) + c.rotations.capacity() * sizeof(rotation_key);
+                }
+            }
+            return size;
+        }
+        model::load_state model::get_load_state() const {
+            return this->m_load_state;
+        }
+        bool model::is_ready() const {
+            return this->m_load_state == load_state::ready;
+        }
+        void model::compute_bone_palette(int32_t animation_index, float animation_time, std::vector<glm::mat4>& palette, animation_cursor* cursor) const {
+            if (!this->is_animated()) {
+                palette.clear();
+                return;
+            }
+            this->evaluate_pose(this->get_animation_ticks(animation_index, animation_time), animation_index, palette, cursor);
+        }
+        uint32_t model::get_lod_count() const {
+            if (this->m_load_state != load_state::ready) {
+                return 0;
+            }
+            return (uint32_t)this->m_lod_errors.size();
+        }
+        float model::get_lod_error(uint32_t lod) const {
+            if (this->m_load_state != load_state::ready || this->m_lod_errors.empty()) {
+                return 0.f;
+            }
+            return this->m_lod_errors[std::min((size_t)lod, this->m_lod_errors.size() - 1)];
+        }
+        void model::draw(const std::vector<glm::mat4>& palette, uint32_t lod) {
+            if (this->m_load_state != load_state::ready) {
+                return;
+            }
             if (!this->m_shader) {
                 spdlog::warn("Model shader not found; make sure to set \"model-" + std::string(this->m_is_animated ? "animated" : "static") +  "\" in the shader library");
                 return;
             }
             this->m_shader->bind();
             if (this->m_is_animated) {
-                float time = 0.f;
-                if (animation_index != -1) {
-                    const aiAnimation* animation = this->m_scene->mAnimations[animation_index];
-                    float ticks_per_second = static_cast<float>(animation->mTicksPerSecond != 0.0 ? animation->mTicksPerSecond : 25.0);
-                    float time_in_ticks = animation_time * ticks_per_second;
-                    time = fmod(time_in_ticks, (float)animation->mDuration);
+                const std::vector<glm::mat4>* matrices = &palette;
+                std::vector<glm::mat4> bind_pose;
+                if (palette.empty()) {
+                    this->compute_bone_palette(-1, 0.f, bind_pose);
+                    matrices = &bind_pose;
                 }
-                // todo: calculate bones only once per entity per frame
-                this->bone_transform(time, animation_index);
-                for (size_t i = 0; i < this->m_bone_info.size(); i++) {
-                    std::string uniform_name = "bones[" + std::to_string(i) + "]";
-                    glm::mat4 matrix = this->m_bone_transforms[i];
-                    this->m_shader->uniform_mat4(uniform_name, matrix);
+                if (this->m_bone_palette_uniform.is_valid()) {
+                    if (!this->m_palette_buffer) {
+                        this->m_palette_buffer = ref<texture_buffer>::create();
+                    }
+                    this->m_palette_buffer->set_data(*matrices);
+                    this->bind_palette(this->m_palette_buffer, 0);
+                } else {
+                    // shaders without a palette buffer declare "bones" as a uniform array
+                    this->m_shader->uniform_mat4_array(this->m_bones_uniform, matrices->data(), matrices->size());
+                }
+            }
+            this->draw_meshes(lod);
+        }
+        void model::draw(ref<texture_buffer> palette, uint32_t offset, uint32_t lod, const std::vector<glm::mat4>* matrices) {
+            if (this->m_load_state != load_state::ready) {
+                return;
+            }
+            if (!this->m_shader) {
+                spdlog::warn("Model shader not found; make sure to set \"model-" + std::string(this->m_is_animated ? "animated" : "static") +  "\" in the shader library");
+                return;
+            }
+            this->m_shader->bind();
+            if (this->m_is_animated) {
+                if (this->m_bone_palette_uniform.is_valid()) {
+                    this->bind_palette(palette, offset);
+                } else if (matrices && !matrices->empty()) {
+                    this->m_shader->uniform_mat4_array(this->m_bones_uniform, matrices->data(), matrices->size());
                 }
             }
+            this->draw_meshes(lod);
+        }
+        float model::get_animation_ticks(int32_t animation_index, float animation_time) const {
+            if (animation_index < 0 || (size_t)animation_index >= this->m_animations.size()) {
+                return 0.f;
+            }
+            const auto& animation = this->m_animations[(size_t)animation_index];
+            if (animation.duration <= 0.f) {
+                return 0.f;
+            }
+            return fmod(animation_time * animation.ticks_per_second, animation.duration);
+        }
+        void model::bind_palette(ref<texture_buffer> palette, uint32_t offset) {
+            palette->bind(bone_palette_slot);
+            this->m_shader->uniform_int(this->m_bone_palette_uniform, (GLint)bone_palette_slot);
+            this->m_shader->uniform_int(this->m_bone_offset_uniform, (GLint)offset);
+        }
+        void model::draw_meshes(uint32_t lod) {
+            this->m_shader->uniform_int(this->m_octahedral_normals_uniform, this->m_vertex_format.normals == normal_encoding::octahedral ? 1 : 0);
             for (auto& mesh : this->m_meshes) {
-                auto vao = mesh.get_vao();
-                vao->bind();
-                mesh.get_ebo()->draw(GL_TRIANGLES);
-                vao->unbind();
+                this->m_shader->uniform_vec3(this->m_position_offset_uniform, mesh.get_position_offset());
+                this->m_shader->uniform_vec3(this->m_position_scale_uniform, mesh.get_position_scale());
+                mesh.get_vao()->bind();
+                const auto& lods = mesh.get_lods();
+                if (lods.empty()) {
+                    mesh.get_ebo()->draw(GL_TRIANGLES);
+                } else {
+                    const auto& level = lods[std::min((size_t)lod, lods.size() - 1)];
+                    mesh.get_ebo()->draw_range(GL_TRIANGLES, (size_t)level.index_offset, (size_t)level.index_count);
+                }
             }
+            // unbind once rather than after every mesh
+            state_tracker::get().bind_vertex_array(0);
         }
-        void model::bone_transform(float time, int32_t animation_index) {
-            this->read_node_hierarchy(time, this->m_scene->mRootNode, glm::mat4(1.f), animation_index);
-            this->m_bone_transforms.resize(this->m_bone_count);
-            for (size_t i = 0; i < (size_t)this->m_bone_count; i++) {
-                this->m_bone_transforms[i] = this->m_bone_info[i].final_transform;
+        void model::load_skeleton(const aiScene* scene, const std::unordered_map<std::string, uint32_t>& bone_map, bool bake, float sample_rate) {
+            // depth first, so that every parent comes before its children
+            std::unordered_map<std::string, uint32_t> joint_map;
+            std::vector<std::pair<const aiNode*, int32_t>> stack = { { scene->mRootNode, -1 } };
+            while (!stack.empty()) {
+                auto [node, parent] = stack.back();
+                stack.pop_back();
+                std::string name = std::string(node->mName.C_Str());
+                joint j;
+                j.parent = parent;
+                j.local_transform = from_assimp_matrix(node->mTransformation);
+                auto it = bone_map.find(name);
+                j.bone = it != bone_map.end() ? (int32_t)it->second : -1;
+                int32_t index = (int32_t)this->m_joints.size();
+                this->m_joints.push_back(j);
+                joint_map.insert({ name, (uint32_t)index });
+                for (uint32_t i = node->mNumChildren; i > 0; i--) {
+                    stack.push_back({ node->mChildren[i - 1], index });
+                }
+            }
+            this->m_animations.resize((size_t)scene->mNumAnimations);
+            for (uint32_t i = 0; i < scene->mNumAnimations; i++) {
+                const aiAnimation* source = scene->mAnimations[i];
+                auto& animation = this->m_animations[i];
+                animation.name = std::string(source->mName.C_Str());
+                animation.duration = (float)source->mDuration;
+                animation.ticks_per_second = (float)(source->mTicksPerSecond != 0.0 ? source->mTicksPerSecond : 25.0);
+                animation.joint_channels.resize(this->m_joints.size(), -1);
+                for (uint32_t c = 0; c < source->mNumChannels; c++) {
+                    const aiNodeAnim* node_animation = source->mChannels[c];
+                    auto it = joint_map.find(std::string(node_animation->mNodeName.C_Str()));
+                    if (it == joint_map.end()) {
+                        continue;
+                    }
+                    animation.joint_channels[it->second] = (int32_t)animation.channels.size();
+                    auto& channel = animation.channels.emplace_back();
+                    for (uint32_t k = 0; k < node_animation->mNumPositionKeys; k++) {
+                        const auto& key = node_animation->mPositionKeys[k];
+                        channel.positions.push_back({ (float)key.mTime, from_assimp_vector<3>(key.mValue) });
+                    }
+                    for (uint32_t k = 0; k < node_animation->mNumRotationKeys; k++) {
+                        const auto& key = node_animation->mRotationKeys[k];
+                        channel.rotations.push_back({ (float)key.mTime, from_assimp_quaternion(key.mValue) });
+                    }
+                    for (uint32_t k = 0; k < node_animation->mNumScalingKeys; k++) {
+                        const auto& key = node_animation->mScalingKeys[k];
+                        channel.scales.push_back({ (float)key.mTime, from_assimp_vector<3>(key.mValue) });
+                    }
+                }
+                if (bake && !animation.channels.empty()) {
+                    animation.baked = baked_animation::bake(animation.channels.size(), animation.duration, sample_rate / animation.ticks_per_second, [&](size_t channel, float time) {
+                        const auto& c = animation.channels[channel];
+                        return baked_animation::sample{ interpolate_translation(time, c, nullptr), interpolate_rotation(time, c, nullptr), interpolate_scale(time, c, nullptr) };
+                    });
+                    // the keys are no longer needed
+                    animation.channels.clear();
+                    animation.channels.shrink_to_fit();
+                    animation.is_baked = true;
+                }
             }
         }
-        void model::read_node_hierarchy(float animation_time, const aiNode* node, const glm::mat4& parent_transform, int32_t animation_index) {
-            std::string name = std::string(node->mName.C_Str());
-            const aiAnimation* animation = nullptr;
-            if (animation_index != -1) {
-                animation = this->m_scene->mAnimations[animation_index];
+        void model::evaluate_pose(float time, int32_t animation_index, std::vector<glm::mat4>& palette, animation_cursor* cursor) const {
+            const animation* current_animation = nullptr;
+            const baked_animation::sample* baked_samples = nullptr;
+            if (animation_index >= 0 && (size_t)animation_index < this->m_animations.size()) {
+                current_animation = &this->m_animations[(size_t)animation_index];
+                if (current_animation->is_baked) {
+                    // baked clips are sampled at a fixed rate, so there are no keys to search for
+                    thread_local std::vector<baked_animation::sample> samples;
+                    samples.resize(current_animation->baked.get_channel_count());
+                    current_animation->baked.evaluate(time, samples.data());
+                    baked_samples = samples.data();
+                } else if (cursor && (cursor->animation != animation_index || cursor->keys.size() != current_animation->channels.size() * 3)) {
+                    cursor->animation = animation_index;
+                    cursor->keys.assign(current_animation->channels.size() * 3, 0);
+                }
+            }
+            // per thread, so that several entities can be posed at once
+            thread_local std::vector<glm::mat4> global_transforms;
+            global_transforms.resize(this->m_joints.size());
+            palette.resize(this->m_bone_offsets.size(), glm::mat4(1.f));
+            for (size_t i = 0; i < this->m_joints.size(); i++) {
+                const joint& j = this->m_joints[i];
+                glm::mat4 local_transform = j.local_transform;
+                if (current_animation && current_animation->joint_channels[i] != -1) {
+                    size_t channel_index = (size_t)current_animation->joint_channels[i];
+                    glm::vec3 translation, scale;
+                    glm::quat rotation;
+                    if (baked_samples) {
+                        const auto& s = baked_samples[channel_index];
+                        translation = s.translation;
+                        rotation = s.rotation;
+                        scale = s.scale;
+                    } else {
+                        const auto& channel = current_animation->channels[channel_index];
+                        uint32_t* keys = cursor ? &cursor->keys[channel_index * 3] : nullptr;
+                        translation = interpolate_translation(time, channel, keys ? &keys[0] : nullptr);
+                        rotation = interpolate_rotation(time, channel, keys ? &keys[1] : nullptr);
+                        scale = interpolate_scale(time, channel, keys ? &keys[2] : nullptr);
+                    }
+                    local_transform = glm::translate(glm::mat4(1.f), translation) * glm::toMat4(rotation) * glm::scale(glm::mat4(1.f), scale);
+                }
+                glm::mat4 global_transform = j.parent < 0 ? local_transform : global_transforms[(size_t)j.parent] * local_transform;
+                global_transforms[i] = global_transform;
+                if (j.bone >= 0) {
+                    palette[(size_t)j.bone] = this->m_inverse_transform * global_transform * this->m_bone_offsets[(size_t)j.bone];
+                }
+            }
+        }
+        glm::vec3 model::interpolate_translation(float animation_time, const channel& c, uint32_t* cursor) {
+            if (c.positions.empty()) {
+                return glm::vec3(0.f);
             }
-            glm::mat4 node_transform = from_assimp_matrix(node->mTransformation);
-            const aiNodeAnim* node_animation = nullptr;
-            if (animation) {
-                node_animation = this->find_node_animation(animation, name);
+            if (c.positions.size() == 1) {
+                return c.positions[0].value;
             }
-            if (node_animation) {
-                glm::vec3 translation = this->interpolate_translation(animation_time, node_animation);
-                glm::mat4 translation_matrix = glm::translate(glm::mat4(1.f), translation);
-                glm::quat rotation = this->interpolate_rotation(animation_time, node_animation);
-                glm::mat4 rotation_matrix = glm::toMat4(rotation);
-                glm::vec3 scale = this->interpolate_scale(animation_time, node_animation);
-                glm::mat4 scale_matrix = glm::scale(glm::mat4(1.f), scale);
-                node_transform = translation_matrix * rotation_matrix * scale_matrix;
-            }
-            glm::mat4 transform = parent_transform * node_transform;
-            if (this->m_bone_map.find(name) != this->m_bone_map.end()) {
-                uint32_t bone_index = this->m_bone_map[name];
-                bone_info& bi = this->m_bone_info[(size_t)bone_index];
-                bi.final_transform = this->m_inverse_transform * transform * bi.bone_offset;
-            }
-            for (uint32_t i = 0; i < node->mNumChildren; i++) {
-                this->read_node_hierarchy(animation_time, node->mChildren[i], transform, animation_index);
-            }
-        }
-        void model::traverse_nodes(aiNode* node, const glm::mat4& parent_transform, uint32_t level) {
-            glm::mat4 transform = parent_transform * from_assimp_matrix(node->mTransformation);
-            this->m_node_map[node].resize(node->mNumMeshes);
-            for (uint32_t i = 0; i < node->mNumMeshes; i++) {
-                uint32_t mesh = node->mMeshes[i];
-                // todo: something about node names
-                this->m_node_map[node][i] = mesh;
-            }
-            for (uint32_t i = 0; i < node->mNumChildren; i++) {
-                this->traverse_nodes(node->mChildren[i], transform, level + 1);
-            }
-        }
-        const aiNodeAnim* model::find_node_animation(const aiAnimation* animation, const std::string& node_name) {
-            for (uint32_t i = 0; i < animation->mNumChannels; i++) {
-                const aiNodeAnim* node_animation = animation->mChannels[i];
-                if (std::string(node_animation->mNodeName.C_Str()) == node_name) {
-                    return node_animation;
-                }
-            }
-            return nullptr;
-        }
-        uint32_t model::find_position(float animation_time, const aiNodeAnim* node_animation) {
-            for (uint32_t i = 0; i < node_animation->mNumPositionKeys - 1; i++) {
-                if (animation_time < (float)node_animation->mPositionKeys[i + 1].mTime) {
-                    return i;
-                }
-            }
-            return 0;
-        }
-        uint32_t model::find_rotation(float animation_time, const aiNodeAnim* node_animation) {
-            for (uint32_t i = 0; i < node_animation->mNumRotationKeys - 1; i++) {
-                if (animation_time < (float)node_animation->mRotationKeys[i + 1].mTime) {
-                    return i;
-                }
-            }
-            return 0;
-        }
-        uint32_t model::find_scale(float animation_time, const aiNodeAnim* node_animation) {
-            for (uint32_t i = 0; i < node_animation->mNumScalingKeys - 1; i++) {
-                if (animation_time < (float)node_animation->mScalingKeys[i + 1].mTime) {
-                    return i;
-                }
-            }
-            return 0;
-        }
-        glm::vec3 model::interpolate_translation(float animation_time, const aiNodeAnim* node_animation) {
-            if (node_animation->mNumPositionKeys <= 1) {
-                return from_assimp_vector<3>(node_animation->mPositionKeys[0].mValue);
-            }
-            uint32_t position_index = this->find_position(animation_time, node_animation);
-            uint32_t next_position_index = position_index + 1;
-            float delta_time = (float)(node_animation->mPositionKeys[next_position_index].mTime - node_animation->mPositionKeys[position_index].mTime);
-            float factor = (delta_time - (float)node_animation->mPositionKeys[position_index].mTime) / delta_time;
-            if (factor > 1.f) {
-                throw std::runtime_error("Factor must be below 1!");
-            }
-            factor = glm::clamp(factor, 0.f, 1.f);
-            const auto& start = node_animation->mPositionKeys[position_index].mValue;
-            const auto& end = node_animation->mPositionKeys[next_position_index].mValue;
-            auto delta = end - start;
-            return from_assimp_vector<3>(start + factor * delta);
+            size_t index = find_key(c.positions, animation_time, cursor);
+            if (index + 1 >= c.positions.size()) {
+                return c.positions.back().value;
+            }
+            float factor = get_interpolation_factor(c.positions, index, animation_time);
+            return glm::mix(c.positions[index].value, c.positions[index + 1].value, factor);
         }
-        glm::quat model::interpolate_rotation(float animation_time, const aiNodeAnim* node_animation) {
-            if (node_animation->mNumRotationKeys <= 1) {
-                return from_assimp_quaternion(node_animation->mRotationKeys[0].mValue);
-            }
-            uint32_t rotation_index = this->find_rotation(animation_time, node_animation);
-            uint32_t next_rotation_index = rotation_index + 1;
-            float delta_time = (float)(node_animation->mRotationKeys[next_rotation_index].mTime - node_animation->mRotationKeys[rotation_index].mTime);
-            float factor = (delta_time - (float)node_animation->mRotationKeys[rotation_index].mTime) / delta_time;
-            if (factor > 1.f) {
-                throw std::runtime_error("Factor must be below 1!");
-            }
-            factor = glm::clamp(factor, 0.f, 1.f);
-            const auto& start = node_animation->mRotationKeys[rotation_index].mValue;
-            const auto& end = node_animation->mRotationKeys[next_rotation_index].mValue;
-            aiQuaternion q;
-            aiQuaternion::Interpolate(q, start, end, factor);
-            return from_assimp_quaternion(q.Normalize());
-        }
-        glm::vec3 model::interpolate_scale(float animation_time, const aiNodeAnim* node_animation) {
-            if (node_animation->mNumScalingKeys <= 1) {
-                return from_assimp_vector<3>(node_animation->mScalingKeys[0].mValue);
-            }
-            uint32_t scale_index = this->find_scale(animation_time, node_animation);
-            uint32_t next_scale_index = scale_index + 1;
-            float delta_time = (float)(node_animation->mScalingKeys[next_scale_index].mTime - node_animation->mScalingKeys[scale_index].mTime);
-            float factor = (delta_time - (float)node_animation->mScalingKeys[scale_index].mTime) / delta_time;
-            if (factor > 1.f) {
-                throw std::runtime_error("Factor must be below 1!");
+        glm::quat model::interpolate_rotation(float animation_time, const channel& c, uint32_t* cursor) {
+            if (c.rotations.empty()) {
+                return glm::quat(1.f, 0.f, 0.f, 0.f);
+            }
+            if (c.rotations.size() == 1) {
+                return c.rotations[0].value;
+            }
+            size_t index = find_key(c.rotations, animation_time, cursor);
+            if (index + 1 >= c.rotations.size()) {
+                return c.rotations.back().value;
+            }
+            float factor = get_interpolation_factor(c.rotations, index, animation_time);
+            return glm::normalize(glm::slerp(c.rotations[index].value, c.rotations[index + 1].value, factor));
+        }
+        glm::vec3 model::interpolate_scale(float animation_time, const channel& c, uint32_t* cursor) {
+            if (c.scales.empty()) {
+                return glm::vec3(1.f);
+            }
+            if (c.scales.size() == 1) {
+                return c.scales[0].value;
+            }
+            size_t index = find_key(c.scales, animation_time, cursor);
+            if (index + 1 >= c.scales.size()) {
+                return c.scales.back().value;
             }
-            factor = glm::clamp(factor, 0.f, 1.f);
-            const auto& start = node_animation->mScalingKeys[scale_index].mValue;
-            const auto& end = node_animation->mScalingKeys[next_scale_index].mValue;
-            auto delta = end - start;
-            return from_assimp_vector<3>(start + factor * delta);
+            float factor = get_interpolation_factor(c.scales, index, animation_time);
+            return glm::mix(c.scales[index].value, c.scales[index + 1].value, factor);
         }
     }
 }
\ No newline at end of file
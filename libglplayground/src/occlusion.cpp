@@ -0,0 +1,216 @@
+#include "libglppch.h"
+#include "occlusion.h"
+#if defined(__AVX__)
+#define LIBGLPLAYGROUND_AVX
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define LIBGLPLAYGROUND_SSE
+#include <xmmintrin.h>
+#endif
+namespace libplayground {
+    namespace gl {
+        // triangles with a vertex closer than this (in clip space w) are not rasterized
+        constexpr float occluder_near_w = 1e-3f;
+        // boxes are tested on the first level where they cover at most this many texels across
+        constexpr uint32_t max_test_texels = 4;
+        occlusion_buffer::occlusion_buffer(uint32_t width, uint32_t height) {
+            this->m_view_projection = glm::mat4(1.f);
+            this->m_simd_enabled = true;
+            width = std::max((width + 7) & ~(uint32_t)7, (uint32_t)8);
+            height = std::max(height, (uint32_t)1);
+            // each level keeps the farthest depth of the (up to) 2x2 texels below it
+            while (true) {
+                level l;
+                l.width = width;
+                l.height = height;
+                l.depth.assign((size_t)width * (size_t)height, 1.f);
+                this->m_levels.push_back(std::move(l));
+                if (width == 1 && height == 1) {
+                    break;
+                }
+                width = std::max((width + 1) / 2, (uint32_t)1);
+                height = std::max((height + 1) / 2, (uint32_t)1);
+            }
+        }
+        void occlusion_buffer::begin(const glm::mat4& view_projection) {
+            this->m_view_projection = view_projection;
+            for (auto& l : this->m_levels) {
+                std::fill(l.depth.begin(), l.depth.end(), 1.f);
+            }
+        }
+        void occlusion_buffer::add_occluder(const glm::vec3* positions, size_t position_stride, const uint32_t* indices, size_t index_count, const glm::mat4& transform) {
+            glm::mat4 matrix = this->m_view_projection * transform;
+            const auto& base = this->m_levels[0];
+            auto to_screen = [&](uint32_t index, glm::vec3& result) {
+                glm::vec3 position;
+                memcpy(&position, (const uint8_t*)positions + (size_t)index * position_stride, sizeof(glm::vec3));
+                glm::vec4 clip = matrix * glm::vec4(position, 1.f);
+                if (clip.w < occluder_near_w) {
+                    return false;
+                }
+                glm::vec3 ndc = glm::vec3(clip) / clip.w;
+                result.x = (ndc.x * 0.5f + 0.5f) * (float)base.width;
+                result.y = (ndc.y * 0.5f + 0.5f) * (float)base.height;
+                result.z = ndc.z * 0.5f + 0.5f;
+                return true;
+            };
+            for (size_t i = 0; i + 3 <= index_count; i += 3) {
+                glm::vec3 a, b, c;
+                if (to_screen(indices[i], a) && to_screen(indices[i + 1], b) && to_screen(indices[i + 2], c)) {
+                    this->rasterize_triangle(a, b, c);
+                }
+            }
+        }
+        void occlusion_buffer::rasterize_triangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+            auto& base = this->m_levels[0];
+            float min_x = std::min(a.x, std::min(b.x, c.x)), max_x = std::max(a.x, std::max(b.x, c.x));
+            float min_y = std::min(a.y, std::min(b.y, c.y)), max_y = std::max(a.y, std::max(b.y, c.y));
+            if (max_x < 0.f || max_y < 0.f || min_x >= (float)base.width || min_y >= (float)base.height) {
+                return;
+            }
+            // e(x, y) = ex * x + (ey * y + ec); positive on the inside once oriented
+            float e0x = a.y - b.y, e0y = b.x - a.x, e0c = a.x * b.y - b.x * a.y;
+            float e1x = b.y - c.y, e1y = c.x - b.x, e1c = b.x * c.y - c.x * b.y;
+            float e2x = c.y - a.y, e2y = a.x - c.x, e2c = c.x * a.y - a.x * c.y;
+            float area = e0x * c.x + (e0y * c.y + e0c);
+            if (area == 0.f) {
+                return;
+            }
+            if (area < 0.f) {
+                // both windings are occluders
+                e0x = -e0x; e0y = -e0y; e0c = -e0c;
+                e1x = -e1x; e1y = -e1y; e1c = -e1c;
+                e2x = -e2x; e2y = -e2y; e2c = -e2c;
+                area = -area;
+            }
+            // depth is linear in screen space: z = zx * x + (zy * y + zc)
+            float inverse_area = 1.f / area;
+            float zx = (e1x * a.z + e2x * b.z + e0x * c.z) * inverse_area;
+            float zy = (e1y * a.z + e2y * b.z + e0y * c.z) * inverse_area;
+            float zc = (e1c * a.z + e2c * b.z + e0c * c.z) * inverse_area;
+            uint32_t x0 = (uint32_t)std::max(min_x, 0.f), x1 = (uint32_t)std::min(max_x, (float)(base.width - 1));
+            uint32_t y0 = (uint32_t)std::max(min_y, 0.f), y1 = (uint32_t)std::min(max_y, (float)(base.height - 1));
+            for (uint32_t y = y0; y <= y1; y++) {
+                float py = (float)y + 0.5f;
+                float r0 = e0y * py + e0c, r1 = e1y * py + e1c, r2 = e2y * py + e2c, rz = zy * py + zc;
+                float* row = base.depth.data() + (size_t)y * base.width;
+                uint32_t x = x0;
+#if defined(LIBGLPLAYGROUND_AVX)
+                if (this->m_simd_enabled) {
+                    __m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+                    x &= ~(uint32_t)7;
+                    for (; x <= x1; x += 8) {
+                        __m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), offsets);
+                        __m256 w0 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(e0x), px), _mm256_set1_ps(r0));
+                        __m256 w1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(e1x), px), _mm256_set1_ps(r1));
+                        __m256 w2 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(e2x), px), _mm256_set1_ps(r2));
+                        __m256 z = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(zx), px), _mm256_set1_ps(rz));
+                        __m256 zero = _mm256_setzero_ps();
+                        __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(w0, zero, _CMP_GE_OQ), _mm256_cmp_ps(w1, zero, _CMP_GE_OQ)), _mm256_cmp_ps(w2, zero, _CMP_GE_OQ));
+                        __m256 old = _mm256_loadu_ps(row + x);
+                        __m256 candidate = _mm256_or_ps(_mm256_and_ps(inside, z), _mm256_andnot_ps(inside, old));
+                        _mm256_storeu_ps(row + x, _mm256_min_ps(old, candidate));
+                    }
+                }
+#elif defined(LIBGLPLAYGROUND_SSE)
+                if (this->m_simd_enabled) {
+                    __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                    x &= ~(uint32_t)3;
+                    for (; x <= x1; x += 4) {
+                        __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                        __m128 w0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e0x), px), _mm_set1_ps(r0));
+                        __m128 w1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e1x), px), _mm_set1_ps(r1));
+                        __m128 w2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e2x), px), _mm_set1_ps(r2));
+                        __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zx), px), _mm_set1_ps(rz));
+                        __m128 zero = _mm_setzero_ps();
+                        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)), _mm_cmpge_ps(w2, zero));
+                        __m128 old = _mm_loadu_ps(row + x);
+                        __m128 candidate = _mm_or_ps(_mm_and_ps(inside, z), _mm_andnot_ps(inside, old));
+                        _mm_storeu_ps(row + x, _mm_min_ps(old, candidate));
+                    }
+                }
+#endif
+                for (; x <= x1; x++) {
+                    float px = (float)x + 0.5f;
+                    float w0 = e0x * px + r0, w1 = e1x * px + r1, w2 = e2x * px + r2;
+                    if (w0 >= 0.f && w1 >= 0.f && w2 >= 0.f) {
+                        row[x] = std::min(row[x], zx * px + rz);
+                    }
+                }
+            }
+        }
+        void occlusion_buffer::finish() {
+            for (size_t i = 1; i < this->m_levels.size(); i++) {
+                const auto& source = this->m_levels[i - 1];
+                auto& destination = this->m_levels[i];
+                for (uint32_t y = 0; y < destination.height; y++) {
+                    uint32_t sy0 = y * 2, sy1 = std::min(y * 2 + 1, source.height - 1);
+                    for (uint32_t x = 0; x < destination.width; x++) {
+                        uint32_t sx0 = x * 2, sx1 = std::min(x * 2 + 1, source.width - 1);
+                        float farthest = std::max(std::max(source.depth[(size_t)sy0 * source.width + sx0], source.depth[(size_t)sy0 * source.width + sx1]),
+                            std::max(source.depth[(size_t)sy1 * source.width + sx0], source.depth[(size_t)sy1 * source.width + sx1]));
+                        destination.depth[(size_t)y * destination.width + x] = farthest;
+                    }
+                }
+            }
+        }
+        bool occlusion_buffer::is_visible(const aabb& box) const {
+            if (!box.is_valid()) {
+                return true;
+            }
+            const auto& base = this->m_levels[0];
+            float min_x = std::numeric_limits<float>::max(), min_y = min_x, nearest = min_x;
+            float max_x = -min_x, max_y = -min_x;
+            for (uint32_t i = 0; i < 8; i++) {
+                glm::vec3 corner = glm::vec3(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z);
+                glm::vec4 clip = this->m_view_projection * glm::vec4(corner, 1.f);
+                if (clip.w < occluder_near_w) {
+                    // reaches behind the camera
+                    return true;
+                }
+                glm::vec3 ndc = glm::vec3(clip) / clip.w;
+                float x = (ndc.x * 0.5f + 0.5f) * (float)base.width, y = (ndc.y * 0.5f + 0.5f) * (float)base.height;
+                min_x = std::min(min_x, x); max_x = std::max(max_x, x);
+                min_y = std::min(min_y, y); max_y = std::max(max_y, y);
+                nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+            }
+            if (max_x < 0.f || max_y < 0.f || min_x >= (float)base.width || min_y >= (float)base.height) {
+                return false;
+            }
+            uint32_t x0 = (uint32_t)std::max(min_x, 0.f), x1 = (uint32_t)std::min(max_x, (float)(base.width - 1));
+            uint32_t y0 = (uint32_t)std::max(min_y, 0.f), y1 = (uint32_t)std::min(max_y, (float)(base.height - 1));
+            size_t level_index = 0;
+            while (level_index + 1 < this->m_levels.size() && std::max(x1 - x0, y1 - y0) + 1 > max_test_texels) {
+                x0 /= 2; x1 /= 2; y0 /= 2; y1 /= 2;
+                level_index++;
+            }
+            const auto& l = this->m_levels[level_index];
+            for (uint32_t y = y0; y <= y1; y++) {
+                for (uint32_t x = x0; x <= x1; x++) {
+                    if (nearest <= l.depth[(size_t)y * l.width + x]) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+        void occlusion_buffer::set_simd_enabled(bool enabled) {
+            this->m_simd_enabled = enabled;
+        }
+        bool occlusion_buffer::is_simd_enabled() const {
+            return this->m_simd_enabled;
+        }
+        uint32_t occlusion_buffer::get_width() const {
+            return this->m_levels[0].width;
+        }
+        uint32_t occlusion_buffer::get_height() const {
+            return this->m_levels[0].height;
+        }
+        uint32_t occlusion_buffer::get_level_count() const {
+            return (uint32_t)this->m_levels.size();
+        }
+        const std::vector<float>& occlusion_buffer::get_depth(uint32_t level) const {
+            return this->m_levels[level].depth;
+        }
+    }
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "libglppch.h"
 #include "renderer.h"
 #include "shader_library.h"
+#include "state_tracker.h"
 namespace libplayground {
     namespace gl {
         static std::vector<vertex_attribute> attributes = {
@@ -8,9 +9,144 @@ namespace libplayground {
             { GL_FLOAT, 3, sizeof(vertex), offsetof(vertex, normal), false },
             { GL_FLOAT, 2, sizeof(vertex), offsetof(vertex, uv), false }
         };
+        // the texture layer follows the per-instance model matrix (3 through 6)
+        constexpr uint32_t layer_attribute = 7;
+        // resident meshes that have not been submitted for this many frames are released
+        constexpr uint64_t max_unused_frames = 300;
+        static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+            // fnv-1a
+            const uint8_t* bytes = (const uint8_t*)data;
+            for (size_t i = 0; i < size; i++) {
+                hash ^= (uint64_t)bytes[i];
+                hash *= 0x100000001b3ull;
+            }
+            return hash;
+        }
+        static uint64_t hash_geometry(const std::vector<vertex>& vertices, const std::vector<uint32_t>& indices) {
+            uint64_t hash = 0xcbf29ce484222325ull;
+            size_t counts[] = { vertices.size(), indices.size() };
+            hash = hash_bytes(hash, counts, sizeof(counts));
+            hash = hash_bytes(hash, vertices.data(), vertices.size() * sizeof(vertex));
+            hash = hash_bytes(hash, indices.data(), indices.size() * sizeof(uint32_t));
+            return hash != 0 ? hash : 1;
+        }
+        static bool same_textures(const std::vector<texture_descriptor>& lhs, const std::vector<texture_descriptor>& rhs) {
+            if (lhs.size() != rhs.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < lhs.size(); i++) {
+                if (lhs[i].data != rhs[i].data || lhs[i].uniform_name != rhs[i].uniform_name) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        static uint32_t get_layer(const std::vector<texture_descriptor>& textures) {
+            return textures.empty() ? 0 : textures[0].layer;
+        }
+        template<typename T> static void radix_sort(std::vector<T>& items, std::vector<T>& scratch) {
+            if (items.empty()) {
+                return;
+            }
+            scratch.resize(items.size());
+            for (uint32_t shift = 0; shift < 64; shift += 8) {
+                size_t counts[256] = { 0 };
+                for (const auto& item : items) {
+                    counts[(item.key >> shift) & 0xff]++;
+                }
+                // every key has the same byte here; this pass would not move anything
+                if (counts[(items[0].key >> shift) & 0xff] == items.size()) {
+                    continue;
+                }
+                size_t offsets[256];
+                size_t offset = 0;
+                for (size_t i = 0; i < 256; i++) {
+                    offsets[i] = offset;
+                    offset += counts[i];
+                }
+                for (const auto& item : items) {
+                    scratch[offsets[(item.key >> shift) & 0xff]++] = item;
+                }
+                items.swap(scratch);
+            }
+        }
+        static void bind_textures(ref<shader> current_shader, const std::vector<texture_descriptor>& textures) {
+            for (size_t i = 0; i < textures.size(); i++) {
+                auto& desc = textures[i];
+                desc.data->bind((uint32_t)i);
+                if (current_shader && !desc.uniform_name.empty()) {
+                    current_shader->uniform_int(desc.uniform_name, (GLint)i);
+                }
+            }
+        }
+        shared_geometry::shared_geometry(const std::vector<vertex>& vertices, const std::vector<uint32_t>& indices) {
+            this->m_vertices = vertices;
+            this->m_indices = indices;
+            this->m_bounds = aabb::from_vertices(this->m_vertices);
+        }
+        void shared_geometry::set_data(const std::vector<vertex>& vertices, const std::vector<uint32_t>& indices) {
+            this->m_vertices = vertices;
+            this->m_indices = indices;
+            this->m_bounds = aabb::from_vertices(this->m_vertices);
+            this->m_version++;
+        }
+        const std::vector<vertex>& shared_geometry::get_vertices() const {
+            return this->m_vertices;
+        }
+        const std::vector<uint32_t>& shared_geometry::get_indices() const {
+            return this->m_indices;
+        }
+        uint32_t shared_geometry::get_version() const {
+            return this->m_version;
+        }
+        const aabb& shared_geometry::get_bounds() const {
+            return this->m_bounds;
+        }
         void renderer::reset() {
             this->m_models.clear();
             this->m_meshes.clear();
+            this->m_frame++;
+            for (auto it = this->m_mesh_cache.begin(); it != this->m_mesh_cache.end();) {
+                if (this->m_frame - it->second.last_used_frame > max_unused_frames) {
+                    this->release_mesh_contents(it->second);
+                    it = this->m_mesh_cache.erase(it);
+                } else {
+                    it++;
+                }
+            }
+            for (auto it = this->m_geometry_cache.begin(); it != this->m_geometry_cache.end();) {
+                if (this->m_frame - it->second.last_used_frame > max_unused_frames) {
+                    it = this->m_geometry_cache.erase(it);
+                } else {
+                    it++;
+                }
+            }
+            this->m_static_submissions = 0;
+            this->m_statistics = statistics();
+        }
+        void renderer::set_camera(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& position, const glm::vec4& viewport) {
+            camera_data data;
+            data.projection = projection;
+            data.view = view;
+            data.view_projection = projection * view;
+            data.position = glm::vec4(position, 1.f);
+            data.viewport = viewport;
+            if (!this->m_camera_buffer) {
+                this->m_camera_buffer = ref<uniform_buffer_object>::create(sizeof(camera_data), (uint32_t)uniform_buffer_binding::camera);
+            }
+            this->m_camera_buffer->set_data(data);
+            this->m_camera_buffer->bind_base();
+            // shaders that do not declare the block still get their matrices the old way
+            for (const auto& pair : shader_library::get()) {
+                if (!pair.second->uses_camera_buffer()) {
+                    pair.second->bind();
+                    pair.second->uniform_mat4("projection", projection);
+                    pair.second->uniform_mat4("view", view);
+                }
+            }
+            this->m_camera_position = position;
+            this->m_frustum = frustum::from_matrix(data.view_projection);
+            this->m_has_camera = true;
         }
         void renderer::submit(const mesh& m) {
             assembled_mesh assembled;
@@ -20,40 +156,487 @@ namespace libplayground {
             assembled.ebo = ref<element_buffer_object>::create(m.indices);
             assembled.vao->add_vertex_attributes(attributes);
             assembled.textures = m.textures;
+            assembled.is_transparent = m.is_transparent;
+            this->m_statistics.buffer_allocations += 2;
             this->m_meshes.push_back(assembled);
         }
+        void renderer::submit(const cached_mesh_descriptor& desc) {
+            if (desc.is_static && !desc.is_transparent && this->m_static_batching) {
+                this->submit_static(desc);
+                return;
+            }
+            resident_mesh* resident;
+            if (desc.geometry) {
+                auto it = this->m_geometry_cache.find(desc.geometry);
+                bool is_new = it == this->m_geometry_cache.end();
+                if (is_new) {
+                    it = this->m_geometry_cache.insert({ desc.geometry, resident_mesh() }).first;
+                    it->second.geometry = ref<shared_geometry>(desc.geometry);
+                    // every user of the geometry draws the same buffers
+                    it->second.instance_key = desc.geometry;
+                }
+                uint32_t version = desc.geometry->get_version();
+                this->make_resident(it->second, is_new, desc.geometry->get_vertices(), desc.geometry->get_indices(), version, version);
+                resident = &it->second;
+            } else {
+                auto it = this->m_mesh_cache.find(desc.key);
+                bool is_new = it == this->m_mesh_cache.end();
+                if (is_new) {
+                    it = this->m_mesh_cache.insert({ desc.key, resident_mesh() }).first;
+                }
+                resident = &it->second;
+                bool reallocate = false;
+                if (!is_new && (resident->vertex_version != desc.vertex_version || resident->index_version != desc.index_version)) {
+                    // contents that change are not worth comparing every time they do
+                    // buffers that other meshes still compare against are left to them, and new ones are made
+                    reallocate = this->release_mesh_contents(*resident);
+                }
+                this->make_resident(*resident, is_new || reallocate, *desc.vertices, *desc.indices, desc.vertex_version, desc.index_version);
+                if (is_new && !desc.is_transparent) {
+                    this->acquire_mesh_contents(*resident, *desc.vertices, *desc.indices);
+                }
+            }
+            resident->last_used_frame = this->m_frame;
+            assembled_mesh assembled;
+            assembled.transform = desc.transform;
+            assembled.vao = resident->vao;
+            assembled.vbo = resident->vbo;
+            assembled.ebo = resident->ebo;
+            assembled.instance_key = resident->instance_key;
+            assembled.is_transparent = desc.is_transparent;
+            if (desc.textures) {
+                assembled.textures = *desc.textures;
+            }
+            this->m_meshes.push_back(assembled);
+        }
+        void renderer::make_resident(resident_mesh& resident, bool is_new, const std::vector<vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t vertex_version, uint32_t index_version) {
+            bool vertices_changed = is_new || resident.vertex_version != vertex_version;
+            bool indices_changed = is_new || resident.index_version != index_version;
+            if (!vertices_changed && !indices_changed) {
+                return;
+            }
+            if (is_new) {
+                resident.vao = ref<vertex_array_object>::create();
+                resident.vbo = ref<vertex_buffer_object>::create(vertices);
+                resident.ebo = ref<element_buffer_object>::create(indices);
+                resident.vao->add_vertex_attributes(attributes);
+                this->m_statistics.buffer_allocations += 2;
+            } else {
+                // the element buffer binding is part of the vao state
+                resident.vao->bind();
+                if (vertices_changed) {
+                    resident.vbo->set_data(vertices);
+                    this->m_statistics.buffer_uploads++;
+                }
+                if (indices_changed) {
+                    resident.ebo->set_data(indices);
+                    this->m_statistics.buffer_uploads++;
+                }
+            }
+            resident.vao->unbind();
+            resident.vertex_version = vertex_version;
+            resident.index_version = index_version;
+        }
+        void renderer::acquire_mesh_contents(resident_mesh& resident, const std::vector<vertex>& vertices, const std::vector<uint32_t>& indices) {
+            uint64_t hash = hash_geometry(vertices, indices);
+            auto range = this->m_mesh_contents.equal_range(hash);
+            auto it = range.first;
+            for (; it != range.second; it++) {
+                // the hash alone could collide, and instances are all drawn from the first one's buffers
+                // reading back stalls, but only happens once for a new mesh whose hash matches
+                auto& contents = it->second;
+                if (contents.vertex_count != vertices.size() || contents.index_count != indices.size()) {
+                    continue;
+                }
+                std::vector<vertex> resident_vertices(vertices.size());
+                contents.vbo->get_data(resident_vertices.data(), resident_vertices.size() * sizeof(vertex));
+                if (memcmp(resident_vertices.data(), vertices.data(), vertices.size() * sizeof(vertex)) == 0 && contents.ebo->get_data() == indices) {
+                    break;
+                }
+            }
+            if (it == range.second) {
+                it = this->m_mesh_contents.insert({ hash, mesh_contents() });
+                it->second.vbo = resident.vbo;
+                it->second.ebo = resident.ebo;
+                it->second.vertex_count = vertices.size();
+                it->second.index_count = indices.size();
+            }
+            it->second.users++;
+            resident.instance_key = &it->second;
+            resident.content_hash = hash;
+        }
+        bool renderer::release_mesh_contents(resident_mesh& resident) {
+            if (resident.geometry || !resident.instance_key) {
+                return false;
+            }
+            bool still_referenced = false;
+            auto range = this->m_mesh_contents.equal_range(resident.content_hash);
+            for (auto it = range.first; it != range.second; it++) {
+                if (&it->second == resident.instance_key) {
+                    if (--it->second.users == 0) {
+                        this->m_mesh_contents.erase(it);
+                    } else {
+                        still_referenced = it->second.vbo == resident.vbo;
+                    }
+                    break;
+                }
+            }
+            resident.instance_key = nullptr;
+            return still_referenced;
+        }
         void renderer::submit(const model_descriptor& model) {
             this->m_models.push_back(model);
         }
+        void renderer::submit_static(const cached_mesh_descriptor& desc) {
+            auto it = this->m_static_meshes.find(desc.key);
+            bool is_new = it == this->m_static_meshes.end();
+            if (is_new) {
+                it = this->m_static_meshes.insert({ desc.key, static_mesh() }).first;
+            }
+            auto& entry = it->second;
+            // a mesh submitted twice in one frame still counts once, so that stale meshes are never missed
+            if (is_new || entry.last_used_frame != this->m_frame) {
+                this->m_static_submissions++;
+            }
+            entry.last_used_frame = this->m_frame;
+            entry.vertices = desc.vertices;
+            entry.indices = desc.indices;
+            size_t texture_count = desc.textures ? desc.textures->size() : 0;
+            bool textures_changed = is_new || entry.batch.size() != texture_count;
+            for (size_t i = 0; i < texture_count && !textures_changed; i++) {
+                const auto& texture_desc = (*desc.textures)[i];
+                textures_changed = entry.batch[i].first != texture_desc.data.raw() || entry.batch[i].second != texture_desc.uniform_name;
+            }
+            uint32_t layer = desc.textures ? get_layer(*desc.textures) : 0;
+            if (!textures_changed && entry.layer == layer && entry.transform == desc.transform &&
+                entry.vertex_version == desc.vertex_version && entry.index_version == desc.index_version) {
+                return;
+            }
+            if (!is_new) {
+                auto& old_batch = this->m_static_batches[entry.batch];
+                old_batch.members.erase(desc.key);
+                old_batch.dirty = true;
+            }
+            if (textures_changed) {
+                entry.batch.clear();
+                for (size_t i = 0; i < texture_count; i++) {
+                    const auto& texture_desc = (*desc.textures)[i];
+                    entry.batch.push_back({ texture_desc.data.raw(), texture_desc.uniform_name });
+                }
+            }
+            entry.layer = layer;
+            entry.transform = desc.transform;
+            entry.vertex_version = desc.vertex_version;
+            entry.index_version = desc.index_version;
+            auto& batch = this->m_static_batches[entry.batch];
+            if (batch.textures.empty() && desc.textures) {
+                batch.textures = *desc.textures;
+            }
+            batch.members.insert(desc.key);
+            batch.dirty = true;
+        }
+        void renderer::remove_stale_static_meshes() {
+            // every static mesh must be resubmitted each frame; anything that was not is removed from its batch
+            if (this->m_static_submissions == this->m_static_meshes.size()) {
+                return;
+            }
+            for (auto it = this->m_static_meshes.begin(); it != this->m_static_meshes.end();) {
+                if (it->second.last_used_frame != this->m_frame) {
+                    auto& batch = this->m_static_batches[it->second.batch];
+                    batch.members.erase(it->first);
+                    batch.dirty = true;
+                    it = this->m_static_meshes.erase(it);
+                } else {
+                    it++;
+                }
+            }
+        }
+        void renderer::rebuild_static_batch(static_batch& batch) {
+            std::vector<vertex> vertices;
+            std::vector<float> layers;
+            std::vector<uint32_t> indices;
+            for (mesh_cache_key key : batch.members) {
+                const auto& entry = this->m_static_meshes[key];
+                // transformed here rather than kept, so that the mesh is not stored twice on the cpu
+                glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(entry.transform)));
+                uint32_t base_vertex = (uint32_t)vertices.size();
+                for (const vertex& source : *entry.vertices) {
+                    vertex transformed;
+                    transformed.pos = glm::vec3(entry.transform * glm::vec4(source.pos, 1.f));
+                    transformed.normal = glm::normalize(normal_matrix * source.normal);
+                    transformed.uv = source.uv;
+                    vertices.push_back(transformed);
+                }
+                layers.insert(layers.end(), entry.vertices->size(), (float)entry.layer);
+                for (uint32_t index : *entry.indices) {
+                    indices.push_back(base_vertex + index);
+                }
+            }
+            if (!batch.vao) {
+                batch.vao = ref<vertex_array_object>::create();
+                batch.vbo = ref<vertex_buffer_object>::create(vertices);
+                batch.ebo = ref<element_buffer_object>::create(indices);
+                batch.vao->add_vertex_attributes(attributes);
+                batch.layer_vbo = ref<vertex_buffer_object>::create(layers);
+                batch.vao->add_vertex_attributes({ { GL_FLOAT, 1, sizeof(float), 0, false } }, layer_attribute);
+                this->m_statistics.buffer_allocations += 3;
+            } else {
+                batch.vao->bind();
+                batch.vbo->set_data(vertices);
+                batch.layer_vbo->set_data(layers);
+                batch.ebo->set_data(indices);
+                this->m_statistics.buffer_uploads += 3;
+            }
+            batch.vao->unbind();
+            batch.index_count = indices.size();
+            batch.bounds = aabb::from_vertices(vertices);
+            batch.dirty = false;
+        }
+        void renderer::render_instanced(const std::vector<const assembled_mesh*>& group, size_t first_instance) {
+            // per-instance model matrices occupy attributes 3 through 6, right after the vertex attributes
+            constexpr uint32_t first_attribute = 3;
+            std::vector<vertex_attribute> instance_attributes;
+            for (size_t i = 0; i < 4; i++) {
+                size_t offset = first_instance * sizeof(glm::mat4) + i * sizeof(glm::vec4);
+                instance_attributes.push_back({ GL_FLOAT, 4, sizeof(glm::mat4), offset, false, 1 });
+            }
+            const auto& mesh = *group.front();
+            this->m_instance_buffer->bind();
+            mesh.vao->add_vertex_attributes(instance_attributes, first_attribute);
+            this->m_instance_layer_buffer->bind();
+            mesh.vao->add_vertex_attributes({ { GL_FLOAT, 1, sizeof(float), first_instance * sizeof(float), false, 1 } }, layer_attribute);
+            mesh.ebo->draw_instanced(GL_TRIANGLES, (uint32_t)group.size());
+            mesh.vao->disable_vertex_attributes(first_attribute, (uint32_t)instance_attributes.size());
+            mesh.vao->disable_vertex_attributes(layer_attribute, 1);
+            this->m_statistics.draw_calls++;
+            this->m_statistics.instanced_draw_calls++;
+            this->m_statistics.instances += (uint32_t)group.size();
+        }
+        uint64_t renderer::make_sort_key(bool transparent, ref<shader> program, const std::vector<texture_descriptor>* textures, ref<vertex_array_object> vao, const glm::vec3& position) {
+            uint64_t shader_id = program ? (uint64_t)(program->get() & 0xfff) : 0;
+            uint64_t texture_set_id = 0;
+            if (textures && !textures->empty()) {
+                uint64_t hash = 0xcbf29ce484222325ull;
+                for (const auto& desc : *textures) {
+                    const texture* data = desc.data.raw();
+                    hash = hash_bytes(hash, &data, sizeof(const texture*));
+                }
+                auto it = this->m_texture_set_ids.find(hash);
+                if (it == this->m_texture_set_ids.end()) {
+                    it = this->m_texture_set_ids.insert({ hash, (uint32_t)this->m_texture_set_ids.size() + 1 }).first;
+                }
+                texture_set_id = (uint64_t)(it->second & 0xfff);
+            }
+            uint64_t vao_id = vao ? (uint64_t)(vao->get() & 0x7fff) : 0;
+            // non-negative floats sort the same way as their bit patterns
+            float distance = glm::length(position - this->m_camera_position);
+            uint32_t distance_bits;
+            memcpy(&distance_bits, &distance, sizeof(float));
+            uint64_t depth = (uint64_t)(distance_bits >> 8);
+            if (transparent) {
+                // transparent: [63] pass | [62:39] inverted depth (back to front) | [38:27] shader | [26:15] textures | [14:0] vao
+                return (1ull << 63) | ((~depth & 0xffffff) << 39) | (shader_id << 27) | (texture_set_id << 15) | vao_id;
+            } else {
+                // opaque: [63] pass | [62:51] shader | [50:39] textures | [38:24] vao | [23:0] depth (front to back)
+                return (shader_id << 51) | (texture_set_id << 39) | (vao_id << 24) | depth;
+            }
+        }
+        void renderer::evict(mesh_cache_key key) {
+            auto resident = this->m_mesh_cache.find(key);
+            if (resident != this->m_mesh_cache.end()) {
+                this->release_mesh_contents(resident->second);
+                this->m_mesh_cache.erase(resident);
+            }
+            auto it = this->m_static_meshes.find(key);
+            if (it != this->m_static_meshes.end()) {
+                auto& batch = this->m_static_batches[it->second.batch];
+                batch.members.erase(key);
+                batch.dirty = true;
+                this->m_static_meshes.erase(it);
+            }
+        }
+        void renderer::clear_cache() {
+            this->m_mesh_cache.clear();
+            this->m_mesh_contents.clear();
+            this->m_geometry_cache.clear();
+            this->m_static_meshes.clear();
+            this->m_static_batches.clear();
+        }
+        void renderer::set_static_batching(bool enabled) {
+            this->m_static_batching = enabled;
+            if (!enabled) {
+                this->m_static_meshes.clear();
+                this->m_static_batches.clear();
+            }
+        }
+        bool renderer::is_static_batching_enabled() const {
+            return this->m_static_batching;
+        }
+        const renderer::statistics& renderer::get_statistics() const {
+            return this->m_statistics;
+        }
         void renderer::render() {
-            // todo: instead of rendering each object individually, start batch rendering
-            ref<shader> current_shader;
+            ref<shader> default_shader, instanced_shader;
             auto& library = shader_library::get();
-            std::string shader_name = "renderer-default";
-            if (library.find(shader_name) != library.end()) {
-                current_shader = library[shader_name];
+            if (library.find("renderer-default") != library.end()) {
+                default_shader = library["renderer-default"];
             }
-            if (current_shader) {
-                current_shader->bind();
+            if (library.find("renderer-instanced") != library.end()) {
+                instanced_shader = library["renderer-instanced"];
             }
-            for (auto& mesh : this->m_meshes) {
-                if (current_shader) {
-                    current_shader->uniform_mat4("model", mesh.transform);
+            this->m_commands.clear();
+            this->m_texture_set_ids.clear();
+            this->remove_stale_static_meshes();
+            for (auto it = this->m_static_batches.begin(); it != this->m_static_batches.end();) {
+                auto& batch = it->second;
+                if (batch.members.empty()) {
+                    it = this->m_static_batches.erase(it);
+                    continue;
+                }
+                if (batch.dirty) {
+                    this->rebuild_static_batch(batch);
                 }
-                for (size_t i = 0; i < mesh.textures.size(); i++) {
-                    auto& desc = mesh.textures[i];
-                    desc.data->bind((uint32_t)i);
-                    if (current_shader && !desc.uniform_name.empty()) {
-                        current_shader->uniform_int(desc.uniform_name, (GLint)i);
+                // static meshes are submitted without being culled by the scene; the batch is culled as a whole instead
+                if (this->m_has_camera && !this->m_frustum.intersects(batch.bounds)) {
+                    this->m_statistics.culled_static_batches++;
+                    it++;
+                    continue;
+                }
+                uint64_t key = this->make_sort_key(false, default_shader, &batch.textures, batch.vao, batch.bounds.get_center());
+                this->m_commands.push_back({ key, draw_command_type::static_batch, &batch, 0 });
+                it++;
+            }
+            this->m_statistics.static_batches = this->m_static_batches.size();
+            this->m_statistics.static_meshes = this->m_static_meshes.size();
+            // group meshes with identical geometry and textures; without an instanced shader, every mesh is its own group
+            // layers are left out, so that meshes sampling different layers of the same array are drawn together
+            this->m_instance_groups.clear();
+            std::unordered_map<uint64_t, size_t> group_indices;
+            for (const auto& mesh : this->m_meshes) {
+                if (instanced_shader && mesh.instance_key && !mesh.is_transparent) {
+                    uint64_t group_key = hash_bytes(0xcbf29ce484222325ull, &mesh.instance_key, sizeof(const void*));
+                    for (const auto& desc : mesh.textures) {
+                        const texture* data = desc.data.raw();
+                        group_key = hash_bytes(group_key, &data, sizeof(const texture*));
+                        group_key = hash_bytes(group_key, desc.uniform_name.data(), desc.uniform_name.length());
+                    }
+                    auto it = group_indices.find(group_key);
+                    const auto* first = it != group_indices.end() ? this->m_instance_groups[it->second].front() : nullptr;
+                    if (first && first->instance_key == mesh.instance_key && same_textures(first->textures, mesh.textures)) {
+                        this->m_instance_groups[it->second].push_back(&mesh);
+                        continue;
+                    }
+                    if (it == group_indices.end()) {
+                        group_indices.insert({ group_key, this->m_instance_groups.size() });
                     }
                 }
-                mesh.vao->bind();
-                mesh.ebo->draw(GL_TRIANGLES);
-                mesh.vao->unbind();
+                this->m_instance_groups.push_back({ &mesh });
+            }
+            this->m_instance_transforms.clear();
+            this->m_instance_layers.clear();
+            for (const auto& group : this->m_instance_groups) {
+                const auto& mesh = *group.front();
+                glm::vec3 position = glm::vec3(mesh.transform[3]);
+                if (group.size() > 1) {
+                    uint64_t key = this->make_sort_key(false, instanced_shader, &mesh.textures, mesh.vao, position);
+                    this->m_commands.push_back({ key, draw_command_type::instanced, &group, this->m_instance_transforms.size() });
+                    for (const auto* instance : group) {
+                        this->m_instance_transforms.push_back(instance->transform);
+                        this->m_instance_layers.push_back((float)get_layer(instance->textures));
+                    }
+                } else {
+                    uint64_t key = this->make_sort_key(mesh.is_transparent, default_shader, &mesh.textures, mesh.vao, position);
+                    this->m_commands.push_back({ key, draw_command_type::mesh, &mesh, 0 });
+                }
             }
             for (const auto& model : this->m_models) {
-                model.render_callback(model);
+                uint64_t key = this->make_sort_key(model.is_transparent, model.mesh_shader, nullptr, nullptr, glm::vec3(model.transform[3]));
+                this->m_commands.push_back({ key, draw_command_type::model, &model, 0 });
+            }
+            this->m_bone_palettes.clear();
+            for (auto& model : this->m_models) {
+                if (model.bone_palette && !model.bone_palette->empty()) {
+                    model.bone_palette_offset = (uint32_t)this->m_bone_palettes.size();
+                    this->m_bone_palettes.insert(this->m_bone_palettes.end(), model.bone_palette->begin(), model.bone_palette->end());
+                }
+            }
+            if (!this->m_bone_palettes.empty()) {
+                if (!this->m_bone_palette_buffer) {
+                    this->m_bone_palette_buffer = ref<texture_buffer>::create();
+                }
+                this->m_bone_palette_buffer->set_data(this->m_bone_palettes);
+                for (auto& model : this->m_models) {
+                    if (model.bone_palette && !model.bone_palette->empty()) {
+                        model.bone_palette_buffer = this->m_bone_palette_buffer;
+                    }
+                }
+                this->m_statistics.bone_palette_matrices = (uint32_t)this->m_bone_palettes.size();
+            }
+            if (!this->m_instance_transforms.empty()) {
+                if (!this->m_instance_buffer) {
+                    this->m_instance_buffer = ref<vertex_buffer_object>::create(this->m_instance_transforms);
+                    this->m_instance_layer_buffer = ref<vertex_buffer_object>::create(this->m_instance_layers);
+                } else {
+                    this->m_instance_buffer->set_data(this->m_instance_transforms);
+                    this->m_instance_layer_buffer->set_data(this->m_instance_layers);
+                }
+            }
+            radix_sort(this->m_commands, this->m_sort_scratch);
+            uniform_handle model_uniform;
+            if (default_shader) {
+                model_uniform = default_shader->get_uniform_handle("model");
+            }
+            // consecutive commands usually share state after sorting; state_tracker and the uniform cache elide the repeated binds
+            auto prepare = [&](ref<shader> program, const std::vector<texture_descriptor>& textures, ref<vertex_array_object> vao) {
+                if (program) {
+                    program->bind();
+                }
+                bind_textures(program, textures);
+                vao->bind();
+            };
+            for (const auto& command : this->m_commands) {
+                switch (command.type) {
+                case draw_command_type::static_batch:
+                {
+                    const auto& batch = *(const static_batch*)command.data;
+                    prepare(default_shader, batch.textures, batch.vao);
+                    if (default_shader) {
+                        default_shader->uniform_mat4(model_uniform, glm::mat4(1.f)); // vertices are already in world space
+                    }
+                    batch.ebo->draw(GL_TRIANGLES);
+                    this->m_statistics.draw_calls++;
+                }
+                    break;
+                case draw_command_type::mesh:
+                {
+                    const auto& mesh = *(const assembled_mesh*)command.data;
+                    prepare(default_shader, mesh.textures, mesh.vao);
+                    if (default_shader) {
+                        default_shader->uniform_mat4(model_uniform, mesh.transform);
+                    }
+                    // the attribute has no array enabled here, so the current value applies to every vertex
+                    glVertexAttrib1f(layer_attribute, (float)get_layer(mesh.textures));
+                    mesh.ebo->draw(GL_TRIANGLES);
+                    this->m_statistics.draw_calls++;
+                }
+                    break;
+                case draw_command_type::instanced:
+                {
+                    const auto& group = *(const std::vector<const assembled_mesh*>*)command.data;
+                    prepare(instanced_shader, group.front()->textures, group.front()->vao);
+                    this->render_instanced(group, command.first_instance);
+                }
+                    break;
+                case draw_command_type::model:
+                {
+                    const auto& model = *(const model_descriptor*)command.data;
+                    model.render_callback(model);
+                }
+                    break;
+                }
             }
+            state_tracker::get().bind_vertex_array(0);
+            this->m_statistics.resident_meshes = this->m_mesh_cache.size() + this->m_geometry_cache.size();
         }
     }
 }
\ No newline at end of file
@@ -6,8 +6,27 @@
 #include "components.h"
 #include "shader.h"
 #include "shader_library.h"
+#include "thread_pool.h"
 namespace libplayground {
     namespace gl {
+        static std::atomic<uint32_t> scene_count = 0;
+        // stored in the upper half of a spatial index proxy's user data
+        enum class proxy_kind : uint32_t {
+            mesh,
+            model
+        };
+        scene::scene() {
+            this->m_id = scene_count++;
+            this->m_frames_since_rebuild_check = 0;
+            this->m_last_update_time = -1.0;
+            this->m_lod_threshold = 1.f;
+            this->m_lod_hysteresis = 0.25f;
+            this->m_occlusion_culling = false;
+            this->m_occluded_count = 0;
+            this->m_registry.on_destroy<components::mesh_component>().connect<&scene::on_mesh_component_destroyed>(*this);
+            this->m_registry.on_destroy<components::model_component>().connect<&scene::on_model_component_destroyed>(*this);
+            this->m_registry.on_destroy<components::transform_component>().connect<&scene::on_transform_component_destroyed>(*this);
+        }
         entity scene::create() {
             entity entity(this->m_registry.create(), this);
             entity.add_component<components::transform_component>();
@@ -21,27 +40,39 @@ namespace libplayground {
             updateable_view.each([](auto& script_component) {
                 script_component.update();
             });
+            double time = glfwGetTime();
+            float delta_time = this->m_last_update_time < 0.0 ? 0.f : (float)(time - this->m_last_update_time);
+            this->m_last_update_time = time;
+            this->update_animations(delta_time);
+        }
+        void scene::update_animations(float delta_time) {
+            this->m_animated_models.clear();
+            auto model_view = this->m_registry.view<components::model_component>();
+            for (entt::entity entity : model_view) {
+                auto& model = model_view.get<components::model_component>(entity);
+                if (model.data && model.data->is_animated()) {
+                    model.animation_time += delta_time;
+                    this->m_animated_models.push_back(&model);
+                }
+            }
+            // every entity writes only to its own component, so poses can be evaluated on any thread
+            thread_pool::get().parallel_for(this->m_animated_models.size(), [this](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    auto& model = *this->m_animated_models[i];
+                    model.data->compute_bone_palette(model.current_animation, model.animation_time, model.bone_palette, &model.animation_cursor);
+                }
+            }, 4);
         }
         void scene::render(ref<renderer> renderer, ref<window> window) {
-            auto renderable_view = this->m_registry.view<components::transform_component, components::mesh_component>();
-            renderable_view.each([&](auto& transform, auto& mesh) {
-                ::libplayground::gl::mesh m;
-                m.transform = transform.get_matrix();
-                m.vertices = mesh.vertices;
-                m.indices = mesh.indices;
-                m.textures = mesh.textures;
-                renderer->submit(m);
-            });
-            auto model_view = this->m_registry.view<components::transform_component, components::model_component>();
-            model_view.each([&](auto& transform, components::model_component& model) {
-                model_descriptor desc;
-                desc.render_callback = [&model](const auto& desc) {
-                    model.data->draw(desc.animation_id, 0.f);
-                };
-                desc.transform = transform.get_matrix();
-                desc.animation_id = model.current_animation;
-                renderer->submit(desc);
-            });
+            for (uint64_t key : this->m_evicted_meshes) {
+                renderer->evict(key);
+            }
+            this->m_evicted_meshes.clear();
+            bool has_camera = false;
+            frustum camera_frustum;
+            glm::mat4 view_projection;
+            glm::vec3 camera_position = glm::vec3(0.f);
+            float pixels_per_unit = 0.f; // at a distance of one unit
             auto camera_view = this->m_registry.view<components::transform_component, components::camera_component>();
             entt::entity camera = entt::null;
             // first, search for primary camera entities
@@ -55,23 +86,290 @@ namespace libplayground {
                 camera = camera_view.front();
             }
             // and then, if we found a camera, calculate matricies for rendering
+            // the camera comes first so that the renderer can sort submissions by distance
             if (camera != entt::null) {
-                auto set_uniforms = [&](ref<shader> s, const glm::mat4& projection, const glm::mat4& view) {
-                    s->bind();
-                    s->uniform_mat4("projection", projection);
-                    s->uniform_mat4("view", view);
-                };
                 float aspect_ratio = (float)window->get_width() / (float)window->get_height();
                 auto components = camera_view.get(camera);
                 auto& transform = std::get<0>(components);
                 glm::vec3 position = transform.get_matrix() * glm::vec4(0.f, 0.f, 0.f, 1.f);
                 auto& camera_comp = std::get<1>(components);
-                glm::mat4 projection = glm::perspective(glm::radians(45.f), aspect_ratio, 0.1f, 100.f); // todo: make every field part of camera_component
+                float fov = glm::radians(45.f);
+                glm::mat4 projection = glm::perspective(fov, aspect_ratio, 0.1f, 100.f); // todo: make every field part of camera_component
                 glm::mat4 view = glm::lookAt(position, position + camera_comp.direction, camera_comp.up);
-                for (const auto& pair : shader_library::get()) {
-                    set_uniforms(pair.second, projection, view);
+                renderer->set_camera(projection, view, position, glm::vec4(0.f, 0.f, (float)window->get_width(), (float)window->get_height()));
+                view_projection = projection * view;
+                camera_frustum = frustum::from_matrix(view_projection);
+                camera_position = position;
+                pixels_per_unit = (float)window->get_height() / (2.f * tanf(fov * 0.5f));
+                has_camera = true;
+            }
+            this->sync_spatial_index();
+            auto renderable_view = this->m_registry.view<components::transform_component, components::mesh_component>();
+            auto model_view = this->m_registry.view<components::transform_component, components::model_component>();
+            bool static_batching = renderer->is_static_batching_enabled();
+            this->m_visible_meshes.clear();
+            this->m_visible_models.clear();
+            auto add_visible = [&](uint32_t proxy) {
+                uint64_t user_data = this->m_spatial_index.get_user_data(proxy);
+                auto entity = (entt::entity)(uint32_t)user_data;
+                if ((proxy_kind)(user_data >> 32) == proxy_kind::model) {
+                    this->m_visible_models.push_back(entity);
+                } else if (!static_batching || !renderable_view.get<components::mesh_component>(entity).is_static) {
+                    this->m_visible_meshes.push_back(entity);
+                }
+            };
+            if (has_camera) {
+                // whole subtrees inside the frustum are accepted without testing their leaves
+                // leaves that straddle a plane are tested against their tight bounds in batches
+                this->m_cull_proxies.clear();
+                this->m_cull_boxes.clear();
+                this->m_spatial_index.query(camera_frustum, [&](uint32_t proxy, bool fully_inside) {
+                    if (fully_inside) {
+                        add_visible(proxy);
+                    } else {
+                        this->m_cull_proxies.push_back(proxy);
+                        this->m_cull_boxes.push_back(this->m_spatial_index.get_bounds(proxy));
+                    }
+                });
+                this->m_cull_results.resize(this->m_cull_boxes.size());
+                cull_boxes(camera_frustum, this->m_cull_boxes.data(), this->m_cull_boxes.size(), this->m_cull_results.data());
+                for (size_t i = 0; i < this->m_cull_proxies.size(); i++) {
+                    if (this->m_cull_results[i]) {
+                        add_visible(this->m_cull_proxies[i]);
+                    }
+                }
+                this->m_occluded_count = 0;
+                if (this->m_occlusion_culling) {
+                    this->cull_occluded(view_projection, camera_frustum);
+                }
+            } else {
+                for (const auto& pair : this->m_mesh_proxies) {
+                    add_visible(pair.second.proxy);
+                }
+                for (const auto& pair : this->m_model_proxies) {
+                    add_visible(pair.second.proxy);
                 }
             }
+            if (static_batching) {
+                // batched meshes must be submitted every frame; the renderer culls whole batches
+                renderable_view.each([&](const auto& entity, auto& transform, auto& mesh) {
+                    if (mesh.is_static) {
+                        this->m_visible_meshes.push_back(entity);
+                    }
+                });
+            }
+            for (entt::entity entity : this->m_visible_meshes) {
+                auto& transform = renderable_view.get<components::transform_component>(entity);
+                auto& mesh = renderable_view.get<components::mesh_component>(entity);
+                cached_mesh_descriptor desc;
+                desc.key = this->get_mesh_cache_key(entity);
+                desc.transform = transform.get_matrix();
+                desc.textures = &mesh.textures;
+                if (mesh.geometry) {
+                    desc.geometry = mesh.geometry.raw();
+                    desc.vertices = &mesh.geometry->get_vertices();
+                    desc.indices = &mesh.geometry->get_indices();
+                    desc.vertex_version = desc.index_version = mesh.geometry->get_version();
+                } else {
+                    desc.vertices = &mesh.vertices;
+                    desc.indices = &mesh.indices;
+                    desc.vertex_version = mesh.vertex_version;
+                    desc.index_version = mesh.index_version;
+                }
+                desc.is_static = mesh.is_static;
+                desc.is_transparent = mesh.is_transparent;
+                renderer->submit(desc);
+            }
+            for (entt::entity entity : this->m_visible_models) {
+                auto& transform = model_view.get<components::transform_component>(entity);
+                auto& model = model_view.get<components::model_component>(entity);
+                model_descriptor desc;
+                desc.transform = transform.get_matrix();
+                if (has_camera) {
+                    this->select_lod(model, desc.transform, camera_position, pixels_per_unit);
+                } else {
+                    model.current_lod = 0;
+                }
+                if (!model.bone_palette.empty()) {
+                    desc.bone_palette = &model.bone_palette;
+                }
+                desc.render_callback = [&model](const auto& desc) {
+                    if (desc.bone_palette_buffer) {
+                        model.data->draw(desc.bone_palette_buffer, desc.bone_palette_offset, model.current_lod, desc.bone_palette);
+                    } else {
+                        model.data->draw(model.bone_palette, model.current_lod);
+                    }
+                };
+                desc.animation_id = model.current_animation;
+                desc.mesh_shader = model.data->get_mesh_shader();
+                renderer->submit(desc);
+            }
+        }
+        uint64_t scene::get_mesh_cache_key(entt::entity handle) const {
+            return ((uint64_t)this->m_id << 32) | (uint64_t)(uint32_t)handle;
+        }
+        void scene::on_mesh_component_destroyed(entt::registry& registry, entt::entity handle) {
+            // a new mesh on a recycled entity must not reuse the old buffers
+            this->m_evicted_meshes.push_back(this->get_mesh_cache_key(handle));
+            this->remove_proxy(this->m_mesh_proxies, handle);
+        }
+        void scene::on_model_component_destroyed(entt::registry& registry, entt::entity handle) {
+            this->remove_proxy(this->m_model_proxies, handle);
+        }
+        void scene::on_transform_component_destroyed(entt::registry& registry, entt::entity handle) {
+            // neither proxy has a position without it
+            this->remove_proxy(this->m_mesh_proxies, handle);
+            this->remove_proxy(this->m_model_proxies, handle);
+        }
+        void scene::remove_proxy(std::unordered_map<entt::entity, spatial_proxy>& proxies, entt::entity handle) {
+            auto it = proxies.find(handle);
+            if (it != proxies.end()) {
+                this->m_spatial_index.remove(it->second.proxy);
+                proxies.erase(it);
+            }
+        }
+        bool scene::bounds_source::operator==(const bounds_source& other) const {
+            return this->translation == other.translation && this->rotation == other.rotation && this->scale == other.scale &&
+                this->data == other.data && this->version == other.version;
+        }
+        void scene::sync_proxy(std::unordered_map<entt::entity, spatial_proxy>& proxies, entt::entity handle, uint32_t kind, const bounds_source& source, const std::function<aabb()>& get_bounds) {
+            auto it = proxies.find(handle);
+            if (it != proxies.end() && it->second.source == source) {
+                return;
+            }
+            aabb box = get_bounds();
+            if (!box.is_valid()) {
+                // nothing to draw or hit; checked again every frame, since a loading model gets its bounds later
+                if (it != proxies.end()) {
+                    this->m_spatial_index.remove(it->second.proxy);
+                    proxies.erase(it);
+                }
+            } else if (it == proxies.end()) {
+                uint64_t user_data = ((uint64_t)kind << 32) | (uint64_t)(uint32_t)handle;
+                proxies[handle] = { this->m_spatial_index.insert(box, user_data), source };
+            } else {
+                this->m_spatial_index.update(it->second.proxy, box);
+                it->second.source = source;
+            }
+        }
+        void scene::sync_spatial_index() {
+            // comparing what the bounds were computed from is far cheaper than refitting, and catches changes made through any reference
+            auto renderable_view = this->m_registry.view<components::transform_component, components::mesh_component>();
+            for (entt::entity handle : renderable_view) {
+                auto& transform = renderable_view.get<components::transform_component>(handle);
+                auto& mesh = renderable_view.get<components::mesh_component>(handle);
+                bounds_source source = { transform.translation, transform.rotation, transform.scale };
+                if (mesh.geometry) {
+                    source.data = mesh.geometry.raw();
+                    source.version = mesh.geometry->get_version();
+                } else {
+                    source.version = mesh.vertex_version;
+                }
+                this->sync_proxy(this->m_mesh_proxies, handle, (uint32_t)proxy_kind::mesh, source, [&]() {
+                    return mesh.get_bounds().transformed(transform.get_matrix());
+                });
+            }
+            auto model_view = this->m_registry.view<components::transform_component, components::model_component>();
+            for (entt::entity handle : model_view) {
+                auto& transform = model_view.get<components::transform_component>(handle);
+                auto& model = model_view.get<components::model_component>(handle);
+                bounds_source source = { transform.translation, transform.rotation, transform.scale, model.data.raw() };
+                this->sync_proxy(this->m_model_proxies, handle, (uint32_t)proxy_kind::model, source, [&]() {
+                    return model.data ? model.data->get_bounds().transformed(transform.get_matrix()) : aabb();
+                });
+            }
+            // measuring the tree walks every node, so only do it every so often
+            if (++this->m_frames_since_rebuild_check >= 60) {
+                this->m_spatial_index.rebuild_if_degraded();
+                this->m_frames_since_rebuild_check = 0;
+            }
+        }
+        void scene::set_occlusion_culling(bool enabled) {
+            this->m_occlusion_culling = enabled;
+        }
+        bool scene::is_occlusion_culling_enabled() const {
+            return this->m_occlusion_culling;
+        }
+        size_t scene::get_occluded_count() const {
+            return this->m_occluded_count;
+        }
+        void scene::cull_occluded(const glm::mat4& view_projection, const frustum& camera_frustum) {
+            auto renderable_view = this->m_registry.view<components::transform_component, components::mesh_component>();
+            auto model_view = this->m_registry.view<components::transform_component, components::model_component>();
+            this->m_occlusion_buffer.begin(view_projection);
+            bool has_occluders = false;
+            renderable_view.each([&](const auto& entity, auto& transform, auto& mesh) {
+                if (!mesh.is_occluder || mesh.is_transparent) {
+                    return;
+                }
+                glm::mat4 matrix = transform.get_matrix();
+                if (!camera_frustum.intersects(mesh.get_bounds().transformed(matrix))) {
+                    return;
+                }
+                if (mesh.geometry) {
+                    this->m_occlusion_buffer.add_occluder(mesh.geometry->get_vertices(), mesh.geometry->get_indices(), matrix);
+                } else {
+                    this->m_occlusion_buffer.add_occluder(mesh.vertices, mesh.indices, matrix);
+                }
+                has_occluders = true;
+            });
+            if (!has_occluders) {
+                return;
+            }
+            this->m_occlusion_buffer.finish();
+            size_t previous_count = this->m_visible_meshes.size() + this->m_visible_models.size();
+            // occluders are tested too; one can hide another
+            this->m_visible_meshes.erase(std::remove_if(this->m_visible_meshes.begin(), this->m_visible_meshes.end(), [&](entt::entity entity) {
+                auto& transform = renderable_view.get<components::transform_component>(entity);
+                auto& mesh = renderable_view.get<components::mesh_component>(entity);
+                return !this->m_occlusion_buffer.is_visible(mesh.get_bounds().transformed(transform.get_matrix()));
+            }), this->m_visible_meshes.end());
+            this->m_visible_models.erase(std::remove_if(this->m_visible_models.begin(), this->m_visible_models.end(), [&](entt::entity entity) {
+                auto& transform = model_view.get<components::transform_component>(entity);
+                auto& model = model_view.get<components::model_component>(entity);
+                return !this->m_occlusion_buffer.is_visible(model.data->get_bounds().transformed(transform.get_matrix()));
+            }), this->m_visible_models.end());
+            this->m_occluded_count = previous_count - this->m_visible_meshes.size() - this->m_visible_models.size();
+        }
+        void scene::set_lod_threshold(float pixels, float hysteresis) {
+            this->m_lod_threshold = pixels;
+            this->m_lod_hysteresis = glm::clamp(hysteresis, 0.f, 1.f);
+        }
+        void scene::select_lod(components::model_component& model, const glm::mat4& transform, const glm::vec3& camera_position, float pixels_per_unit) const {
+            uint32_t count = model.data->get_lod_count();
+            if (count <= 1) {
+                model.current_lod = 0;
+                return;
+            }
+            aabb bounds = model.data->get_bounds().transformed(transform);
+            float distance = glm::length(bounds.get_center() - camera_position) - glm::length(bounds.get_extent());
+            if (distance <= 0.f) {
+                // the camera is inside the bounds
+                model.current_lod = 0;
+                return;
+            }
+            // errors are in model space
+            float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+            float pixels_per_error = scale * pixels_per_unit / distance;
+            uint32_t lod = std::min(model.current_lod, count - 1);
+            while (lod > 0 && model.data->get_lod_error(lod) * pixels_per_error > this->m_lod_threshold) {
+                lod--;
+            }
+            float coarsen_threshold = this->m_lod_threshold * (1.f - this->m_lod_hysteresis);
+            while (lod + 1 < count && model.data->get_lod_error(lod + 1) * pixels_per_error < coarsen_threshold) {
+                lod++;
+            }
+            model.current_lod = lod;
+        }
+        raycast_hit scene::raycast(const glm::vec3& origin, const glm::vec3& direction, float max_distance) {
+            this->sync_spatial_index();
+            raycast_hit result;
+            this->m_spatial_index.raycast(origin, glm::normalize(direction), max_distance, [&](uint32_t proxy, float distance) {
+                result.hit = (entt::entity)(uint32_t)this->m_spatial_index.get_user_data(proxy);
+                result.distance = distance;
+                return distance;
+            });
+            return result;
         }
     }
 }
\ No newline at end of file
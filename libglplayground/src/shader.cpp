@@ -1,5 +1,8 @@
 #include "libglppch.h"
 #include "shader.h"
+#include "state_tracker.h"
+#include "uniform_buffer_object.h"
+#include "cooked_file.h"
 namespace libplayground {
     namespace gl {
         extern bool _context_destroyed_;
@@ -32,6 +35,59 @@ namespace libplayground {
             }
             return shader;
         }
+        // bump whenever the layout of cached program binaries changes
+        constexpr uint32_t program_binary_magic = 0x47525043; // "CPRG"
+        constexpr uint32_t program_binary_version = 1;
+        struct program_binary_header {
+            uint32_t magic, version;
+            // the file name is derived from this too; it is checked in case a file was copied around
+            uint64_t key;
+            uint32_t format;
+        };
+        // off until the application picks a directory it is allowed to write to
+        static std::string program_binary_directory;
+        static uint64_t hash_string(uint64_t hash, const std::string& value) {
+            // fnv-1a; the terminator is included, so that "ab" + "c" and "a" + "bc" differ
+            for (size_t i = 0; i <= value.length(); i++) {
+                hash ^= (uint64_t)(uint8_t)value.c_str()[i];
+                hash *= 0x100000001b3ull;
+            }
+            return hash;
+        }
+        static bool is_program_binary_supported() {
+            static const bool supported = []() {
+                // core since opengl 4.1; older contexts may still have arb_get_program_binary
+                if (!glGetProgramBinary || !glProgramBinary) {
+                    return false;
+                }
+                GLint format_count = 0;
+                glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+                return format_count > 0;
+            }();
+            return supported;
+        }
+        // binaries are only valid for the driver that made them, and a driver update does not always change the format enum
+        static uint64_t get_program_key(const shader_source& source) {
+            static const std::string driver = []() {
+                std::string result;
+                for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+                    const char* value = (const char*)glGetString(name);
+                    result += std::string(value ? value : "") + "\n";
+                }
+                return result;
+            }();
+            uint64_t hash = 0xcbf29ce484222325ull;
+            hash = hash_string(hash, source.vertex);
+            hash = hash_string(hash, source.fragment);
+            hash = hash_string(hash, source.geometry);
+            return hash_string(hash, driver);
+        }
+        void shader::set_binary_cache_directory(const std::string& path) {
+            program_binary_directory = path;
+        }
+        const std::string& shader::get_binary_cache_directory() {
+            return program_binary_directory;
+        }
         shader::shader(const shader_source& source) {
             if (source.vertex.empty()) {
                 throw std::runtime_error("Vertex shader source cannot be empty!");
@@ -39,6 +95,29 @@ namespace libplayground {
             if (source.fragment.empty()) {
                 throw std::runtime_error("Fragment shader source cannot be empty!");
             }
+            this->m_id = 0;
+            std::string cache_path;
+            uint64_t key = 0;
+            if (!program_binary_directory.empty() && is_program_binary_supported()) {
+                key = get_program_key(source);
+                std::stringstream file_name;
+                file_name << std::hex << key << ".bin";
+                cache_path = (std::filesystem::path(program_binary_directory) / file_name.str()).string();
+            }
+            if (cache_path.empty() || !this->load_binary(cache_path, key)) {
+                this->link(source, !cache_path.empty());
+                if (!cache_path.empty()) {
+                    this->save_binary(cache_path, key);
+                }
+            }
+            this->reflect();
+            GLuint camera_block = this->get_uniform_block_index("camera_data");
+            this->m_uses_camera_buffer = camera_block != GL_INVALID_INDEX;
+            if (this->m_uses_camera_buffer) {
+                glUniformBlockBinding(this->m_id, camera_block, (GLuint)uniform_buffer_binding::camera);
+            }
+        }
+        void shader::link(const shader_source& source, bool retrievable) {
             std::vector<GLuint> shaders;
             shaders.push_back(create_shader(source.vertex, GL_VERTEX_SHADER));
             shaders.push_back(create_shader(source.fragment, GL_FRAGMENT_SHADER));
@@ -49,6 +128,10 @@ namespace libplayground {
             for (GLuint shader : shaders) {
                 glAttachShader(this->m_id, shader);
             }
+            if (retrievable) {
+                // some drivers only keep a binary around when asked to before linking
+                glProgramParameteri(this->m_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            }
             glLinkProgram(this->m_id);
             GLint succeeded;
             glGetProgramiv(this->m_id, GL_LINK_STATUS, &succeeded);
@@ -61,42 +144,239 @@ namespace libplayground {
                 glDeleteShader(shader);
             }
         }
+        bool shader::load_binary(const std::string& path, uint64_t key) {
+            std::error_code error;
+            if (!std::filesystem::exists(path, error)) {
+                return false;
+            }
+            try {
+                auto file = ref<mapped_file>::create(path);
+                binary_reader reader(file->get_data(), file->get_size());
+                auto header = reader.read<program_binary_header>();
+                if (header.magic != program_binary_magic || header.version != program_binary_version || header.key != key) {
+                    return false;
+                }
+                size_t size;
+                const uint8_t* binary = reader.view_array<uint8_t>(size);
+                this->m_id = glCreateProgram();
+                glProgramBinary(this->m_id, (GLenum)header.format, binary, (GLsizei)size);
+            } catch (const std::exception& exc) {
+                spdlog::warn("Ignoring damaged program binary " + path + ": " + exc.what());
+                return false;
+            }
+            GLint succeeded;
+            glGetProgramiv(this->m_id, GL_LINK_STATUS, &succeeded);
+            if (!succeeded) {
+                // the driver no longer accepts its own format; it is replaced once the program is linked from source
+                glDeleteProgram(this->m_id);
+                this->m_id = 0;
+                return false;
+            }
+            return true;
+        }
+        void shader::save_binary(const std::string& path, uint64_t key) const {
+            GLint length = 0;
+            glGetProgramiv(this->m_id, GL_PROGRAM_BINARY_LENGTH, &length);
+            if (length <= 0) {
+                return;
+            }
+            std::vector<uint8_t> binary((size_t)length);
+            GLsizei written = 0;
+            GLenum format = GL_NONE;
+            glGetProgramBinary(this->m_id, length, &written, &format, binary.data());
+            binary.resize((size_t)std::max(written, 0));
+            if (binary.empty()) {
+                return;
+            }
+            program_binary_header header;
+            memset(&header, 0, sizeof(program_binary_header));
+            header.magic = program_binary_magic;
+            header.version = program_binary_version;
+            header.key = key;
+            header.format = (uint32_t)format;
+            binary_writer writer;
+            writer.write(header);
+            writer.write_array(binary);
+            try {
+                std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+                writer.save(path);
+            } catch (const std::exception& exc) {
+                spdlog::warn("Could not write program binary " + path + ": " + exc.what());
+            }
+        }
         shader::~shader() {
-            if (!_context_destroyed_)
+            if (!_context_destroyed_) {
                 glDeleteProgram(this->m_id);
+                state_tracker::get().on_program_deleted(this->m_id);
+            }
         }
         void shader::bind() {
-            glUseProgram(this->m_id);
+            state_tracker::get().use_program(this->m_id);
         }
         void shader::unbind() {
-            glUseProgram(0);
+            state_tracker::get().use_program(0);
         }
         GLuint shader::get() {
             return this->m_id;
         }
+        bool shader::uses_camera_buffer() const {
+            return this->m_uses_camera_buffer;
+        }
+        uniform_handle shader::get_uniform_handle(const std::string& name) const {
+            uniform_handle handle;
+            auto it = this->m_uniform_indices.find(name);
+            if (it != this->m_uniform_indices.end()) {
+                handle.index = it->second;
+            }
+            return handle;
+        }
+        GLuint shader::get_uniform_block_index(const std::string& name) const {
+            auto it = this->m_uniform_blocks.find(name);
+            if (it == this->m_uniform_blocks.end()) {
+                return GL_INVALID_INDEX;
+            }
+            return it->second;
+        }
         void shader::uniform_int(const std::string& name, GLint value) {
-            glUniform1i(this->get_uniform_location(name), value);
+            this->uniform_int(this->get_uniform_handle(name), value);
         }
         void shader::uniform_uint(const std::string& name, GLuint value) {
-            glUniform1ui(this->get_uniform_location(name), value);
+            this->uniform_uint(this->get_uniform_handle(name), value);
         }
         void shader::uniform_float(const std::string& name, GLfloat value) {
-            glUniform1f(this->get_uniform_location(name), value);
+            this->uniform_float(this->get_uniform_handle(name), value);
         }
         void shader::uniform_vec2(const std::string& name, const glm::vec2& value) {
-            glUniform2f(this->get_uniform_location(name), value.x, value.y);
+            this->uniform_vec2(this->get_uniform_handle(name), value);
         }
         void shader::uniform_vec3(const std::string& name, const glm::vec3& value) {
-            glUniform3f(this->get_uniform_location(name), value.x, value.y, value.z);
+            this->uniform_vec3(this->get_uniform_handle(name), value);
         }
         void shader::uniform_vec4(const std::string& name, const glm::vec4& value) {
-            glUniform4f(this->get_uniform_location(name), value.x, value.y, value.z, value.w);
+            this->uniform_vec4(this->get_uniform_handle(name), value);
         }
         void shader::uniform_mat4(const std::string& name, const glm::mat4& value, bool transpose) {
-            glUniformMatrix4fv(this->get_uniform_location(name), 1, transpose, glm::value_ptr(value));
+            this->uniform_mat4(this->get_uniform_handle(name), value, transpose);
+        }
+        template<typename T> bool shader::should_update(uniform_handle handle, const T& value) {
+            static_assert(sizeof(T) <= sizeof(uniform_slot::value), "uniform values must fit in the cache");
+            if (!handle.is_valid()) {
+                return false;
+            }
+            auto& slot = this->m_uniforms[(size_t)handle.index];
+            if (slot.has_value && memcmp(slot.value, &value, sizeof(T)) == 0) {
+                this->m_statistics.uniform_updates_elided++;
+                return false;
+            }
+            memcpy(slot.value, &value, sizeof(T));
+            slot.has_value = true;
+            this->m_statistics.uniform_updates++;
+            return true;
+        }
+        void shader::uniform_int(uniform_handle handle, GLint value) {
+            if (this->should_update(handle, value)) {
+                glUniform1i(this->m_uniforms[(size_t)handle.index].location, value);
+            }
+        }
+        void shader::uniform_uint(uniform_handle handle, GLuint value) {
+            if (this->should_update(handle, value)) {
+                glUniform1ui(this->m_uniforms[(size_t)handle.index].location, value);
+            }
+        }
+        void shader::uniform_float(uniform_handle handle, GLfloat value) {
+            if (this->should_update(handle, value)) {
+                glUniform1f(this->m_uniforms[(size_t)handle.index].location, value);
+            }
+        }
+        void shader::uniform_vec2(uniform_handle handle, const glm::vec2& value) {
+            if (this->should_update(handle, value)) {
+                glUniform2f(this->m_uniforms[(size_t)handle.index].location, value.x, value.y);
+            }
+        }
+        void shader::uniform_vec3(uniform_handle handle, const glm::vec3& value) {
+            if (this->should_update(handle, value)) {
+                glUniform3f(this->m_uniforms[(size_t)handle.index].location, value.x, value.y, value.z);
+            }
+        }
+        void shader::uniform_vec4(uniform_handle handle, const glm::vec4& value) {
+            if (this->should_update(handle, value)) {
+                glUniform4f(this->m_uniforms[(size_t)handle.index].location, value.x, value.y, value.z, value.w);
+            }
+        }
+        void shader::uniform_mat4(uniform_handle handle, const glm::mat4& value, bool transpose) {
+            // the cache holds the matrix as opengl sees it
+            glm::mat4 matrix = transpose ? glm::transpose(value) : value;
+            if (this->should_update(handle, matrix)) {
+                glUniformMatrix4fv(this->m_uniforms[(size_t)handle.index].location, 1, GL_FALSE, glm::value_ptr(matrix));
+            }
+        }
+        void shader::uniform_mat4_array(uniform_handle first, const glm::mat4* values, size_t count) {
+            if (!first.is_valid() || count == 0) {
+                return;
+            }
+            // elements are reflected in order, so their cached values follow the first one
+            size_t end = std::min((size_t)first.index + count, this->m_uniforms.size());
+            for (size_t i = (size_t)first.index; i < end; i++) {
+                this->m_uniforms[i].has_value = false;
+            }
+            glUniformMatrix4fv(this->m_uniforms[(size_t)first.index].location, (GLsizei)count, GL_FALSE, glm::value_ptr(values[0]));
+            this->m_statistics.uniform_updates++;
+        }
+        const shader::statistics& shader::get_statistics() const {
+            return this->m_statistics;
+        }
+        void shader::reset_statistics() {
+            this->m_statistics = statistics();
+        }
+        void shader::reflect() {
+            GLint uniform_count = 0, max_name_length = 0;
+            glGetProgramiv(this->m_id, GL_ACTIVE_UNIFORMS, &uniform_count);
+            glGetProgramiv(this->m_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+            std::vector<GLchar> name_buffer((size_t)std::max(max_name_length, 1));
+            for (GLint i = 0; i < uniform_count; i++) {
+                GLsizei length = 0;
+                GLint size = 0;
+                GLenum type = GL_NONE;
+                glGetActiveUniform(this->m_id, (GLuint)i, (GLsizei)name_buffer.size(), &length, &size, &type, name_buffer.data());
+                std::string name(name_buffer.data(), (size_t)length);
+                GLint location = glGetUniformLocation(this->m_id, name.c_str());
+                if (location == -1) {
+                    // members of uniform blocks have no location
+                    continue;
+                }
+                if (name.back() != ']') {
+                    this->add_uniform(name, location, type);
+                    continue;
+                }
+                // arrays are reported once, as "name[0]"; the base name refers to the first element
+                std::string base_name = name.substr(0, name.rfind('['));
+                for (GLint element = 0; element < size; element++) {
+                    std::string element_name = base_name + "[" + std::to_string(element) + "]";
+                    GLint element_location = element == 0 ? location : glGetUniformLocation(this->m_id, element_name.c_str());
+                    if (element_location != -1) {
+                        this->add_uniform(element_name, element_location, type);
+                    }
+                }
+                if (this->m_uniform_indices.find(name) != this->m_uniform_indices.end()) {
+                    this->m_uniform_indices[base_name] = this->m_uniform_indices[name];
+                }
+            }
+            GLint block_count = 0, max_block_name_length = 0;
+            glGetProgramiv(this->m_id, GL_ACTIVE_UNIFORM_BLOCKS, &block_count);
+            glGetProgramiv(this->m_id, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_block_name_length);
+            name_buffer.resize((size_t)std::max(max_block_name_length, 1));
+            for (GLint i = 0; i < block_count; i++) {
+                GLsizei length = 0;
+                glGetActiveUniformBlockName(this->m_id, (GLuint)i, (GLsizei)name_buffer.size(), &length, name_buffer.data());
+                this->m_uniform_blocks[std::string(name_buffer.data(), (size_t)length)] = (GLuint)i;
+            }
         }
-        GLint shader::get_uniform_location(const std::string& name) {
-            return glGetUniformLocation(this->m_id, name.c_str());
+        void shader::add_uniform(const std::string& name, GLint location, GLenum type) {
+            uniform_slot slot;
+            slot.location = location;
+            slot.type = type;
+            this->m_uniform_indices[name] = (int32_t)this->m_uniforms.size();
+            this->m_uniforms.push_back(slot);
         }
     }
 }
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include "libglppch.h"
+#include "state_tracker.h"
+namespace libplayground {
+    namespace gl {
+        using tracker_map = std::unordered_map<GLFWwindow*, std::unique_ptr<state_tracker>>;
+        static tracker_map& get_trackers() {
+            // intentionally leaked; gl objects and windows may be destroyed during static destruction
+            static tracker_map* trackers = new tracker_map;
+            return *trackers;
+        }
+        state_tracker& state_tracker::get() {
+            auto& trackers = get_trackers();
+            GLFWwindow* context = glfwGetCurrentContext();
+            auto it = trackers.find(context);
+            if (it == trackers.end()) {
+                it = trackers.insert({ context, std::make_unique<state_tracker>() }).first;
+            }
+            return *it->second;
+        }
+        void state_tracker::remove(GLFWwindow* context) {
+            get_trackers().erase(context);
+        }
+        state_tracker::state_tracker() {
+            this->invalidate();
+        }
+        void state_tracker::use_program(GLuint program) {
+            if (this->m_program == program) {
+                this->m_statistics.program_binds_elided++;
+                return;
+            }
+            glUseProgram(program);
+            this->m_program = program;
+            this->m_statistics.program_binds++;
+        }
+        void state_tracker::bind_vertex_array(GLuint vertex_array) {
+            if (this->m_vertex_array == vertex_array) {
+                this->m_statistics.vertex_array_binds_elided++;
+                return;
+            }
+            glBindVertexArray(vertex_array);
+            this->m_vertex_array = vertex_array;
+            // the element array buffer binding belongs to the vertex array
+            this->m_element_array_buffer = unknown;
+            this->m_statistics.vertex_array_binds++;
+        }
+        void state_tracker::bind_buffer(GLenum target, GLuint buffer) {
+            GLuint* current;
+            switch (target) {
+            case GL_ARRAY_BUFFER:
+                current = &this->m_array_buffer;
+                break;
+            case GL_ELEMENT_ARRAY_BUFFER:
+                current = &this->m_element_array_buffer;
+                break;
+            default:
+            {
+                auto it = this->m_buffers.find(target);
+                if (it == this->m_buffers.end()) {
+                    it = this->m_buffers.insert({ target, unknown }).first;
+                }
+                current = &it->second;
+            }
+                break;
+            }
+            if (*current == buffer) {
+                this->m_statistics.buffer_binds_elided++;
+                return;
+            }
+            glBindBuffer(target, buffer);
+            *current = buffer;
+            this->m_statistics.buffer_binds++;
+        }
+        void state_tracker::active_texture(uint32_t slot) {
+            if (this->m_active_texture == slot) {
+                this->m_statistics.active_texture_changes_elided++;
+                return;
+            }
+            glActiveTexture(GL_TEXTURE0 + (GLenum)slot);
+            this->m_active_texture = slot;
+            this->m_statistics.active_texture_changes++;
+        }
+        void state_tracker::bind_texture(GLenum target, GLuint texture) {
+            if (this->m_active_texture == (uint32_t)unknown) {
+                // the active unit has never been set through the tracker; make it known
+                this->active_texture(0);
+            }
+            uint64_t key = ((uint64_t)this->m_active_texture << 32) | (uint64_t)target;
+            auto it = this->m_textures.find(key);
+            if (it != this->m_textures.end() && it->second == texture) {
+                this->m_statistics.texture_binds_elided++;
+                return;
+            }
+            glBindTexture(target, texture);
+            this->m_textures[key] = texture;
+            this->m_statistics.texture_binds++;
+        }
+        void state_tracker::bind_texture(uint32_t slot, GLenum target, GLuint texture) {
+            uint64_t key = ((uint64_t)slot << 32) | (uint64_t)target;
+            auto it = this->m_textures.find(key);
+            if (it != this->m_textures.end() && it->second == texture) {
+                // no need to switch units either
+                this->m_statistics.texture_binds_elided++;
+                return;
+            }
+            this->active_texture(slot);
+            this->bind_texture(target, texture);
+        }
+        void state_tracker::on_program_deleted(GLuint program) {
+            if (this->m_program == program) {
+                this->m_program = unknown;
+            }
+        }
+        void state_tracker::on_vertex_array_deleted(GLuint vertex_array) {
+            if (this->m_vertex_array == vertex_array) {
+                this->m_vertex_array = 0;
+                this->m_element_array_buffer = unknown;
+            }
+        }
+        void state_tracker::on_buffer_deleted(GLuint buffer) {
+            if (this->m_array_buffer == buffer) {
+                this->m_array_buffer = 0;
+            }
+            // it may still be referenced by a vertex array other than the bound one
+            if (this->m_element_array_buffer == buffer) {
+                this->m_element_array_buffer = unknown;
+            }
+            for (auto& pair : this->m_buffers) {
+                if (pair.second == buffer) {
+                    pair.second = 0;
+                }
+            }
+        }
+        void state_tracker::on_texture_deleted(GLuint texture) {
+            for (auto& pair : this->m_textures) {
+                if (pair.second == texture) {
+                    pair.second = 0;
+                }
+            }
+        }
+        void state_tracker::invalidate() {
+            this->m_program = unknown;
+            this->m_vertex_array = unknown;
+            this->m_array_buffer = unknown;
+            this->m_element_array_buffer = unknown;
+            this->m_buffers.clear();
+            this->m_active_texture = (uint32_t)unknown;
+            this->m_textures.clear();
+        }
+        const state_tracker::statistics& state_tracker::get_statistics() const {
+            return this->m_statistics;
+        }
+        void state_tracker::reset_statistics() {
+            this->m_statistics = statistics();
+        }
+    }
+}
\ No newline at end of file
@@ -1,63 +1,874 @@
 #include "libglppch.h"
 #include "texture.h"
+#include "state_tracker.h"
+#include "thread_pool.h"
+#include "main_thread_queue.h"
+#include "cooked_file.h"
 #ifdef SHARED_ASSIMP
 #define STB_IMAGE_IMPLEMENTATION
 #endif
 #include <stb_image.h>
 namespace libplayground {
     namespace gl {
-        texture::texture(const std::vector<uint8_t>& data, int32_t width, int32_t height, int32_t channels, const settings& s) {
+        extern bool _context_destroyed_;
+        using texture_compression::format;
+        struct texture::image_layout {
+            struct level {
+                int32_t width, height;
+                size_t offset, size;
+            };
+            format block_format = format::none;
+            int32_t channels = 0; // for format::none
+            bool generate_mips = false; // a single level; the driver makes the rest
+            std::vector<level> levels;
+            size_t size = 0;
+        };
+        static texture::image_layout make_layout(format block_format, int32_t width, int32_t height, int32_t channels, uint32_t level_count) {
+            texture::image_layout layout;
+            layout.block_format = block_format;
+            layout.channels = channels;
+            layout.generate_mips = false;
+            layout.size = 0;
+            for (uint32_t i = 0; i < level_count; i++) {
+                texture::image_layout::level l;
+                l.width = std::max(width >> i, 1);
+                l.height = std::max(height >> i, 1);
+                l.offset = layout.size;
+                l.size = texture_compression::get_level_size(block_format, l.width, l.height, channels);
+                layout.size += l.size;
+                layout.levels.push_back(l);
+            }
+            return layout;
+        }
+        static size_t get_mip_chain_size(size_t width, size_t height, size_t channels) {
+            size_t size = 0;
+            for (size_t w = width, h = height; ; w = std::max(w / 2, (size_t)1), h = std::max(h / 2, (size_t)1)) {
+                size += w * h * channels;
+                if (w == 1 && h == 1) {
+                    break;
+                }
+            }
+            return size;
+        }
+        // from ext_texture_compression_s3tc and arb_texture_compression_bptc, which glad may have been generated without
+        constexpr GLenum compressed_rgba_s3tc_dxt1 = 0x83f1;
+        constexpr GLenum compressed_rgba_s3tc_dxt5 = 0x83f3;
+        constexpr GLenum compressed_rgba_bptc_unorm = 0x8e8c;
+        static bool has_extension(const char* name) {
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count; i++) {
+                const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+                if (extension && strcmp(extension, name) == 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        // rgtc (bc4 and bc5) is core since opengl 3.0
+        static bool is_format_supported(format block_format) {
+            static const bool s3tc = has_extension("GL_EXT_texture_compression_s3tc");
+            static const bool bptc = has_extension("GL_ARB_texture_compression_bptc");
+            switch (block_format) {
+            case format::bc1:
+            case format::bc3:
+                return s3tc;
+            case format::bc7:
+                return bptc;
+            default:
+                return true;
+            }
+        }
+        // srgb data is sampled as stored, like images loaded through stb_image; the renderer does no gamma correction
+        static GLint get_internal_format(format block_format, int32_t channels) {
+            switch (block_format) {
+            case format::bc1:
+                return compressed_rgba_s3tc_dxt1;
+            case format::bc3:
+                return compressed_rgba_s3tc_dxt5;
+            case format::bc4:
+                return GL_COMPRESSED_RED_RGTC1;
+            case format::bc5:
+                return GL_COMPRESSED_RG_RGTC2;
+            case format::bc7:
+                return compressed_rgba_bptc_unorm;
+            default:
+                break;
+            }
+            switch (channels) {
+            case 1:
+                return GL_R8;
+            case 2:
+                return GL_RG;
+            case 3:
+                return GL_RGB;
+            default:
+                return GL_RGBA;
+            }
+        }
+        static GLenum get_pixel_format(GLint internal_format, GLenum override_format) {
+            if (override_format) {
+                return override_format;
+            }
+            return internal_format == GL_R8 ? GL_RED : (GLenum)internal_format;
+        }
+        // the layout that is actually uploaded; bc1 to bc5 are decompressed if the context cannot sample them
+        static texture::image_layout get_upload_layout(const texture::image_layout& layout) {
+            if (is_format_supported(layout.block_format)) {
+                return layout;
+            }
+            if (layout.block_format == format::bc7) {
+                throw std::runtime_error("BC7 textures are not supported by this context!");
+            }
+            const auto& base = layout.levels[0];
+            int32_t channels = texture_compression::get_channel_count(layout.block_format);
+            return make_layout(format::none, base.width, base.height, channels, (uint32_t)layout.levels.size());
+        }
+        static void copy_levels(const texture::image_layout& source_layout, const uint8_t* source, const texture::image_layout& layout, uint8_t* destination) {
+            if (source_layout.block_format == layout.block_format) {
+                memcpy(destination, source, layout.size);
+                return;
+            }
+            for (size_t i = 0; i < layout.levels.size(); i++) {
+                const auto& l = layout.levels[i];
+                texture_compression::decompress(source_layout.block_format, source + source_layout.levels[i].offset, l.width, l.height, destination + l.offset);
+            }
+        }
+        // dds, with or without the dx10 header; only plain 2d textures
+        constexpr uint32_t dds_magic = 0x20534444; // "DDS "
+        constexpr uint32_t dds_flag_caps = 0x1, dds_flag_height = 0x2, dds_flag_width = 0x4, dds_flag_pitch = 0x8;
+        constexpr uint32_t dds_flag_pixel_format = 0x1000, dds_flag_mip_map_count = 0x20000, dds_flag_linear_size = 0x80000;
+        constexpr uint32_t dds_pixel_format_alpha = 0x1, dds_pixel_format_four_cc = 0x4, dds_pixel_format_rgb = 0x40, dds_pixel_format_luminance = 0x20000;
+        constexpr uint32_t dds_caps_complex = 0x8, dds_caps_texture = 0x1000, dds_caps_mip_map = 0x400000;
+        constexpr uint32_t dds_caps2_cube_map = 0x200, dds_caps2_volume = 0x200000;
+        constexpr uint32_t dds_dimension_texture_2d = 3;
+        static constexpr uint32_t make_four_cc(char a, char b, char c, char d) {
+            return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8) | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+        }
+        enum class dxgi_format : uint32_t {
+            r8g8b8a8_unorm = 28,
+            r8g8b8a8_unorm_srgb = 29,
+            r8g8_unorm = 49,
+            r8_unorm = 61,
+            bc1_unorm = 71,
+            bc1_unorm_srgb = 72,
+            bc3_unorm = 77,
+            bc3_unorm_srgb = 78,
+            bc4_unorm = 80,
+            bc5_unorm = 83,
+            bc7_unorm = 98,
+            bc7_unorm_srgb = 99,
+        };
+        struct dds_pixel_format {
+            uint32_t size, flags, four_cc, rgb_bit_count, r_mask, g_mask, b_mask, a_mask;
+        };
+        struct dds_header {
+            uint32_t size, flags, height, width, pitch_or_linear_size, depth, mip_map_count, reserved1[11];
+            dds_pixel_format pixel_format;
+            uint32_t caps, caps2, caps3, caps4, reserved2;
+        };
+        struct dds_header_dx10 {
+            uint32_t dxgi_format, resource_dimension, misc_flag, array_size, misc_flags2;
+        };
+        static bool from_dxgi_format(uint32_t value, format& block_format, int32_t& channels) {
+            channels = 4;
+            switch ((dxgi_format)value) {
+            case dxgi_format::r8g8b8a8_unorm:
+            case dxgi_format::r8g8b8a8_unorm_srgb:
+                block_format = format::none;
+                return true;
+            case dxgi_format::r8g8_unorm:
+                block_format = format::none;
+                channels = 2;
+                return true;
+            case dxgi_format::r8_unorm:
+                block_format = format::none;
+                channels = 1;
+                return true;
+            case dxgi_format::bc1_unorm:
+            case dxgi_format::bc1_unorm_srgb:
+                block_format = format::bc1;
+                return true;
+            case dxgi_format::bc3_unorm:
+            case dxgi_format::bc3_unorm_srgb:
+                block_format = format::bc3;
+                return true;
+            case dxgi_format::bc4_unorm:
+                block_format = format::bc4;
+                return true;
+            case dxgi_format::bc5_unorm:
+                block_format = format::bc5;
+                return true;
+            case dxgi_format::bc7_unorm:
+            case dxgi_format::bc7_unorm_srgb:
+                block_format = format::bc7;
+                return true;
+            default:
+                return false;
+            }
+        }
+        static bool from_legacy_pixel_format(const dds_pixel_format& pixel_format, format& block_format, int32_t& channels) {
+            channels = 4;
+            if (pixel_format.flags & dds_pixel_format_four_cc) {
+                switch (pixel_format.four_cc) {
+                case make_four_cc('D', 'X', 'T', '1'):
+                    block_format = format::bc1;
+                    return true;
+                case make_four_cc('D', 'X', 'T', '5'):
+                    block_format = format::bc3;
+                    return true;
+                case make_four_cc('A', 'T', 'I', '1'):
+                case make_four_cc('B', 'C', '4', 'U'):
+                    block_format = format::bc4;
+                    return true;
+                case make_four_cc('A', 'T', 'I', '2'):
+                case make_four_cc('B', 'C', '5', 'U'):
+                    block_format = format::bc5;
+                    return true;
+                default:
+                    return false;
+                }
+            }
+            block_format = format::none;
+            if ((pixel_format.flags & dds_pixel_format_rgb) && pixel_format.rgb_bit_count == 32 && pixel_format.r_mask == 0xff && pixel_format.g_mask == 0xff00 &&
+                pixel_format.b_mask == 0xff0000 && ((pixel_format.flags & dds_pixel_format_alpha) == 0 || pixel_format.a_mask == 0xff000000)) {
+                return true;
+            }
+            if ((pixel_format.flags & dds_pixel_format_luminance) && pixel_format.rgb_bit_count == 8) {
+                channels = 1;
+                return true;
+            }
+            return false;
+        }
+        // data only has to hold the headers; file_size is checked against the levels they describe
+        static texture::image_layout read_dds_layout(const uint8_t* data, size_t size, size_t file_size, size_t& data_offset) {
+            binary_reader reader(data, size);
+            if (reader.read<uint32_t>() != dds_magic) {
+                throw std::runtime_error("Not a DDS file!");
+            }
+            auto header = reader.read<dds_header>();
+            if (header.size != sizeof(dds_header) || header.width == 0 || header.height == 0) {
+                throw std::runtime_error("Invalid DDS header!");
+            }
+            if ((header.caps2 & (dds_caps2_cube_map | dds_caps2_volume)) != 0) {
+                throw std::runtime_error("Only 2D DDS textures are supported!");
+            }
+            format block_format;
+            int32_t channels;
+            bool known_format;
+            bool has_extension_header = (header.pixel_format.flags & dds_pixel_format_four_cc) && header.pixel_format.four_cc == make_four_cc('D', 'X', '1', '0');
+            if (has_extension_header) {
+                auto extension = reader.read<dds_header_dx10>();
+                if (extension.resource_dimension != dds_dimension_texture_2d || extension.array_size > 1) {
+                    throw std::runtime_error("Only 2D DDS textures are supported!");
+                }
+                known_format = from_dxgi_format(extension.dxgi_format, block_format, channels);
+            } else {
+                known_format = from_legacy_pixel_format(header.pixel_format, block_format, channels);
+            }
+            if (!known_format) {
+                throw std::runtime_error("Unsupported DDS pixel format!");
+            }
+            data_offset = sizeof(uint32_t) + sizeof(dds_header) + (has_extension_header ? sizeof(dds_header_dx10) : 0);
+            uint32_t level_count = (header.flags & dds_flag_mip_map_count) && header.mip_map_count > 0 ? header.mip_map_count : 1;
+            level_count = std::min(level_count, texture_compression::get_mip_count((int32_t)header.width, (int32_t)header.height));
+            auto layout = make_layout(block_format, (int32_t)header.width, (int32_t)header.height, channels, level_count);
+            if (layout.size > file_size - std::min(data_offset, file_size)) {
+                throw std::runtime_error("DDS file is truncated!");
+            }
+            return layout;
+        }
+        static bool is_cooked_path(const std::string& path) {
+            std::string extension = std::filesystem::path(path).extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+            return extension == texture::cooked_extension;
+        }
+        texture::texture(const settings& s) {
             glGenTextures(1, &this->m_id);
             this->m_target = s.target ? s.target : GL_TEXTURE_2D;
-            glBindTexture(this->m_target, this->m_id);
+            this->m_format = s.format;
+            this->m_settings = s;
+            this->m_width = this->m_height = this->m_channels = 0;
+            this->m_layer_count = 0;
+            this->m_memory_usage = 0;
+            this->m_ready = false;
+            this->apply_settings();
+        }
+        void texture::apply_settings() {
+            const auto& s = this->m_settings;
+            state_tracker::get().bind_texture(this->m_target, this->m_id);
 #define TEXPARAMETERI(name, field, default_value) glTexParameteri(this->m_target, name, s.field ? s.field : default_value)
             TEXPARAMETERI(GL_TEXTURE_MIN_FILTER, min_filter, GL_LINEAR);
             TEXPARAMETERI(GL_TEXTURE_MAG_FILTER, mag_filter, GL_LINEAR);
             TEXPARAMETERI(GL_TEXTURE_WRAP_S, wrap_s, GL_CLAMP_TO_EDGE);
             TEXPARAMETERI(GL_TEXTURE_WRAP_T, wrap_t, GL_CLAMP_TO_EDGE);
 #undef TEXPARAMETERI
-            GLint internal_format;
-            switch (channels) {
-            case 1:
-                internal_format = GL_R8;
-                break;
-            case 2:
-                internal_format = GL_RG;
-                break;
-            case 3:
-                internal_format = GL_RGB;
-                break;
-            case 4:
-                internal_format = GL_RGBA;
-                break;
-            }
-            GLenum format = s.format ? s.format : (GLenum)internal_format;
-            glTexImage2D(this->m_target, 0, internal_format, (GLsizei)width, (GLsizei)height, 0, format, GL_UNSIGNED_BYTE, data.data());
-            glGenerateMipmap(this->m_target);
+        }
+        texture::texture(const std::vector<uint8_t>& data, int32_t width, int32_t height, int32_t channels, const settings& s) : texture(s) {
+            this->set_image(data.data(), width, height, channels);
         }
         texture::~texture() {
-            glDeleteTextures(1, &this->m_id);
+            if (!_context_destroyed_) {
+                glDeleteTextures(1, &this->m_id);
+                state_tracker::get().on_texture_deleted(this->m_id);
+            }
+        }
+        void texture::set_levels(const image_layout& layout, const uint8_t* data) {
+            GLint internal_format = get_internal_format(layout.block_format, layout.channels);
+            state_tracker::get().bind_texture(this->m_target, this->m_id);
+            // decoded rows are tightly packed
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            for (size_t i = 0; i < layout.levels.size(); i++) {
+                const auto& l = layout.levels[i];
+                // with a pixel unpack buffer bound, this is an offset into it
+                const void* level_data = (const void*)((uintptr_t)data + l.offset);
+                if (layout.block_format == format::none) {
+                    GLenum pixel_format = get_pixel_format(internal_format, this->m_format);
+                    glTexImage2D(this->m_target, (GLint)i, internal_format, (GLsizei)l.width, (GLsizei)l.height, 0, pixel_format, GL_UNSIGNED_BYTE, level_data);
+                } else {
+                    glCompressedTexImage2D(this->m_target, (GLint)i, (GLenum)internal_format, (GLsizei)l.width, (GLsizei)l.height, 0, (GLsizei)l.size, level_data);
+                }
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            // a texture can be given a shorter chain than it had before, e.g. a streamed texture's placeholder
+            glTexParameteri(this->m_target, GL_TEXTURE_MAX_LEVEL, layout.generate_mips ? 1000 : (GLint)layout.levels.size() - 1);
+            if (layout.generate_mips) {
+                glGenerateMipmap(this->m_target);
+                const auto& base = layout.levels[0];
+                this->m_memory_usage = get_mip_chain_size((size_t)base.width, (size_t)base.height, (size_t)layout.channels);
+            } else {
+                this->m_memory_usage = layout.size;
+            }
+            this->m_ready = true;
+        }
+        void texture::set_image(const void* data, int32_t width, int32_t height, int32_t channels) {
+            auto layout = make_layout(format::none, width, height, channels, 1);
+            layout.generate_mips = true;
+            this->set_levels(layout, (const uint8_t*)data);
         }
         void texture::bind(uint32_t slot) {
-            glActiveTexture(GL_TEXTURE0 + (GLenum)slot);
-            glBindTexture(this->m_target, this->m_id);
+            state_tracker::get().bind_texture(slot, this->m_target, this->m_id);
         }
         GLuint texture::get() {
             return this->m_id;
         }
+        size_t texture::get_memory_usage() const {
+            return this->m_memory_usage;
+        }
+        bool texture::is_ready() const {
+            return this->m_ready;
+        }
+        uint32_t texture::get_layer_count() const {
+            return this->m_layer_count;
+        }
+        ref<texture> texture::create_array(int32_t width, int32_t height, int32_t channels, uint32_t layer_count, const settings& s) {
+            settings array_settings = s;
+            array_settings.target = GL_TEXTURE_2D_ARRAY;
+            ref<texture> tex = ref<texture>(new texture(array_settings));
+            tex->m_width = width;
+            tex->m_height = height;
+            tex->m_channels = channels;
+            tex->allocate_layers(layer_count);
+            tex->m_ready = true;
+            return tex;
+        }
+        // expects the texture to be bound
+        void texture::allocate_layers(uint32_t layer_count) {
+            GLint internal_format = get_internal_format(format::none, this->m_channels);
+            GLenum pixel_format = get_pixel_format(internal_format, this->m_format);
+            uint32_t level_count = texture_compression::get_mip_count(this->m_width, this->m_height);
+            for (uint32_t i = 0; i < level_count; i++) {
+                GLsizei width = (GLsizei)std::max(this->m_width >> i, 1);
+                GLsizei height = (GLsizei)std::max(this->m_height >> i, 1);
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)i, internal_format, width, height, (GLsizei)layer_count, 0, pixel_format, GL_UNSIGNED_BYTE, nullptr);
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint)level_count - 1);
+            this->m_layer_count = layer_count;
+            this->m_memory_usage = get_mip_chain_size((size_t)this->m_width, (size_t)this->m_height, (size_t)this->m_channels) * (size_t)layer_count;
+        }
+        void texture::set_layer(uint32_t layer, const uint8_t* pixels) {
+            if (this->m_target != GL_TEXTURE_2D_ARRAY || layer >= this->m_layer_count) {
+                throw std::runtime_error("Layer " + std::to_string(layer) + " is out of range!");
+            }
+            // regenerating mips on the gpu would redo every layer
+            bool srgb = this->m_channels >= 3;
+            auto levels = texture_compression::generate_mips(pixels, this->m_width, this->m_height, this->m_channels, texture_compression::mip_filter::box, srgb);
+            GLenum pixel_format = get_pixel_format(get_internal_format(format::none, this->m_channels), this->m_format);
+            state_tracker::get().bind_texture(this->m_target, this->m_id);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            for (size_t i = 0; i < levels.size(); i++) {
+                GLsizei width = (GLsizei)std::max(this->m_width >> i, 1);
+                GLsizei height = (GLsizei)std::max(this->m_height >> i, 1);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)i, 0, 0, (GLint)layer, width, height, 1, pixel_format, GL_UNSIGNED_BYTE, levels[i].data());
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+        void texture::set_layer_count(uint32_t layer_count) {
+            if (this->m_target != GL_TEXTURE_2D_ARRAY) {
+                throw std::runtime_error("Not an array texture!");
+            }
+            if (layer_count == this->m_layer_count) {
+                return;
+            }
+            // array storage cannot be resized in place; the layers are copied into a new texture
+            GLuint old_id = this->m_id;
+            uint32_t copied_layers = std::min(layer_count, this->m_layer_count);
+            glGenTextures(1, &this->m_id);
+            this->apply_settings();
+            this->allocate_layers(layer_count);
+            if (copied_layers > 0) {
+                // glCopyImageSubData needs opengl 4.3; reading through a framebuffer works on 3.3
+                GLuint framebuffer;
+                glGenFramebuffers(1, &framebuffer);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+                uint32_t level_count = texture_compression::get_mip_count(this->m_width, this->m_height);
+                for (uint32_t i = 0; i < level_count; i++) {
+                    GLsizei width = (GLsizei)std::max(this->m_width >> i, 1);
+                    GLsizei height = (GLsizei)std::max(this->m_height >> i, 1);
+                    for (uint32_t layer = 0; layer < copied_layers; layer++) {
+                        glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, old_id, (GLint)i, (GLint)layer);
+                        glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)i, 0, 0, (GLint)layer, 0, 0, width, height);
+                    }
+                }
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+                glDeleteFramebuffers(1, &framebuffer);
+            }
+            glDeleteTextures(1, &old_id);
+            state_tracker::get().on_texture_deleted(old_id);
+        }
         ref<texture> texture::from_file(const std::string& path) {
+            if (is_cooked_path(path)) {
+                auto file = ref<mapped_file>::create(path);
+                size_t data_offset;
+                image_layout file_layout;
+                try {
+                    file_layout = read_dds_layout(file->get_data(), file->get_size(), file->get_size(), data_offset);
+                } catch (const std::exception& exc) {
+                    throw std::runtime_error("Could not load image: " + path + " (" + exc.what() + ")");
+                }
+                image_layout layout = get_upload_layout(file_layout);
+                ref<texture> tex = ref<texture>(new texture(settings()));
+                const uint8_t* data = file->get_data() + data_offset;
+                if (layout.block_format == file_layout.block_format) {
+                    // straight from the mapping
+                    tex->set_levels(layout, data);
+                } else {
+                    std::vector<uint8_t> pixels(layout.size);
+                    copy_levels(file_layout, data, layout, pixels.data());
+                    tex->set_levels(layout, pixels.data());
+                }
+                return tex;
+            }
             int32_t width, height, channels;
             uint8_t* data = stbi_load(path.c_str(), &width, &height, &channels, 0);
-            ref<texture> tex;
-            if (data) {
-                std::vector<uint8_t> image_data(static_cast<size_t>(width * height * channels));
-                memcpy(image_data.data(), data, (size_t)width * (size_t)height * (size_t)channels * sizeof(uint8_t)); // todo: not this
-                settings s;
-                tex = ref<texture>::create(image_data, width, height, channels, s);
-            } else {
+            if (!data) {
                 throw std::runtime_error("Could not load image: " + path);
             }
+            ref<texture> tex = ref<texture>(new texture(settings()));
+            tex->set_image(data, width, height, channels);
+            stbi_image_free(data);
             return tex;
         }
+        void texture::cook(const std::string& source_path, const std::string& cooked_path, const cook_settings& s) {
+            int32_t width, height, channels;
+            std::unique_ptr<uint8_t, void(*)(void*)> data(stbi_load(source_path.c_str(), &width, &height, &channels, 0), stbi_image_free);
+            if (!data) {
+                throw std::runtime_error("Could not load image: " + source_path);
+            }
+            size_t pixel_count = (size_t)width * (size_t)height;
+            format block_format = s.format;
+            if (s.pick_format) {
+                switch (channels) {
+                case 1:
+                    block_format = format::bc4;
+                    break;
+                case 2:
+                    block_format = format::bc5;
+                    break;
+                case 3:
+                    block_format = format::bc1;
+                    break;
+                default:
+                    block_format = format::bc1;
+                    for (size_t i = 0; i < pixel_count; i++) {
+                        if (data.get()[i * 4 + 3] != 255) {
+                            block_format = format::bc3;
+                            break;
+                        }
+                    }
+                    break;
+                }
+            }
+            if (block_format == format::bc7) {
+                throw std::runtime_error("BC7 textures cannot be cooked!");
+            }
+            // dds has no 24 bit format
+            int32_t cooked_channels = block_format == format::none ? (channels == 3 ? 4 : channels) : texture_compression::get_channel_count(block_format);
+            std::vector<uint8_t> pixels(pixel_count * (size_t)cooked_channels);
+            for (size_t i = 0; i < pixel_count; i++) {
+                const uint8_t* source = data.get() + i * (size_t)channels;
+                for (int32_t c = 0; c < cooked_channels; c++) {
+                    uint8_t value;
+                    if (c < channels) {
+                        value = source[c];
+                    } else if (c == 3) {
+                        value = 255;
+                    } else {
+                        value = channels == 1 ? source[0] : 0; // grayscale to rgb
+                    }
+                    pixels[i * (size_t)cooked_channels + (size_t)c] = value;
+                }
+            }
+            data.reset();
+            bool color = cooked_channels == 4 && s.srgb;
+            auto levels = texture_compression::generate_mips(pixels.data(), width, height, cooked_channels, s.filter, color);
+            auto layout = make_layout(block_format, width, height, cooked_channels, (uint32_t)levels.size());
+            dds_header header;
+            memset(&header, 0, sizeof(dds_header));
+            header.size = sizeof(dds_header);
+            header.flags = dds_flag_caps | dds_flag_height | dds_flag_width | dds_flag_pixel_format | dds_flag_mip_map_count;
+            header.flags |= block_format == format::none ? dds_flag_pitch : dds_flag_linear_size;
+            header.height = (uint32_t)height;
+            header.width = (uint32_t)width;
+            header.pitch_or_linear_size = block_format == format::none ? (uint32_t)(width * cooked_channels) : (uint32_t)layout.levels[0].size;
+            header.mip_map_count = (uint32_t)levels.size();
+            header.pixel_format.size = sizeof(dds_pixel_format);
+            header.pixel_format.flags = dds_pixel_format_four_cc;
+            header.pixel_format.four_cc = make_four_cc('D', 'X', '1', '0');
+            header.caps = dds_caps_texture | (levels.size() > 1 ? dds_caps_mip_map | dds_caps_complex : 0);
+            dds_header_dx10 extension;
+            memset(&extension, 0, sizeof(dds_header_dx10));
+            switch (block_format) {
+            case format::bc1:
+                extension.dxgi_format = (uint32_t)(color ? dxgi_format::bc1_unorm_srgb : dxgi_format::bc1_unorm);
+                break;
+            case format::bc3:
+                extension.dxgi_format = (uint32_t)(color ? dxgi_format::bc3_unorm_srgb : dxgi_format::bc3_unorm);
+                break;
+            case format::bc4:
+                extension.dxgi_format = (uint32_t)dxgi_format::bc4_unorm;
+                break;
+            case format::bc5:
+                extension.dxgi_format = (uint32_t)dxgi_format::bc5_unorm;
+                break;
+            default:
+                switch (cooked_channels) {
+                case 1:
+                    extension.dxgi_format = (uint32_t)dxgi_format::r8_unorm;
+                    break;
+                case 2:
+                    extension.dxgi_format = (uint32_t)dxgi_format::r8g8_unorm;
+                    break;
+                default:
+                    extension.dxgi_format = (uint32_t)(color ? dxgi_format::r8g8b8a8_unorm_srgb : dxgi_format::r8g8b8a8_unorm);
+                    break;
+                }
+                break;
+            }
+            extension.resource_dimension = dds_dimension_texture_2d;
+            extension.array_size = 1;
+            binary_writer writer;
+            writer.write(dds_magic);
+            writer.write(header);
+            writer.write(extension);
+            std::vector<uint8_t> blocks;
+            for (size_t i = 0; i < levels.size(); i++) {
+                const auto& l = layout.levels[i];
+                if (block_format == format::none) {
+                    writer.write_bytes(levels[i].data(), levels[i].size());
+                } else {
+                    blocks.resize(l.size);
+                    texture_compression::compress(block_format, levels[i].data(), l.width, l.height, blocks.data());
+                    writer.write_bytes(blocks.data(), blocks.size());
+                }
+            }
+            writer.save(cooked_path);
+            size_t uncompressed_size = get_mip_chain_size((size_t)width, (size_t)height, (size_t)channels);
+            spdlog::info("Cooked " + source_path + ": " + std::to_string(levels.size()) + " level(s), " + std::to_string(uncompressed_size) + " -> " + std::to_string(layout.size) + " bytes");
+        }
+        // a streamed texture moves through these stages in order; everything but reading the file happens on the main thread
+        enum class upload_stage {
+            reading_header,
+            waiting_for_staging,
+            decoding,
+            decoded,
+            uploaded,
+        };
+        struct texture_upload {
+            ref<texture> destination; // released once the upload is issued
+            std::string path;
+            upload_stage stage;
+            bool cooked;
+            texture::image_layout file_layout, layout;
+            size_t data_offset;
+            GLuint buffer;
+            size_t size;
+            GLsync fence;
+            bool failed;
+            std::string error;
+        };
+        // a list, so that workers can hold on to pointers into it
+        static std::list<texture_upload> texture_uploads;
+        static size_t texture_upload_budget = 16 * 1024 * 1024;
+        static size_t pending_texture_count = 0;
+        // mapped staging memory is capped at a few frames' worth of uploads
+        constexpr size_t staging_budget_frames = 4;
+        static void release_staging_buffer(texture_upload& upload) {
+            if (upload.fence) {
+                glDeleteSync(upload.fence);
+                upload.fence = nullptr;
+            }
+            if (upload.buffer) {
+                glDeleteBuffers(1, &upload.buffer);
+                upload.buffer = 0;
+            }
+        }
+        // only the headers are read, so that the staging buffer can be sized
+        static texture::image_layout read_layout(const std::string& path, bool cooked, size_t& data_offset) {
+            data_offset = 0;
+            if (!cooked) {
+                int32_t width, height, channels;
+                if (!stbi_info(path.c_str(), &width, &height, &channels)) {
+                    throw std::runtime_error(stbi_failure_reason());
+                }
+                auto layout = make_layout(format::none, width, height, channels, 1);
+                layout.generate_mips = true;
+                return layout;
+            }
+            std::ifstream file(path, std::ios::binary);
+            if (!file.is_open()) {
+                throw std::runtime_error("Could not open file");
+            }
+            uint8_t headers[sizeof(uint32_t) + sizeof(dds_header) + sizeof(dds_header_dx10)];
+            file.read((char*)headers, sizeof(headers));
+            std::error_code error;
+            size_t file_size = (size_t)std::filesystem::file_size(path, error);
+            if (error) {
+                throw std::runtime_error("Could not get the size of the file");
+            }
+            return read_dds_layout(headers, (size_t)file.gcount(), file_size, data_offset);
+        }
+        // fills mapped staging memory; cooked levels that need no conversion are read from the file straight into it
+        static void read_levels(const std::string& path, bool cooked, const texture::image_layout& file_layout, size_t data_offset, const texture::image_layout& layout, uint8_t* destination) {
+            if (!cooked) {
+                int32_t width, height, channels;
+                uint8_t* data = stbi_load(path.c_str(), &width, &height, &channels, layout.channels);
+                if (!data) {
+                    throw std::runtime_error(stbi_failure_reason());
+                }
+                bool valid = (size_t)width * (size_t)height * (size_t)layout.channels == layout.size;
+                if (valid) {
+                    memcpy(destination, data, layout.size);
+                }
+                stbi_image_free(data);
+                if (!valid) {
+                    throw std::runtime_error("File changed while loading");
+                }
+                return;
+            }
+            std::ifstream file(path, std::ios::binary);
+            file.seekg((std::streamoff)data_offset);
+            if (layout.block_format == file_layout.block_format) {
+                file.read((char*)destination, (std::streamsize)layout.size);
+            } else {
+                std::vector<uint8_t> blocks(file_layout.size);
+                file.read((char*)blocks.data(), (std::streamsize)blocks.size());
+                if (file) {
+                    copy_levels(file_layout, blocks.data(), layout, destination);
+                }
+            }
+            if (!file) {
+                throw std::runtime_error("Could not read file");
+            }
+        }
+        ref<texture> texture::load_async(const std::string& path, const settings& s) {
+            ref<texture> tex = ref<texture>(new texture(s));
+            const uint8_t white[] = { 255, 255, 255, 255 };
+            tex->set_image(white, 1, 1, 4);
+            tex->m_ready = false;
+            texture_upload upload;
+            upload.destination = tex;
+            upload.path = path;
+            upload.stage = upload_stage::reading_header;
+            upload.cooked = is_cooked_path(path);
+            upload.data_offset = 0;
+            upload.buffer = 0;
+            upload.size = 0;
+            upload.fence = nullptr;
+            upload.failed = false;
+            texture_uploads.push_back(std::move(upload));
+            pending_texture_count++;
+            // the worker only gets a raw pointer; reference counts are not thread safe
+            texture_upload* instance = &texture_uploads.back();
+            std::string file_path = path;
+            bool cooked = instance->cooked;
+            thread_pool::get().submit([instance, file_path, cooked]() {
+                try {
+                    size_t data_offset;
+                    auto file_layout = read_layout(file_path, cooked, data_offset);
+                    main_thread_queue::post([instance, file_layout, data_offset]() {
+                        instance->file_layout = file_layout;
+                        instance->data_offset = data_offset;
+                        try {
+                            // needs the context, to see which formats it can sample
+                            instance->layout = get_upload_layout(file_layout);
+                        } catch (const std::exception& exc) {
+                            instance->failed = true;
+                            instance->error = exc.what();
+                            return;
+                        }
+                        instance->size = instance->layout.size;
+                        instance->stage = upload_stage::waiting_for_staging;
+                    });
+                } catch (const std::exception& exc) {
+                    std::string message = exc.what();
+                    main_thread_queue::post([instance, message]() {
+                        instance->failed = true;
+                        instance->error = message;
+                    });
+                }
+            });
+            return tex;
+        }
+        void texture::set_upload_budget(size_t bytes) {
+            texture_upload_budget = bytes;
+        }
+        size_t texture::get_upload_budget() {
+            return texture_upload_budget;
+        }
+        size_t texture::get_pending_count() {
+            return pending_texture_count;
+        }
+        void texture::cancel_streaming() {
+            // workers hold pointers into the list while they read headers or decode into a mapping
+            auto is_busy = [](const texture_upload& upload) {
+                return !upload.failed && (upload.stage == upload_stage::reading_header || upload.stage == upload_stage::decoding);
+            };
+            while (std::any_of(texture_uploads.begin(), texture_uploads.end(), is_busy)) {
+                main_thread_queue::flush();
+                std::this_thread::yield();
+            }
+            auto& tracker = state_tracker::get();
+            for (auto& upload : texture_uploads) {
+                // staging buffers stay mapped until their upload is issued
+                if (upload.buffer && upload.stage != upload_stage::uploaded) {
+                    tracker.bind_buffer(GL_PIXEL_UNPACK_BUFFER, upload.buffer);
+                    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                    tracker.bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                }
+                release_staging_buffer(upload);
+            }
+            texture_uploads.clear();
+            pending_texture_count = 0;
+        }
+        void texture::update_streaming() {
+            if (texture_uploads.empty()) {
+                return;
+            }
+            auto& tracker = state_tracker::get();
+            size_t staged_size = 0;
+            for (const auto& upload : texture_uploads) {
+                if (upload.stage == upload_stage::decoding || upload.stage == upload_stage::decoded) {
+                    staged_size += upload.size;
+                }
+            }
+            size_t staging_budget = texture_upload_budget * staging_budget_frames;
+            size_t uploaded_size = 0;
+            bool uploaded_any = false;
+            for (auto it = texture_uploads.begin(); it != texture_uploads.end();) {
+                auto& upload = *it;
+                if (upload.failed) {
+                    // the worker is done with the mapping by now
+                    if (upload.buffer) {
+                        tracker.bind_buffer(GL_PIXEL_UNPACK_BUFFER, upload.buffer);
+                        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                        tracker.bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                    }
+                    release_staging_buffer(upload);
+                    spdlog::error("Could not load image: " + upload.path + (upload.error.empty() ? "" : " (" + upload.error + ")"));
+                    pending_texture_count--;
+                    it = texture_uploads.erase(it);
+                    continue;
+                }
+                switch (upload.stage) {
+                case upload_stage::waiting_for_staging:
+                    // a single image larger than the budget still has to get through
+                    if (staging_budget > 0 && staged_size > 0 && staged_size + upload.size > staging_budget) {
+                        break;
+                    }
+                    {
+                        glGenBuffers(1, &upload.buffer);
+                        tracker.bind_buffer(GL_PIXEL_UNPACK_BUFFER, upload.buffer);
+                        glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)upload.size, nullptr, GL_STREAM_DRAW);
+                        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)upload.size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+                        tracker.bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                        if (!mapped) {
+                            release_staging_buffer(upload);
+                            upload.failed = true;
+                            upload.error = "Could not map a staging buffer";
+                            break;
+                        }
+                        staged_size += upload.size;
+                        upload.stage = upload_stage::decoding;
+                        texture_upload* instance = &upload;
+                        std::string path = upload.path;
+                        bool cooked = upload.cooked;
+                        auto file_layout = upload.file_layout;
+                        auto layout = upload.layout;
+                        size_t data_offset = upload.data_offset;
+                        thread_pool::get().submit([instance, path, cooked, file_layout, data_offset, layout, mapped]() {
+                            std::string message;
+                            try {
+                                read_levels(path, cooked, file_layout, data_offset, layout, (uint8_t*)mapped);
+                            } catch (const std::exception& exc) {
+                                message = exc.what();
+                            }
+                            main_thread_queue::post([instance, message]() {
+                                if (message.empty()) {
+                                    instance->stage = upload_stage::decoded;
+                                } else {
+                                    instance->failed = true;
+                                    instance->error = message;
+                                }
+                            });
+                        });
+                    }
+                    break;
+                case upload_stage::decoded:
+                    if (uploaded_any && texture_upload_budget > 0 && uploaded_size + upload.size > texture_upload_budget) {
+                        break;
+                    }
+                    tracker.bind_buffer(GL_PIXEL_UNPACK_BUFFER, upload.buffer);
+                    if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE) {
+                        upload.destination->set_levels(upload.layout, nullptr);
+                    } else {
+                        // the driver lost the contents; the placeholder stays
+                        spdlog::warn("Staging buffer for " + upload.path + " was corrupted");
+                    }
+                    tracker.bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                    // the buffer can only go once the gpu has copied out of it
+                    upload.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                    upload.destination.reset();
+                    upload.stage = upload_stage::uploaded;
+                    uploaded_size += upload.size;
+                    uploaded_any = true;
+                    pending_texture_count--;
+                    break;
+                case upload_stage::uploaded:
+                {
+                    GLenum status = glClientWaitSync(upload.fence, 0, 0);
+                    if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED || status == GL_WAIT_FAILED) {
+                        release_staging_buffer(upload);
+                        it = texture_uploads.erase(it);
+                        continue;
+                    }
+                }
+                    break;
+                default:
+                    break;
+                }
+                it++;
+            }
+        }
     }
-}
\ No newline at end of file
+}
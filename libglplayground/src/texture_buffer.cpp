@@ -0,0 +1,43 @@
+#include "libglppch.h"
+#include "texture_buffer.h"
+#include "state_tracker.h"
+namespace libplayground {
+    namespace gl {
+        extern bool _context_destroyed_;
+        texture_buffer::texture_buffer(GLenum internal_format) {
+            this->m_internal_format = internal_format;
+            this->m_capacity = 0;
+            glGenBuffers(1, &this->m_buffer);
+            glGenTextures(1, &this->m_texture);
+        }
+        texture_buffer::~texture_buffer() {
+            if (!_context_destroyed_) {
+                glDeleteTextures(1, &this->m_texture);
+                state_tracker::get().on_texture_deleted(this->m_texture);
+                glDeleteBuffers(1, &this->m_buffer);
+                state_tracker::get().on_buffer_deleted(this->m_buffer);
+            }
+        }
+        void texture_buffer::bind(uint32_t slot) {
+            state_tracker::get().bind_texture(slot, GL_TEXTURE_BUFFER, this->m_texture);
+        }
+        GLuint texture_buffer::get() {
+            return this->m_texture;
+        }
+        void texture_buffer::update(const void* data, size_t length) {
+            auto& tracker = state_tracker::get();
+            tracker.bind_buffer(GL_TEXTURE_BUFFER, this->m_buffer);
+            if (length > this->m_capacity) {
+                glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)length, data, GL_STREAM_DRAW);
+                bool attach = this->m_capacity == 0;
+                this->m_capacity = length;
+                if (attach) {
+                    tracker.bind_texture(GL_TEXTURE_BUFFER, this->m_texture);
+                    glTexBuffer(GL_TEXTURE_BUFFER, this->m_internal_format, this->m_buffer);
+                }
+            } else if (length > 0) {
+                glBufferSubData(GL_TEXTURE_BUFFER, 0, (GLsizeiptr)length, data);
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,434 @@
+#include "libglppch.h"
+#include "texture_compression.h"
+#include "thread_pool.h"
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define LIBGLPLAYGROUND_SSE
+#include <xmmintrin.h>
+#endif
+namespace libplayground {
+    namespace gl {
+        namespace texture_compression {
+            size_t get_block_size(format f) {
+                switch (f) {
+                case format::bc1:
+                case format::bc4:
+                    return 8;
+                case format::bc3:
+                case format::bc5:
+                case format::bc7:
+                    return 16;
+                default:
+                    return 0;
+                }
+            }
+            size_t get_level_size(format f, int32_t width, int32_t height, int32_t channels) {
+                if (f == format::none) {
+                    return (size_t)width * (size_t)height * (size_t)channels;
+                }
+                size_t blocks_x = ((size_t)width + 3) / 4, blocks_y = ((size_t)height + 3) / 4;
+                return blocks_x * blocks_y * get_block_size(f);
+            }
+            int32_t get_channel_count(format f) {
+                switch (f) {
+                case format::bc4:
+                    return 1;
+                case format::bc5:
+                    return 2;
+                default:
+                    return 4;
+                }
+            }
+            uint32_t get_mip_count(int32_t width, int32_t height) {
+                uint32_t count = 1;
+                for (int32_t size = std::max(width, height); size > 1; size /= 2) {
+                    count++;
+                }
+                return count;
+            }
+            // the same window as nvidia's texture tools use by default
+            constexpr float kaiser_width = 3.f;
+            constexpr float kaiser_alpha = 4.f;
+            static float bessel_i0(float x) {
+                float sum = 1.f, term = 1.f, half = x * 0.5f;
+                for (int32_t k = 1; k < 32; k++) {
+                    term *= half / (float)k;
+                    sum += term * term;
+                    if (term * term < sum * 1e-8f) {
+                        break;
+                    }
+                }
+                return sum;
+            }
+            static float sinc(float x) {
+                if (fabsf(x) < 1e-5f) {
+                    return 1.f;
+                }
+                x *= 3.14159265f;
+                return sinf(x) / x;
+            }
+            static float kaiser(float x) {
+                float t = std::max(1.f - x * x, 0.f);
+                return bessel_i0(kaiser_alpha * sqrtf(t)) / bessel_i0(kaiser_alpha);
+            }
+            struct filter_tap {
+                int32_t index;
+                float weight;
+            };
+            // the taps of every destination texel along one axis; taps past the edge are clamped onto it
+            static std::vector<std::vector<filter_tap>> compute_kernels(int32_t source_size, int32_t size, mip_filter filter) {
+                std::vector<std::vector<filter_tap>> kernels((size_t)size);
+                float scale = (float)source_size / (float)size;
+                float support = filter == mip_filter::box ? scale * 0.5f : kaiser_width * scale;
+                for (int32_t o = 0; o < size; o++) {
+                    float center = ((float)o + 0.5f) * scale;
+                    int32_t first = (int32_t)floorf(center - support), last = (int32_t)ceilf(center + support);
+                    auto& taps = kernels[(size_t)o];
+                    float total = 0.f;
+                    for (int32_t i = first; i <= last; i++) {
+                        float weight;
+                        if (filter == mip_filter::box) {
+                            weight = std::min(center + support, (float)(i + 1)) - std::max(center - support, (float)i);
+                        } else {
+                            float t = ((float)i + 0.5f - center) / scale;
+                            weight = fabsf(t) < kaiser_width ? sinc(t) * kaiser(t / kaiser_width) : 0.f;
+                        }
+                        if (filter == mip_filter::box ? weight <= 0.f : weight == 0.f) {
+                            continue;
+                        }
+                        taps.push_back({ std::clamp(i, 0, source_size - 1), weight });
+                        total += weight;
+                    }
+                    for (auto& tap : taps) {
+                        tap.weight /= total;
+                    }
+                }
+                return kernels;
+            }
+            // one rgba texel per sse register
+            static void apply_kernel(const glm::vec4* source, size_t stride, const std::vector<filter_tap>& taps, glm::vec4& destination) {
+#ifdef LIBGLPLAYGROUND_SSE
+                __m128 sum = _mm_setzero_ps();
+                for (const auto& tap : taps) {
+                    __m128 texel = _mm_loadu_ps(&source[(size_t)tap.index * stride].x);
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(tap.weight), texel));
+                }
+                _mm_storeu_ps(&destination.x, sum);
+#else
+                glm::vec4 sum = glm::vec4(0.f);
+                for (const auto& tap : taps) {
+                    sum += source[(size_t)tap.index * stride] * tap.weight;
+                }
+                destination = sum;
+#endif
+            }
+            static float srgb_to_linear(float value) {
+                return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+            }
+            static float linear_to_srgb(float value) {
+                return value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.f / 2.4f) - 0.055f;
+            }
+            std::vector<std::vector<uint8_t>> generate_mips(const uint8_t* pixels, int32_t width, int32_t height, int32_t channels, mip_filter filter, bool srgb) {
+                std::vector<std::vector<uint8_t>> levels;
+                levels.emplace_back(pixels, pixels + (size_t)width * (size_t)height * (size_t)channels);
+                // only rgb and rgba images hold colors; one and two channel images are data, like normal maps
+                int32_t color_channels = srgb && channels >= 3 ? 3 : 0;
+                float to_linear[256];
+                for (int32_t i = 0; i < 256; i++) {
+                    to_linear[i] = srgb_to_linear((float)i / 255.f);
+                }
+                // levels are filtered from the previous level before it was quantized
+                std::vector<glm::vec4> current((size_t)width * (size_t)height, glm::vec4(0.f));
+                for (size_t i = 0; i < current.size(); i++) {
+                    for (int32_t c = 0; c < channels; c++) {
+                        uint8_t value = pixels[i * (size_t)channels + (size_t)c];
+                        current[i][c] = c < color_channels ? to_linear[value] : (float)value / 255.f;
+                    }
+                }
+                auto& pool = thread_pool::get();
+                std::vector<glm::vec4> intermediate, next;
+                while (width > 1 || height > 1) {
+                    int32_t next_width = std::max(width / 2, 1), next_height = std::max(height / 2, 1);
+                    auto horizontal = compute_kernels(width, next_width, filter);
+                    auto vertical = compute_kernels(height, next_height, filter);
+                    intermediate.resize((size_t)next_width * (size_t)height);
+                    next.resize((size_t)next_width * (size_t)next_height);
+                    pool.parallel_for((size_t)height, [&](size_t begin, size_t end) {
+                        for (size_t y = begin; y < end; y++) {
+                            const glm::vec4* row = current.data() + y * (size_t)width;
+                            for (size_t x = 0; x < (size_t)next_width; x++) {
+                                apply_kernel(row, 1, horizontal[x], intermediate[y * (size_t)next_width + x]);
+                            }
+                        }
+                    });
+                    pool.parallel_for((size_t)next_height, [&](size_t begin, size_t end) {
+                        for (size_t y = begin; y < end; y++) {
+                            for (size_t x = 0; x < (size_t)next_width; x++) {
+                                apply_kernel(intermediate.data() + x, (size_t)next_width, vertical[y], next[y * (size_t)next_width + x]);
+                            }
+                        }
+                    });
+                    std::vector<uint8_t> level(next.size() * (size_t)channels);
+                    for (size_t i = 0; i < next.size(); i++) {
+                        for (int32_t c = 0; c < channels; c++) {
+                            // kaiser lobes can overshoot
+                            float value = glm::clamp(next[i][c], 0.f, 1.f);
+                            if (c < color_channels) {
+                                value = linear_to_srgb(value);
+                            }
+                            level[i * (size_t)channels + (size_t)c] = (uint8_t)(value * 255.f + 0.5f);
+                        }
+                    }
+                    levels.push_back(std::move(level));
+                    current.swap(next);
+                    width = next_width;
+                    height = next_height;
+                }
+                return levels;
+            }
+            using block_pixels = std::array<std::array<uint8_t, 4>, 16>;
+            // texels past the edge of the image repeat the last row or column
+            static void fetch_block(const uint8_t* pixels, int32_t width, int32_t height, int32_t channels, int32_t block_x, int32_t block_y, block_pixels& block) {
+                for (int32_t i = 0; i < 16; i++) {
+                    int32_t x = std::min(block_x * 4 + (i & 3), width - 1), y = std::min(block_y * 4 + (i >> 2), height - 1);
+                    const uint8_t* texel = pixels + ((size_t)y * (size_t)width + (size_t)x) * (size_t)channels;
+                    block[i] = { 0, 0, 0, 255 };
+                    for (int32_t c = 0; c < channels; c++) {
+                        block[i][c] = texel[c];
+                    }
+                }
+            }
+            static uint16_t to_565(const glm::vec3& color) {
+                uint32_t r = (uint32_t)(glm::clamp(color.r, 0.f, 255.f) * 31.f / 255.f + 0.5f);
+                uint32_t g = (uint32_t)(glm::clamp(color.g, 0.f, 255.f) * 63.f / 255.f + 0.5f);
+                uint32_t b = (uint32_t)(glm::clamp(color.b, 0.f, 255.f) * 31.f / 255.f + 0.5f);
+                return (uint16_t)((r << 11) | (g << 5) | b);
+            }
+            static glm::ivec3 from_565(uint16_t color) {
+                int32_t r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+                return glm::ivec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+            }
+            // the four colors of a block; transparent black is flagged with an alpha of 0
+            static void get_bc1_palette(uint16_t c0, uint16_t c1, bool four_color, glm::ivec4 palette[4]) {
+                glm::ivec3 a = from_565(c0), b = from_565(c1);
+                palette[0] = glm::ivec4(a, 255);
+                palette[1] = glm::ivec4(b, 255);
+                if (four_color || c0 > c1) {
+                    palette[2] = glm::ivec4((a * 2 + b) / 3, 255);
+                    palette[3] = glm::ivec4((a + b * 2) / 3, 255);
+                } else {
+                    palette[2] = glm::ivec4((a + b) / 2, 255);
+                    palette[3] = glm::ivec4(0);
+                }
+            }
+            // endpoints are the extremes of the block along its principal axis; always uses the four color mode
+            static void encode_bc1(const block_pixels& block, uint8_t* destination) {
+                glm::vec3 colors[16];
+                glm::vec3 mean = glm::vec3(0.f), minimum = glm::vec3(255.f), maximum = glm::vec3(0.f);
+                for (int32_t i = 0; i < 16; i++) {
+                    colors[i] = glm::vec3((float)block[i][0], (float)block[i][1], (float)block[i][2]);
+                    mean += colors[i];
+                    minimum = glm::min(minimum, colors[i]);
+                    maximum = glm::max(maximum, colors[i]);
+                }
+                mean /= 16.f;
+                glm::mat3 covariance = glm::mat3(0.f);
+                for (const auto& color : colors) {
+                    glm::vec3 d = color - mean;
+                    covariance += glm::outerProduct(d, d);
+                }
+                glm::vec3 axis = maximum - minimum;
+                if (glm::dot(axis, axis) < 1e-6f) {
+                    axis = glm::vec3(1.f);
+                }
+                for (int32_t i = 0; i < 8; i++) {
+                    glm::vec3 next = covariance * axis;
+                    float length = glm::length(next);
+                    if (length < 1e-6f) {
+                        break;
+                    }
+                    axis = next / length;
+                }
+                size_t lowest = 0, highest = 0;
+                float lowest_t = std::numeric_limits<float>::max(), highest_t = -lowest_t;
+                for (size_t i = 0; i < 16; i++) {
+                    float t = glm::dot(colors[i] - mean, axis);
+                    if (t < lowest_t) {
+                        lowest_t = t;
+                        lowest = i;
+                    }
+                    if (t > highest_t) {
+                        highest_t = t;
+                        highest = i;
+                    }
+                }
+                uint16_t c0 = to_565(colors[highest]), c1 = to_565(colors[lowest]);
+                if (c0 < c1) {
+                    std::swap(c0, c1);
+                }
+                uint32_t indices = 0;
+                if (c0 != c1) {
+                    glm::ivec4 palette[4];
+                    get_bc1_palette(c0, c1, true, palette);
+                    for (int32_t i = 0; i < 16; i++) {
+                        glm::ivec3 color = glm::ivec3(block[i][0], block[i][1], block[i][2]);
+                        int32_t best = 0, best_distance = std::numeric_limits<int32_t>::max();
+                        for (int32_t p = 0; p < 4; p++) {
+                            glm::ivec3 d = color - glm::ivec3(palette[p]);
+                            int32_t distance = d.x * d.x + d.y * d.y + d.z * d.z;
+                            if (distance < best_distance) {
+                                best_distance = distance;
+                                best = p;
+                            }
+                        }
+                        indices |= (uint32_t)best << (i * 2);
+                    }
+                }
+                memcpy(destination, &c0, sizeof(uint16_t));
+                memcpy(destination + 2, &c1, sizeof(uint16_t));
+                memcpy(destination + 4, &indices, sizeof(uint32_t));
+            }
+            static void decode_bc1(const uint8_t* source, bool four_color, block_pixels& block) {
+                uint16_t c0, c1;
+                uint32_t indices;
+                memcpy(&c0, source, sizeof(uint16_t));
+                memcpy(&c1, source + 2, sizeof(uint16_t));
+                memcpy(&indices, source + 4, sizeof(uint32_t));
+                glm::ivec4 palette[4];
+                get_bc1_palette(c0, c1, four_color, palette);
+                for (int32_t i = 0; i < 16; i++) {
+                    const auto& color = palette[(indices >> (i * 2)) & 3];
+                    block[i] = { (uint8_t)color.x, (uint8_t)color.y, (uint8_t)color.z, (uint8_t)color.w };
+                }
+            }
+            static void get_bc4_palette(uint8_t a0, uint8_t a1, int32_t palette[8]) {
+                palette[0] = a0;
+                palette[1] = a1;
+                if (a0 > a1) {
+                    for (int32_t i = 2; i < 8; i++) {
+                        palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+                    }
+                } else {
+                    for (int32_t i = 2; i < 6; i++) {
+                        palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+                    }
+                    palette[6] = 0;
+                    palette[7] = 255;
+                }
+            }
+            // always uses the eight value mode, unless every value is the same
+            static void encode_bc4(const block_pixels& block, int32_t channel, uint8_t* destination) {
+                uint8_t minimum = 255, maximum = 0;
+                for (const auto& texel : block) {
+                    minimum = std::min(minimum, texel[channel]);
+                    maximum = std::max(maximum, texel[channel]);
+                }
+                uint64_t indices = 0;
+                if (maximum != minimum) {
+                    int32_t palette[8];
+                    get_bc4_palette(maximum, minimum, palette);
+                    for (int32_t i = 0; i < 16; i++) {
+                        int32_t best = 0, best_distance = std::numeric_limits<int32_t>::max();
+                        for (int32_t p = 0; p < 8; p++) {
+                            int32_t distance = std::abs((int32_t)block[i][channel] - palette[p]);
+                            if (distance < best_distance) {
+                                best_distance = distance;
+                                best = p;
+                            }
+                        }
+                        indices |= (uint64_t)best << (i * 3);
+                    }
+                }
+                destination[0] = maximum;
+                destination[1] = minimum;
+                for (int32_t i = 0; i < 6; i++) {
+                    destination[2 + i] = (uint8_t)(indices >> (i * 8));
+                }
+            }
+            static void decode_bc4(const uint8_t* source, int32_t channel, block_pixels& block) {
+                int32_t palette[8];
+                get_bc4_palette(source[0], source[1], palette);
+                uint64_t indices = 0;
+                for (int32_t i = 0; i < 6; i++) {
+                    indices |= (uint64_t)source[2 + i] << (i * 8);
+                }
+                for (int32_t i = 0; i < 16; i++) {
+                    block[i][channel] = (uint8_t)palette[(indices >> (i * 3)) & 7];
+                }
+            }
+            void compress(format f, const uint8_t* pixels, int32_t width, int32_t height, uint8_t* destination) {
+                if (f == format::none || f == format::bc7) {
+                    throw std::runtime_error("Only bc1 through bc5 can be compressed!");
+                }
+                int32_t channels = get_channel_count(f);
+                size_t block_size = get_block_size(f);
+                size_t blocks_x = ((size_t)width + 3) / 4, blocks_y = ((size_t)height + 3) / 4;
+                thread_pool::get().parallel_for(blocks_y, [&](size_t begin, size_t end) {
+                    block_pixels block;
+                    for (size_t y = begin; y < end; y++) {
+                        for (size_t x = 0; x < blocks_x; x++) {
+                            fetch_block(pixels, width, height, channels, (int32_t)x, (int32_t)y, block);
+                            uint8_t* output = destination + (y * blocks_x + x) * block_size;
+                            switch (f) {
+                            case format::bc1:
+                                encode_bc1(block, output);
+                                break;
+                            case format::bc3:
+                                encode_bc4(block, 3, output);
+                                encode_bc1(block, output + 8);
+                                break;
+                            case format::bc4:
+                                encode_bc4(block, 0, output);
+                                break;
+                            case format::bc5:
+                                encode_bc4(block, 0, output);
+                                encode_bc4(block, 1, output + 8);
+                                break;
+                            default:
+                                break;
+                            }
+                        }
+                    }
+                }, 1);
+            }
+            void decompress(format f, const uint8_t* blocks, int32_t width, int32_t height, uint8_t* destination) {
+                if (f == format::none || f == format::bc7) {
+                    throw std::runtime_error("Only bc1 through bc5 can be decompressed!");
+                }
+                int32_t channels = get_channel_count(f);
+                size_t block_size = get_block_size(f);
+                size_t blocks_x = ((size_t)width + 3) / 4, blocks_y = ((size_t)height + 3) / 4;
+                for (size_t y = 0; y < blocks_y; y++) {
+                    for (size_t x = 0; x < blocks_x; x++) {
+                        const uint8_t* input = blocks + (y * blocks_x + x) * block_size;
+                        block_pixels block;
+                        switch (f) {
+                        case format::bc1:
+                            decode_bc1(input, false, block);
+                            break;
+                        case format::bc3:
+                            decode_bc1(input + 8, true, block);
+                            decode_bc4(input, 3, block);
+                            break;
+                        case format::bc4:
+                            decode_bc4(input, 0, block);
+                            break;
+                        case format::bc5:
+                            decode_bc4(input, 0, block);
+                            decode_bc4(input + 8, 1, block);
+                            break;
+                        default:
+                            break;
+                        }
+                        for (int32_t i = 0; i < 16; i++) {
+                            size_t px = x * 4 + (size_t)(i & 3), py = y * 4 + (size_t)(i >> 2);
+                            if (px >= (size_t)width || py >= (size_t)height) {
+                                continue;
+                            }
+                            memcpy(destination + (py * (size_t)width + px) * (size_t)channels, block[i].data(), (size_t)channels);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,170 @@
+#include "libglppch.h"
+#include "texture_manager.h"
+#include <stb_image.h>
+namespace libplayground {
+    namespace gl {
+        // new arrays get this many layers, or the maximum if it is lower
+        constexpr uint32_t initial_layers = 4;
+        static std::string canonicalize(const std::string& path) {
+            std::error_code error;
+            auto canonical = std::filesystem::weakly_canonical(path, error);
+            if (error) {
+                return path;
+            }
+            return canonical.generic_string();
+        }
+        static uint32_t get_layer_limit() {
+            static GLint limit = 0;
+            if (limit == 0) {
+                glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &limit);
+                limit = std::max(limit, (GLint)1);
+            }
+            return (uint32_t)limit;
+        }
+        texture_manager& texture_manager::get() {
+            static texture_manager instance;
+            return instance;
+        }
+        texture_manager::texture_manager() {
+            this->m_max_layers = 64;
+        }
+        texture_descriptor texture_manager::load(const std::string& path, const std::string& uniform_name) {
+            std::string canonical = canonicalize(path);
+            auto it = this->m_paths.find(canonical);
+            if (it != this->m_paths.end()) {
+                texture_descriptor desc;
+                desc.data = it->second.data;
+                desc.uniform_name = uniform_name;
+                desc.layer = it->second.layer;
+                for (auto& pair : this->m_pages) {
+                    for (auto& page : pair.second) {
+                        if (page.data == desc.data) {
+                            page.references[desc.layer]++;
+                        }
+                    }
+                }
+                return desc;
+            }
+            int32_t width, height, channels;
+            std::unique_ptr<uint8_t, void(*)(void*)> data(stbi_load(canonical.c_str(), &width, &height, &channels, 0), stbi_image_free);
+            if (!data) {
+                throw std::runtime_error("Could not load image: " + path);
+            }
+            texture_descriptor desc = this->add(data.get(), width, height, channels, uniform_name);
+            this->m_paths.insert({ canonical, { desc.data, desc.layer } });
+            return desc;
+        }
+        texture_descriptor texture_manager::add(const uint8_t* pixels, int32_t width, int32_t height, int32_t channels, const std::string& uniform_name) {
+            if (!pixels || width <= 0 || height <= 0 || channels < 1 || channels > 4) {
+                throw std::runtime_error("Invalid image!");
+            }
+            texture_descriptor desc = this->allocate({ width, height, channels });
+            desc.data->set_layer(desc.layer, pixels);
+            desc.uniform_name = uniform_name;
+            return desc;
+        }
+        texture_descriptor texture_manager::allocate(const format_key& key) {
+            auto& pages = this->m_pages[key];
+            auto claim = [](array_page& page, uint32_t layer) {
+                page.references[layer] = 1;
+                page.used_count++;
+                texture_descriptor desc;
+                desc.data = page.data;
+                desc.layer = layer;
+                return desc;
+            };
+            // the lowest free layer first, which keeps holes from piling up
+            for (auto& page : pages) {
+                if (page.used_count < (uint32_t)page.references.size()) {
+                    for (uint32_t i = 0; i < (uint32_t)page.references.size(); i++) {
+                        if (page.references[i] == 0) {
+                            return claim(page, i);
+                        }
+                    }
+                }
+            }
+            uint32_t max_layers = std::max(std::min(this->m_max_layers, get_layer_limit()), (uint32_t)1);
+            for (auto& page : pages) {
+                uint32_t layer_count = (uint32_t)page.references.size();
+                if (layer_count < max_layers) {
+                    page.data->set_layer_count(std::min(layer_count * 2, max_layers));
+                    page.references.resize(page.data->get_layer_count(), 0);
+                    return claim(page, layer_count);
+                }
+            }
+            texture::settings s;
+            s.min_filter = GL_LINEAR_MIPMAP_LINEAR;
+            array_page page;
+            page.data = texture::create_array(std::get<0>(key), std::get<1>(key), std::get<2>(key), std::min(initial_layers, max_layers), s);
+            page.references.resize(page.data->get_layer_count(), 0);
+            pages.push_back(std::move(page));
+            return claim(pages.back(), 0);
+        }
+        void texture_manager::remove(const texture_descriptor& desc) {
+            for (auto pages = this->m_pages.begin(); pages != this->m_pages.end(); pages++) {
+                for (auto page = pages->second.begin(); page != pages->second.end(); page++) {
+                    if (page->data != desc.data || desc.layer >= (uint32_t)page->references.size() || page->references[desc.layer] == 0) {
+                        continue;
+                    }
+                    if (--page->references[desc.layer] > 0) {
+                        return;
+                    }
+                    page->used_count--;
+                    for (auto it = this->m_paths.begin(); it != this->m_paths.end();) {
+                        if (it->second.data == desc.data && it->second.layer == desc.layer) {
+                            it = this->m_paths.erase(it);
+                        } else {
+                            it++;
+                        }
+                    }
+                    if (page->used_count == 0) {
+                        // descriptors still holding the array keep it alive
+                        pages->second.erase(page);
+                        if (pages->second.empty()) {
+                            this->m_pages.erase(pages);
+                        }
+                    }
+                    return;
+                }
+            }
+        }
+        void texture_manager::set_max_layers(uint32_t layers) {
+            this->m_max_layers = std::max(layers, (uint32_t)1);
+        }
+        uint32_t texture_manager::get_max_layers() const {
+            return this->m_max_layers;
+        }
+        texture_manager::statistics texture_manager::get_statistics() const {
+            statistics stats;
+            for (const auto& pair : this->m_pages) {
+                for (const auto& page : pair.second) {
+                    stats.arrays++;
+                    stats.used_layers += page.used_count;
+                    stats.allocated_layers += page.references.size();
+                    stats.gpu_memory += page.data->get_memory_usage();
+                    size_t end = page.references.size();
+                    while (end > 0 && page.references[end - 1] == 0) {
+                        end--;
+                    }
+                    for (size_t i = 0; i < end; i++) {
+                        if (page.references[i] == 0) {
+                            stats.holes++;
+                        }
+                    }
+                }
+            }
+            if (stats.allocated_layers > 0) {
+                stats.occupancy = (float)stats.used_layers / (float)stats.allocated_layers;
+            }
+            size_t free_layers = stats.allocated_layers - stats.used_layers;
+            if (free_layers > 0) {
+                stats.fragmentation = (float)stats.holes / (float)free_layers;
+            }
+            return stats;
+        }
+        void texture_manager::clear() {
+            this->m_pages.clear();
+            this->m_paths.clear();
+        }
+    }
+}
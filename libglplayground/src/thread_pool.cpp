@@ -0,0 +1,116 @@
+#include "libglppch.h"
+#include "thread_pool.h"
+namespace libplayground {
+    namespace gl {
+        thread_pool& thread_pool::get() {
+            static thread_pool instance;
+            return instance;
+        }
+        thread_pool::thread_pool(size_t thread_count) {
+            this->m_stopping = false;
+            if (thread_count == 0) {
+                size_t hardware_threads = (size_t)std::thread::hardware_concurrency();
+                thread_count = hardware_threads > 1 ? hardware_threads - 1 : 1;
+            }
+            for (size_t i = 0; i < thread_count; i++) {
+                this->m_threads.emplace_back([this]() {
+                    this->worker();
+                });
+            }
+        }
+        thread_pool::~thread_pool() {
+            {
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                this->m_stopping = true;
+            }
+            this->m_condition.notify_all();
+            for (auto& thread : this->m_threads) {
+                thread.join();
+            }
+        }
+        void thread_pool::parallel_for(size_t count, const std::function<void(size_t begin, size_t end)>& callback, size_t min_range_size) {
+            if (count == 0) {
+                return;
+            }
+            size_t range_count = std::min(this->m_threads.size() + 1, (count + min_range_size - 1) / std::max(min_range_size, (size_t)1));
+            if (range_count <= 1) {
+                callback(0, count);
+                return;
+            }
+            // shared, because a worker busy with a long task may only get to its share after this call has returned
+            struct batch {
+                std::function<void(size_t, size_t)> callback;
+                size_t count, range_size, range_count;
+                std::atomic<size_t> next_range, remaining;
+                std::exception_ptr error;
+                std::mutex error_mutex;
+                void run() {
+                    size_t range;
+                    while ((range = this->next_range++) < this->range_count) {
+                        size_t begin = range * this->range_size;
+                        try {
+                            this->callback(begin, std::min(begin + this->range_size, this->count));
+                        } catch (...) {
+                            std::lock_guard<std::mutex> lock(this->error_mutex);
+                            if (!this->error) {
+                                this->error = std::current_exception();
+                            }
+                        }
+                        this->remaining--;
+                    }
+                }
+            };
+            auto work = std::make_shared<batch>();
+            work->callback = callback;
+            work->count = count;
+            work->range_size = (count + range_count - 1) / range_count;
+            work->range_count = (count + work->range_size - 1) / work->range_size;
+            work->next_range = 0;
+            work->remaining = work->range_count;
+            {
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                for (size_t i = 1; i < work->range_count; i++) {
+                    this->m_tasks.push([work]() {
+                        work->run();
+                    });
+                }
+            }
+            this->m_condition.notify_all();
+            // the calling thread takes ranges too, until there are none left
+            work->run();
+            while (work->remaining > 0) {
+                std::this_thread::yield();
+            }
+            if (work->error) {
+                std::rethrow_exception(work->error);
+            }
+        }
+        void thread_pool::submit(const std::function<void()>& task) {
+            {
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                this->m_tasks.push(task);
+            }
+            this->m_condition.notify_one();
+        }
+        size_t thread_pool::get_thread_count() const {
+            return this->m_threads.size();
+        }
+        void thread_pool::worker() {
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(this->m_mutex);
+                    this->m_condition.wait(lock, [this]() {
+                        return this->m_stopping || !this->m_tasks.empty();
+                    });
+                    if (this->m_stopping && this->m_tasks.empty()) {
+                        return;
+                    }
+                    task = std::move(this->m_tasks.front());
+                    this->m_tasks.pop();
+                }
+                task();
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include "libglppch.h"
+#include "uniform_buffer_object.h"
+#include "state_tracker.h"
+namespace libplayground {
+    namespace gl {
+        extern bool _context_destroyed_;
+        uniform_buffer_object::uniform_buffer_object(size_t size, uint32_t binding) {
+            this->m_size = size;
+            this->m_binding = binding;
+            glGenBuffers(1, &this->m_id);
+            state_tracker::get().bind_buffer(GL_UNIFORM_BUFFER, this->m_id);
+            glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)size, nullptr, GL_DYNAMIC_DRAW);
+            this->bind_base();
+        }
+        uniform_buffer_object::~uniform_buffer_object() {
+            if (!_context_destroyed_) {
+                glDeleteBuffers(1, &this->m_id);
+                state_tracker::get().on_buffer_deleted(this->m_id);
+            }
+        }
+        void uniform_buffer_object::bind() {
+            state_tracker::get().bind_buffer(GL_UNIFORM_BUFFER, this->m_id);
+        }
+        void uniform_buffer_object::unbind() {
+            state_tracker::get().bind_buffer(GL_UNIFORM_BUFFER, 0);
+        }
+        void uniform_buffer_object::bind_base() {
+            // this also binds the buffer to the generic GL_UNIFORM_BUFFER target, which the tracker has to know about
+            state_tracker::get().bind_buffer(GL_UNIFORM_BUFFER, this->m_id);
+            glBindBufferBase(GL_UNIFORM_BUFFER, this->m_binding, this->m_id);
+        }
+        GLuint uniform_buffer_object::get() {
+            return this->m_id;
+        }
+        void uniform_buffer_object::update(const void* data, size_t length, size_t offset) {
+            if (offset + length > this->m_size) {
+                throw std::runtime_error("Attempted to write past the end of a uniform buffer!");
+            }
+            state_tracker::get().bind_buffer(GL_UNIFORM_BUFFER, this->m_id);
+            glBufferSubData(GL_UNIFORM_BUFFER, (GLintptr)offset, (GLsizeiptr)length, data);
+        }
+    }
+}
\ No newline at end of file
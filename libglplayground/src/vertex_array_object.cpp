@@ -1,24 +1,31 @@
 #include "libglppch.h"
 #include "vertex_array_object.h"
+#include "state_tracker.h"
 namespace libplayground {
     namespace gl {
+        extern bool _context_destroyed_;
         vertex_array_object::vertex_array_object() {
             glGenVertexArrays(1, &this->m_id);
-            glBindVertexArray(this->m_id);
+            state_tracker::get().bind_vertex_array(this->m_id);
         }
         vertex_array_object::~vertex_array_object() {
-            glDeleteVertexArrays(1, &this->m_id);
+            if (!_context_destroyed_) {
+                glDeleteVertexArrays(1, &this->m_id);
+                state_tracker::get().on_vertex_array_deleted(this->m_id);
+            }
         }
         void vertex_array_object::bind() {
-            glBindVertexArray(this->m_id);
+            state_tracker::get().bind_vertex_array(this->m_id);
         }
         void vertex_array_object::unbind() {
-            glBindVertexArray(0);
+            state_tracker::get().bind_vertex_array(0);
         }
-        void vertex_array_object::add_vertex_attributes(const std::vector<vertex_attribute>& attributes) {
+        void vertex_array_object::add_vertex_attributes(const std::vector<vertex_attribute>& attributes, uint32_t first_index) {
             for (size_t i = 0; i < attributes.size(); i++) {
                 const auto& attrib = attributes[i];
-                glEnableVertexAttribArray((GLuint)i);
+                GLuint index = (GLuint)(first_index + i);
+                glEnableVertexAttribArray(index);
+                bool is_integer = false;
                 switch (attrib.type) {
                 case GL_INT:
                 case GL_UNSIGNED_INT:
@@ -26,12 +33,21 @@ namespace libplayground {
                 case GL_UNSIGNED_BYTE:
                 case GL_SHORT:
                 case GL_UNSIGNED_SHORT:
-                    glVertexAttribIPointer((GLuint)i, (GLint)attrib.elements, attrib.type, (GLsizei)attrib.stride, (void*)attrib.offset);
-                    break;
-                default:
-                    glVertexAttribPointer((GLuint)i, (GLint)attrib.elements, attrib.type, attrib.normalized, (GLsizei)attrib.stride, (void*)attrib.offset);
+                    is_integer = true;
                     break;
                 }
+                // normalized integers are read as floats
+                if (is_integer && !attrib.normalized) {
+                    glVertexAttribIPointer(index, (GLint)attrib.elements, attrib.type, (GLsizei)attrib.stride, (void*)attrib.offset);
+                } else {
+                    glVertexAttribPointer(index, (GLint)attrib.elements, attrib.type, attrib.normalized, (GLsizei)attrib.stride, (void*)attrib.offset);
+                }
+                glVertexAttribDivisor(index, (GLuint)attrib.divisor);
+            }
+        }
+        void vertex_array_object::disable_vertex_attributes(uint32_t first_index, uint32_t count) {
+            for (uint32_t i = first_index; i < first_index + count; i++) {
+                glDisableVertexAttribArray((GLuint)i);
             }
         }
         GLuint vertex_array_object::get() {
@@ -1,15 +1,20 @@
 #include "libglppch.h"
 #include "vertex_buffer_object.h"
+#include "state_tracker.h"
 namespace libplayground {
     namespace gl {
+        extern bool _context_destroyed_;
         vertex_buffer_object::~vertex_buffer_object() {
-            glDeleteBuffers(1, &this->m_id);
+            if (!_context_destroyed_) {
+                glDeleteBuffers(1, &this->m_id);
+                state_tracker::get().on_buffer_deleted(this->m_id);
+            }
         }
         void vertex_buffer_object::bind() {
-            glBindBuffer(GL_ARRAY_BUFFER, this->m_id);
+            state_tracker::get().bind_buffer(GL_ARRAY_BUFFER, this->m_id);
         }
         void vertex_buffer_object::unbind() {
-            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            state_tracker::get().bind_buffer(GL_ARRAY_BUFFER, 0);
         }
         void vertex_buffer_object::draw(GLenum mode) {
             glDrawArrays(mode, 0, (GLsizei)this->m_vertex_count);
@@ -17,10 +22,28 @@ namespace libplayground {
         GLuint vertex_buffer_object::get() {
             return this->m_id;
         }
+        void vertex_buffer_object::get_data(void* destination, size_t length) {
+            // the copy target leaves the vertex array state alone
+            state_tracker::get().bind_buffer(GL_COPY_READ_BUFFER, this->m_id);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)length, destination);
+        }
+        size_t vertex_buffer_object::get_memory_usage() const {
+            return this->m_capacity;
+        }
         void vertex_buffer_object::init(const void* data, size_t length) {
             glGenBuffers(1, &this->m_id);
-            glBindBuffer(GL_ARRAY_BUFFER, this->m_id);
+            state_tracker::get().bind_buffer(GL_ARRAY_BUFFER, this->m_id);
             glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)length, data, GL_STATIC_DRAW); // for now
+            this->m_capacity = length;
+        }
+        void vertex_buffer_object::update(const void* data, size_t length) {
+            state_tracker::get().bind_buffer(GL_ARRAY_BUFFER, this->m_id);
+            if (length > this->m_capacity) {
+                glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)length, data, GL_STATIC_DRAW);
+                this->m_capacity = length;
+            } else if (length > 0) {
+                glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)length, data);
+            }
         }
     }
 }
\ No newline at end of file
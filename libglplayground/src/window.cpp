@@ -1,5 +1,6 @@
 #include "libglppch.h"
 #include "window.h"
+#include "state_tracker.h"
 static uint32_t window_count = 0;
 namespace libplayground {
     namespace gl {
@@ -68,6 +69,7 @@ namespace libplayground {
         }
         window::~window() {
             _context_destroyed_ = true;
+            state_tracker::remove(this->m_window);
             glfwDestroyWindow(this->m_window);
             window_count--;
             if (window_count == 0) {
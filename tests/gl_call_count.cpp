@@ -0,0 +1,147 @@
+// counts the gl calls the renderer makes per frame for meshes that share a shader, textures and geometry, by swapping glad's function pointers for counting wrappers
+#include "test_context.h"
+using namespace libplayground::gl;
+using namespace libplayground_tests;
+constexpr size_t mesh_count = 100;
+constexpr size_t measured_frames = 3;
+static const char* vertex_shader = R"(
+#version 330 core
+layout(location = 0) in vec3 position;
+layout(location = 2) in vec2 _uv;
+layout(std140) uniform camera_data {
+    mat4 projection;
+    mat4 view;
+    mat4 view_projection;
+    vec4 camera_position;
+    vec4 viewport;
+};
+uniform mat4 model;
+out vec2 uv;
+void main() {
+    gl_Position = view_projection * model * vec4(position, 1.0);
+    uv = _uv;
+}
+)";
+static const char* fragment_shader = R"(
+#version 330 core
+in vec2 uv;
+uniform sampler2D albedo;
+uniform sampler2D tint;
+out vec4 color;
+void main() {
+    color = texture(albedo, uv) * texture(tint, uv);
+}
+)";
+enum class gl_call {
+    use_program,
+    bind_texture,
+    bind_vertex_array,
+    draw,
+    model_uniform,
+    sampler_uniform,
+    get_uniform_location,
+};
+static std::map<gl_call, uint64_t> call_counts;
+// one instantiation per wrapped function, told apart by id, so that each keeps its own original pointer
+template<size_t id, gl_call call, typename R, typename... A> struct counting_wrapper {
+    static inline R(APIENTRYP original)(A...) = nullptr;
+    static R APIENTRY invoke(A... args) {
+        call_counts[call]++;
+        return original(args...);
+    }
+};
+template<size_t id, gl_call call, typename R, typename... A> static void wrap(R(APIENTRYP& pointer)(A...)) {
+    using wrapper = counting_wrapper<id, call, R, A...>;
+    wrapper::original = pointer;
+    pointer = &wrapper::invoke;
+}
+static void install_wrappers() {
+    wrap<0, gl_call::use_program>(glUseProgram);
+    wrap<1, gl_call::bind_texture>(glBindTexture);
+    wrap<2, gl_call::bind_vertex_array>(glBindVertexArray);
+    wrap<3, gl_call::draw>(glDrawElements);
+    wrap<4, gl_call::draw>(glDrawElementsInstanced);
+    wrap<5, gl_call::model_uniform>(glUniformMatrix4fv);
+    wrap<6, gl_call::sampler_uniform>(glUniform1i);
+    wrap<7, gl_call::get_uniform_location>(glGetUniformLocation);
+}
+static bool expect(const std::string& name, uint64_t value, uint64_t expected) {
+    std::string message = name + ": " + std::to_string(value) + ", expected " + std::to_string(expected);
+    if (value != expected) {
+        spdlog::error(message);
+        return false;
+    }
+    spdlog::info(message);
+    return true;
+}
+static ref<texture> create_texture(uint8_t value) {
+    std::vector<uint8_t> data = { value, value, value, 255 };
+    return ref<texture>::create(data, 1, 1, 4);
+}
+int main() {
+    ref<window> context = create_test_window(64, 64);
+    if (!context) {
+        return skip_exit_code;
+    }
+    bool passed = true;
+    try {
+        ref<shader> program = ref<shader>::create(shader_source{ vertex_shader, fragment_shader, "" });
+        shader_library::get()["renderer-default"] = program;
+        std::vector<vertex> quad = {
+            { glm::vec3(-1.f, -1.f, 0.f), glm::vec3(0.f, 0.f, 1.f), glm::vec2(0.f, 0.f) },
+            { glm::vec3(1.f, -1.f, 0.f), glm::vec3(0.f, 0.f, 1.f), glm::vec2(1.f, 0.f) },
+            { glm::vec3(1.f, 1.f, 0.f), glm::vec3(0.f, 0.f, 1.f), glm::vec2(1.f, 1.f) },
+            { glm::vec3(-1.f, 1.f, 0.f), glm::vec3(0.f, 0.f, 1.f), glm::vec2(0.f, 1.f) },
+        };
+        ref<shared_geometry> geometry = ref<shared_geometry>::create(quad, std::vector<uint32_t>{ 0, 1, 2, 0, 2, 3 });
+        std::vector<texture_descriptor> textures = { { create_texture(255), "albedo" }, { create_texture(128), "tint" } };
+        std::vector<cached_mesh_descriptor> meshes(mesh_count);
+        for (size_t i = 0; i < mesh_count; i++) {
+            auto& desc = meshes[i];
+            desc.key = (mesh_cache_key)i;
+            desc.transform = glm::translate(glm::mat4(1.f), glm::vec3((float)(i % 10) - 4.5f, (float)(i / 10) - 4.5f, -20.f - (float)i * 0.1f));
+            desc.textures = &textures;
+            desc.geometry = geometry.raw();
+        }
+        ref<renderer> scene_renderer = ref<renderer>::create();
+        glm::mat4 projection = glm::perspective(glm::radians(60.f), 1.f, 0.1f, 100.f);
+        auto render_frame = [&]() {
+            scene_renderer->reset();
+            scene_renderer->set_camera(projection, glm::mat4(1.f), glm::vec3(0.f), glm::vec4(0.f, 0.f, 64.f, 64.f));
+            for (const auto& desc : meshes) {
+                scene_renderer->submit(desc);
+            }
+            scene_renderer->render();
+        };
+        install_wrappers();
+        // the first frame uploads the geometry and binds everything once
+        render_frame();
+        for (size_t frame = 0; frame < measured_frames; frame++) {
+            call_counts.clear();
+            state_tracker::get().reset_statistics();
+            render_frame();
+            const auto& tracked = state_tracker::get().get_statistics();
+            const auto& stats = scene_renderer->get_statistics();
+            // every draw, and every mesh, prepares its program, textures and vertex array; only what changed reaches the driver
+            passed &= expect("draw calls", call_counts[gl_call::draw], mesh_count);
+            passed &= expect("draw calls counted by the renderer", stats.draw_calls, mesh_count);
+            passed &= expect("program binds", call_counts[gl_call::use_program], 0);
+            passed &= expect("program binds elided", tracked.program_binds_elided, mesh_count);
+            passed &= expect("texture binds", call_counts[gl_call::bind_texture], 0);
+            passed &= expect("texture binds elided", tracked.texture_binds_elided, mesh_count * textures.size());
+            // the shared geometry is bound once, and unbound at the end of the frame
+            passed &= expect("vertex array binds", call_counts[gl_call::bind_vertex_array], 2);
+            passed &= expect("vertex array binds elided", tracked.vertex_array_binds_elided, mesh_count - 1);
+            // every mesh has its own transform, but the sampler units never change, and names are looked up in the reflected table
+            passed &= expect("model matrix uploads", call_counts[gl_call::model_uniform], mesh_count);
+            passed &= expect("sampler uniform uploads", call_counts[gl_call::sampler_uniform], 0);
+            passed &= expect("uniform location lookups", call_counts[gl_call::get_uniform_location], 0);
+        }
+        const auto& shader_stats = program->get_statistics();
+        spdlog::info("Shader statistics: " + std::to_string(shader_stats.uniform_updates) + " updates, " + std::to_string(shader_stats.uniform_updates_elided) + " elided");
+    } catch (const std::exception& exc) {
+        spdlog::error(exc.what());
+        return 1;
+    }
+    return passed ? 0 : 1;
+}
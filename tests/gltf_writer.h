@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+namespace libplayground_tests {
+    // builds a gltf file with its one buffer embedded as base64, for tests and benchmarks that generate their own models
+    class gltf_writer {
+    public:
+        // copies the data into a buffer view of its own, and returns the index of the accessor reading it
+        // accessor_json is every accessor property but the buffer view
+        uint32_t add_accessor(const void* data, size_t size, const std::string& accessor_json) {
+            this->m_views.push_back("{\"buffer\":0,\"byteOffset\":" + std::to_string(this->m_buffer.size()) + ",\"byteLength\":" + std::to_string(size) + "}");
+            this->m_accessors.push_back("{\"bufferView\":" + std::to_string(this->m_views.size() - 1) + "," + accessor_json + "}");
+            this->m_buffer.insert(this->m_buffer.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+            return (uint32_t)this->m_accessors.size() - 1;
+        }
+        // fields are the rest of the top level object (scenes, nodes, meshes and so on), without a trailing comma
+        void save(const std::string& path, const std::string& fields) const {
+            std::ofstream stream(path, std::ios::trunc);
+            stream << "{\"asset\":{\"version\":\"2.0\"},\"scene\":0," << fields << ","
+                << "\"buffers\":[{\"byteLength\":" << this->m_buffer.size() << ",\"uri\":\"data:application/octet-stream;base64," << encode_base64(this->m_buffer) << "\"}],"
+                << "\"bufferViews\":[" << join(this->m_views) << "],\"accessors\":[" << join(this->m_accessors) << "]}";
+        }
+        static std::string join(const std::vector<std::string>& items) {
+            std::string result;
+            for (size_t i = 0; i < items.size(); i++) {
+                result += (i > 0 ? "," : "") + items[i];
+            }
+            return result;
+        }
+        static std::string encode_base64(const std::vector<uint8_t>& data) {
+            static const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            std::string result;
+            for (size_t i = 0; i < data.size(); i += 3) {
+                uint32_t word = (uint32_t)data[i] << 16;
+                if (i + 1 < data.size()) {
+                    word |= (uint32_t)data[i + 1] << 8;
+                }
+                if (i + 2 < data.size()) {
+                    word |= (uint32_t)data[i + 2];
+                }
+                result += alphabet[(word >> 18) & 63];
+                result += alphabet[(word >> 12) & 63];
+                result += i + 1 < data.size() ? alphabet[(word >> 6) & 63] : '=';
+                result += i + 2 < data.size() ? alphabet[word & 63] : '=';
+            }
+            return result;
+        }
+    private:
+        std::vector<uint8_t> m_buffer;
+        std::vector<std::string> m_views, m_accessors;
+    };
+}
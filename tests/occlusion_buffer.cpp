@@ -0,0 +1,74 @@
+// rasterizes occluders into the cpu depth buffer and checks which boxes it hides; needs no opengl context
+#include <libglplayground.h>
+#include <random>
+using namespace libplayground::gl;
+constexpr size_t random_triangle_count = 500;
+static const glm::mat4 view_projection = glm::perspective(glm::radians(60.f), 2.f, 0.1f, 100.f) *
+    glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+// a 2x2 quad facing the camera, two units in front of it
+static void add_quad(occlusion_buffer& buffer) {
+    std::vector<glm::vec3> positions = { glm::vec3(-1.f, -1.f, -2.f), glm::vec3(1.f, -1.f, -2.f), glm::vec3(1.f, 1.f, -2.f), glm::vec3(-1.f, 1.f, -2.f) };
+    std::vector<uint32_t> indices = { 0, 1, 2, 0, 2, 3 };
+    buffer.add_occluder(positions.data(), sizeof(glm::vec3), indices.data(), indices.size(), glm::mat4(1.f));
+}
+// the same triangles every run, scattered over the view at different depths and sizes
+static void add_random_triangles(occlusion_buffer& buffer) {
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<float> lateral(-4.f, 4.f), depth(-20.f, -1.f), offset(-2.f, 2.f);
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    for (size_t i = 0; i < random_triangle_count; i++) {
+        glm::vec3 center = glm::vec3(lateral(generator), lateral(generator) * 0.5f, depth(generator));
+        for (uint32_t j = 0; j < 3; j++) {
+            indices.push_back((uint32_t)positions.size());
+            positions.push_back(center + glm::vec3(offset(generator), offset(generator), offset(generator)));
+        }
+    }
+    buffer.add_occluder(positions.data(), sizeof(glm::vec3), indices.data(), indices.size(), glm::mat4(1.f));
+}
+static bool expect(const std::string& name, bool value, bool expected) {
+    std::string message = name + ": " + (value ? "true" : "false") + ", expected " + (expected ? "true" : "false");
+    if (value != expected) {
+        spdlog::error(message);
+        return false;
+    }
+    spdlog::info(message);
+    return true;
+}
+int main() {
+    bool passed = true;
+    occlusion_buffer buffer;
+    buffer.begin(view_projection);
+    add_quad(buffer);
+    buffer.finish();
+    passed &= expect("box behind the quad is visible", buffer.is_visible(aabb(glm::vec3(-0.5f, -0.5f, -6.f), glm::vec3(0.5f, 0.5f, -5.f))), false);
+    passed &= expect("box in front of the quad is visible", buffer.is_visible(aabb(glm::vec3(-0.25f, -0.25f, -1.5f), glm::vec3(0.25f, 0.25f, -1.2f))), true);
+    passed &= expect("box beside the quad is visible", buffer.is_visible(aabb(glm::vec3(3.f, -0.25f, -6.f), glm::vec3(4.f, 0.25f, -5.f))), true);
+    passed &= expect("box straddling the quad is visible", buffer.is_visible(aabb(glm::vec3(-0.5f, -0.5f, -3.f), glm::vec3(0.5f, 0.5f, -1.5f))), true);
+    // the vector paths have to give exactly what the scalar loop gives, on every level
+    occlusion_buffer scalar;
+    scalar.set_simd_enabled(false);
+    for (occlusion_buffer* target : { &buffer, &scalar }) {
+        target->begin(view_projection);
+        add_quad(*target);
+        add_random_triangles(*target);
+        target->finish();
+    }
+    bool identical = true;
+    for (uint32_t level = 0; level < buffer.get_level_count(); level++) {
+        const auto& simd_depth = buffer.get_depth(level);
+        const auto& scalar_depth = scalar.get_depth(level);
+        if (simd_depth.size() != scalar_depth.size() || memcmp(simd_depth.data(), scalar_depth.data(), simd_depth.size() * sizeof(float)) != 0) {
+            spdlog::error("Level " + std::to_string(level) + " differs between the simd and scalar paths");
+            identical = false;
+        }
+    }
+    passed &= expect("simd and scalar pyramids are identical", identical, true);
+    // comparing says little unless the triangles actually landed in the buffer
+    size_t covered = 0;
+    for (float depth : scalar.get_depth()) {
+        covered += depth < 1.f ? 1 : 0;
+    }
+    passed &= expect("random triangles cover part of the buffer", covered > 0 && covered < scalar.get_depth().size(), true);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <libglplayground.h>
+namespace libplayground_tests {
+    // tests that cannot get an opengl context (no display, no driver) exit with this, and ctest reports them as skipped
+    constexpr int skip_exit_code = 77;
+    // a hidden window, for its context; null if one could not be created
+    inline libplayground::gl::ref<libplayground::gl::window> create_test_window(int32_t width, int32_t height) {
+        using namespace libplayground::gl;
+        if (!glfwInit()) {
+            spdlog::warn("GLFW failed to initialize; skipping");
+            return ref<window>();
+        }
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
+        try {
+            return ref<window>::create("libglplayground test", width, height, false, 3, 3);
+        } catch (const std::exception& exc) {
+            spdlog::warn(std::string(exc.what()) + "; skipping");
+            return ref<window>();
+        }
+    }
+    // a color and depth target to render into and read back, instead of the window
+    class offscreen_target {
+    public:
+        offscreen_target(int32_t width, int32_t height) {
+            this->m_width = width;
+            this->m_height = height;
+            glGenFramebuffers(1, &this->m_framebuffer);
+            glGenRenderbuffers(2, this->m_renderbuffers);
+            glBindRenderbuffer(GL_RENDERBUFFER, this->m_renderbuffers[0]);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+            glBindRenderbuffer(GL_RENDERBUFFER, this->m_renderbuffers[1]);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+            glBindFramebuffer(GL_FRAMEBUFFER, this->m_framebuffer);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->m_renderbuffers[0]);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->m_renderbuffers[1]);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                throw std::runtime_error("Offscreen framebuffer is incomplete!");
+            }
+        }
+        ~offscreen_target() {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glDeleteFramebuffers(1, &this->m_framebuffer);
+            glDeleteRenderbuffers(2, this->m_renderbuffers);
+        }
+        offscreen_target(const offscreen_target&) = delete;
+        offscreen_target& operator=(const offscreen_target&) = delete;
+        void begin() {
+            glBindFramebuffer(GL_FRAMEBUFFER, this->m_framebuffer);
+            glViewport(0, 0, this->m_width, this->m_height);
+            glEnable(GL_DEPTH_TEST);
+            glClearColor(0.f, 0.f, 0.f, 0.f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+        // rgba8, bottom row first
+        std::vector<uint8_t> read_pixels() {
+            std::vector<uint8_t> pixels((size_t)this->m_width * (size_t)this->m_height * 4);
+            glBindFramebuffer(GL_FRAMEBUFFER, this->m_framebuffer);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadPixels(0, 0, this->m_width, this->m_height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            return pixels;
+        }
+    private:
+        int32_t m_width, m_height;
+        GLuint m_framebuffer, m_renderbuffers[2];
+    };
+}
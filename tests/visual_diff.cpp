@@ -0,0 +1,220 @@
+// renders the same static and skinned meshes in the full vertex format and in the compact ones, and fails if the images differ by more than quantization allows
+#include "test_context.h"
+#include "gltf_writer.h"
+using namespace libplayground::gl;
+using namespace libplayground_tests;
+constexpr int32_t image_size = 256;
+// per channel, out of 255; octahedral normals are the least precise encoding, at about a tenth of this
+constexpr int32_t channel_tolerance = 6;
+// pixels along silhouettes can flip between covered and not covered
+constexpr double max_mismatched_fraction = 0.01;
+static const char* vertex_shader = R"(
+#version 330 core
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 _uv;
+layout(location = 3) in uvec4 bone_ids;
+layout(location = 4) in vec4 weights;
+uniform mat4 view_projection;
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+uniform int octahedral_normals;
+uniform int skinned;
+uniform samplerBuffer bone_palette;
+uniform int bone_offset;
+out vec3 world_normal;
+out vec2 uv;
+mat4 get_bone(uint id) {
+    int texel = (bone_offset + int(id)) * 4;
+    return mat4(texelFetch(bone_palette, texel), texelFetch(bone_palette, texel + 1), texelFetch(bone_palette, texel + 2), texelFetch(bone_palette, texel + 3));
+}
+vec3 decode_normal() {
+    if (octahedral_normals == 0) {
+        return normal;
+    }
+    vec3 n = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+void main() {
+    mat4 transform = mat4(1.0);
+    if (skinned != 0) {
+        transform = get_bone(bone_ids[0]) * weights[0] + get_bone(bone_ids[1]) * weights[1] + get_bone(bone_ids[2]) * weights[2] + get_bone(bone_ids[3]) * weights[3];
+    }
+    gl_Position = view_projection * transform * vec4(position_offset + position * position_scale, 1.0);
+    world_normal = mat3(transform) * decode_normal();
+    uv = _uv;
+}
+)";
+static const char* fragment_shader = R"(
+#version 330 core
+in vec3 world_normal;
+in vec2 uv;
+uniform int show_uvs;
+out vec4 color;
+void main() {
+    if (show_uvs != 0) {
+        color = vec4(uv, 0.0, 1.0);
+    } else {
+        color = vec4(normalize(world_normal) * 0.5 + 0.5, 1.0);
+    }
+}
+)";
+// an open cylinder along y, two units tall; skinned to a root joint at the base and a tip joint halfway up, which the one animation bends
+static void write_cylinder(const std::string& path, bool skinned) {
+    constexpr uint32_t rings = 9, segments = 16;
+    gltf_writer writer;
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<uint16_t> joints;
+    std::vector<glm::vec4> weights;
+    for (uint32_t i = 0; i < rings; i++) {
+        float t = (float)i / (float)(rings - 1);
+        for (uint32_t j = 0; j <= segments; j++) {
+            float angle = 6.2831853f * (float)j / (float)segments;
+            glm::vec3 normal = glm::vec3(cosf(angle), 0.f, sinf(angle));
+            positions.push_back(glm::vec3(normal.x * 0.5f, t * 2.f, normal.z * 0.5f));
+            normals.push_back(normal);
+            uvs.push_back(glm::vec2((float)j / (float)segments, t));
+            joints.insert(joints.end(), { 0, 1, 0, 0 });
+            weights.push_back(glm::vec4(1.f - t, t, 0.f, 0.f));
+        }
+    }
+    std::vector<uint32_t> indices;
+    for (uint32_t i = 0; i + 1 < rings; i++) {
+        for (uint32_t j = 0; j < segments; j++) {
+            uint32_t a = i * (segments + 1) + j, b = a + 1, c = a + segments + 1, d = c + 1;
+            indices.insert(indices.end(), { a, c, b, b, c, d });
+        }
+    }
+    std::string count = std::to_string(positions.size());
+    writer.add_accessor(positions.data(), positions.size() * sizeof(glm::vec3), "\"componentType\":5126,\"type\":\"VEC3\",\"count\":" + count + ",\"min\":[-0.5,0,-0.5],\"max\":[0.5,2,0.5]");
+    writer.add_accessor(normals.data(), normals.size() * sizeof(glm::vec3), "\"componentType\":5126,\"type\":\"VEC3\",\"count\":" + count);
+    writer.add_accessor(uvs.data(), uvs.size() * sizeof(glm::vec2), "\"componentType\":5126,\"type\":\"VEC2\",\"count\":" + count);
+    writer.add_accessor(joints.data(), joints.size() * sizeof(uint16_t), "\"componentType\":5123,\"type\":\"VEC4\",\"count\":" + count);
+    writer.add_accessor(weights.data(), weights.size() * sizeof(glm::vec4), "\"componentType\":5126,\"type\":\"VEC4\",\"count\":" + count);
+    writer.add_accessor(indices.data(), indices.size() * sizeof(uint32_t), "\"componentType\":5125,\"type\":\"SCALAR\",\"count\":" + std::to_string(indices.size()));
+    glm::mat4 inverse_bind_matrices[] = { glm::mat4(1.f), glm::translate(glm::mat4(1.f), glm::vec3(0.f, -1.f, 0.f)) };
+    writer.add_accessor(inverse_bind_matrices, sizeof(inverse_bind_matrices), "\"componentType\":5126,\"type\":\"MAT4\",\"count\":2");
+    float times[] = { 0.f, 1.f };
+    writer.add_accessor(times, sizeof(times), "\"componentType\":5126,\"type\":\"SCALAR\",\"count\":2,\"min\":[0],\"max\":[1]");
+    // glTF quaternions are xyzw; the tip bends 60 degrees about z
+    float rotations[] = { 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.5f, 0.8660254f };
+    writer.add_accessor(rotations, sizeof(rotations), "\"componentType\":5126,\"type\":\"VEC4\",\"count\":2");
+    std::stringstream json;
+    if (skinned) {
+        json << "\"scenes\":[{\"nodes\":[0,1]}],"
+            << "\"nodes\":[{\"mesh\":0,\"skin\":0},{\"name\":\"root\",\"children\":[2]},{\"name\":\"tip\",\"translation\":[0,1,0]}],"
+            << "\"skins\":[{\"joints\":[1,2],\"inverseBindMatrices\":6}],"
+            << "\"animations\":[{\"channels\":[{\"sampler\":0,\"target\":{\"node\":2,\"path\":\"rotation\"}}],\"samplers\":[{\"input\":7,\"output\":8,\"interpolation\":\"LINEAR\"}]}],"
+            << "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2,\"JOINTS_0\":3,\"WEIGHTS_0\":4},\"indices\":5}]}]";
+    } else {
+        json << "\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+            << "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2},\"indices\":5}]}]";
+    }
+    writer.save(path, json.str());
+}
+struct rendered_images {
+    std::vector<uint8_t> normals, uvs;
+};
+static rendered_images render(ref<model> m, ref<shader> program, offscreen_target& target) {
+    glm::mat4 projection = glm::perspective(glm::radians(45.f), 1.f, 0.1f, 100.f);
+    glm::mat4 view = glm::lookAt(glm::vec3(3.f, 2.5f, 3.f), glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
+    std::vector<glm::mat4> palette;
+    if (m->is_animated()) {
+        // halfway through the bend, so that both weights matter
+        m->compute_bone_palette(0, m->get_animation_length(0) * 0.5f, palette);
+    }
+    rendered_images images;
+    for (int32_t show_uvs = 0; show_uvs < 2; show_uvs++) {
+        target.begin();
+        program->bind();
+        program->uniform_mat4("view_projection", projection * view);
+        program->uniform_int("skinned", m->is_animated() ? 1 : 0);
+        program->uniform_int("show_uvs", show_uvs);
+        m->draw(palette);
+        (show_uvs ? images.uvs : images.normals) = target.read_pixels();
+    }
+    return images;
+}
+static bool compare(const std::string& name, const std::vector<uint8_t>& expected, const std::vector<uint8_t>& actual) {
+    size_t covered = 0, mismatched = 0;
+    int32_t largest_difference = 0;
+    for (size_t i = 0; i < expected.size(); i += 4) {
+        if (expected[i + 3] != 0) {
+            covered++;
+        }
+        int32_t difference = 0;
+        for (size_t c = 0; c < 4; c++) {
+            difference = std::max(difference, abs((int32_t)expected[i + c] - (int32_t)actual[i + c]));
+        }
+        largest_difference = std::max(largest_difference, difference);
+        if (difference > channel_tolerance) {
+            mismatched++;
+        }
+    }
+    // an empty image would match anything
+    bool passed = covered > (size_t)(image_size * image_size / 20) && (double)mismatched <= (double)covered * max_mismatched_fraction;
+    std::string message = name + ": " + std::to_string(covered) + " pixels covered, " + std::to_string(mismatched) + " differ, largest difference " + std::to_string(largest_difference);
+    if (passed) {
+        spdlog::info(message);
+    } else {
+        spdlog::error(message);
+    }
+    return passed;
+}
+static bool compare(const std::string& name, const rendered_images& expected, const rendered_images& actual) {
+    bool normals_match = compare(name + " normals", expected.normals, actual.normals);
+    bool uvs_match = compare(name + " uvs", expected.uvs, actual.uvs);
+    return normals_match && uvs_match;
+}
+int main() {
+    ref<window> context = create_test_window(image_size, image_size);
+    if (!context) {
+        return skip_exit_code;
+    }
+    bool passed = true;
+    try {
+        std::filesystem::path directory = std::filesystem::temp_directory_path() / "libglplayground-visual-diff";
+        std::filesystem::remove_all(directory);
+        std::filesystem::create_directories(directory);
+        ref<shader> program = ref<shader>::create(shader_source{ vertex_shader, fragment_shader, "" });
+        shader_library::get()["model-static"] = program;
+        shader_library::get()["model-animated"] = program;
+        offscreen_target target(image_size, image_size);
+        vertex_format octahedral = vertex_format::compact_layout();
+        octahedral.normals = normal_encoding::octahedral;
+        std::vector<std::pair<std::string, vertex_format>> formats = {
+            { "compact", vertex_format::compact_layout() },
+            { "octahedral", octahedral },
+        };
+        for (bool skinned : { false, true }) {
+            std::string mesh_name = skinned ? "skinned" : "static";
+            std::string path = (directory / (mesh_name + ".gltf")).string();
+            write_cylinder(path, skinned);
+            rendered_images expected = render(ref<model>::create(path), program, target);
+            for (const auto& [format_name, format] : formats) {
+                model::settings s;
+                s.format = format;
+                passed &= compare(mesh_name + " " + format_name, expected, render(ref<model>::create(path, s), program, target));
+            }
+            // the first load cooks the compact vertices, and the second uploads them straight from the cooked file
+            model::settings cooked_settings;
+            cooked_settings.format = vertex_format::compact_layout();
+            cooked_settings.use_cooked_cache = true;
+            ref<model>::create(path, cooked_settings);
+            if (!std::filesystem::exists(path + model::cooked_extension)) {
+                spdlog::error(mesh_name + ": no cooked file was written");
+                passed = false;
+            }
+            passed &= compare(mesh_name + " cooked compact", expected, render(ref<model>::create(path, cooked_settings), program, target));
+        }
+        std::filesystem::remove_all(directory);
+    } catch (const std::exception& exc) {
+        spdlog::error(exc.what());
+        return 1;
+    }
+    return passed ? 0 : 1;
+}